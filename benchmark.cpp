@@ -0,0 +1,398 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#include "benchmark.h"
+
+
+const SBenchTopology bench_topologies[] =
+{
+	{"fifo",  "producer -> fifo -> consumer (test01)",				test01, test_check_point_to_point},
+	{"pipe1", "producer -> fifo -> pipe -> fifo -> consumer (test02)",		test02, test_check_point_to_point},
+	{"pipe2", "producer -> fifo -> pipe -> fifo -> pipe -> fifo -> consumer (test03)",	test03, test_check_point_to_point},
+	{"shm",   "producer process -> shared memory fifo -> consumer process (test04)",	test04, test_check_point_to_point},
+	{"tpipe1", "pipe1 with the geometry fixed at compile time (test05)",		test05, test05_check},
+	{"mpsc",  "producer threads -> fifo_mpsc -> fifo -> consumer (test06)",		test06, test06_check},
+	{"bcast", "producer -> broadcast fifo -> consumer threads (test07)",		test07, test07_check},
+	{"fanin", "producers -> fifos -> fifo_fanin (DMA) -> fifo -> consumer (test08)",	test08, test08_check},
+	{"chain", "producer -> fifo -> pipes (copy kernel) -> fifo -> consumer (test09)",	test09, test09_check},
+	{"copy",  "copy kernel: buffer -> buffer, block_size at a time (test10)",	test10, test10_check},
+	{NULL, NULL, NULL, NULL}
+};
+
+
+//---------------------------------------------------------------------------
+const SBenchTopology *
+bench_find_topology(const char * sName)
+{
+	const SBenchTopology * ptopology;
+
+	for (ptopology = bench_topologies; ptopology->sName != NULL; ptopology++) {
+		if (strcmp(ptopology->sName, sName) == 0)
+			return ptopology;
+	}
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+const char *
+bench_reader_name(unsigned int fifo_flags)
+{
+	return (fifo_flags & FIFO_FLAG_READER_CURSOR) ? "cursor" : "scan";
+}
+
+//---------------------------------------------------------------------------
+const char *
+bench_layout_name(unsigned int fifo_flags)
+{
+	if (fifo_flags & FIFO_FLAG_MIRROR)
+		return (fifo_flags & FIFO_FLAG_CACHE_ALIGNED) ? "cache-mirror" : "mirror";
+
+	return (fifo_flags & FIFO_FLAG_CACHE_ALIGNED) ? "cache" : "packed";
+}
+
+//---------------------------------------------------------------------------
+const char *
+bench_bd_name(unsigned int fifo_flags)
+{
+	return (fifo_flags & FIFO_FLAG_BD64) ? "64" : "32";
+}
+
+//---------------------------------------------------------------------------
+const char *
+bench_data_name(unsigned int data)
+{
+	static const char * const sNames[TESTDATA_MODE_COUNT] = {"scalar", "simd", "touch"};
+
+	return (data < TESTDATA_MODE_COUNT) ? sNames[data] : "unknown";
+}
+
+//---------------------------------------------------------------------------
+const char *
+bench_pipe_mode_name(unsigned int pipe_mode)
+{
+	return (pipe_mode == FIFO_PIPE_COPY) ? "copy" : "handoff";
+}
+
+//---------------------------------------------------------------------------
+static void
+bench_stat_calc(SBenchStat & stat, const std::vector<double> & values)
+{
+	double sum = 0;
+	double sqsum = 0;
+	size_t i;
+
+	stat.mean = stat.stddev = stat.min = stat.max = 0;
+	if (values.empty())
+		return;
+
+	stat.min = stat.max = values[0];
+	for (i = 0; i < values.size(); i++) {
+		sum += values[i];
+		if (values[i] < stat.min) stat.min = values[i];
+		if (values[i] > stat.max) stat.max = values[i];
+	}
+	stat.mean = sum / values.size();
+
+	/* Sample standard deviation */
+	if (values.size() > 1) {
+		for (i = 0; i < values.size(); i++)
+			sqsum += (values[i] - stat.mean) * (values[i] - stat.mean);
+		stat.stddev = std::sqrt(sqsum / (values.size() - 1));
+	}
+}
+
+//---------------------------------------------------------------------------
+CBenchmark::CBenchmark()
+ : count(TEST_COUNT)
+ , latency(false)
+ , blocking(false)
+ , dma_timing{0, 0, 0}
+ , dma_shared_bus(false)
+ , placement(place_get())
+ , warmup(1)
+ , trials(5)
+ , format(BENCH_FORMAT_CSV)
+{
+}
+
+//---------------------------------------------------------------------------
+bool
+CBenchmark::run_one(const SBenchTopology * ptopology, const struct test_config & cfg, SBenchResult & result)
+{
+	std::vector<double> mbps, blocksps, nsperblock;
+	struct test_result res;
+	unsigned int i;
+
+	result.ptopology = ptopology;
+	result.cfg = cfg;
+	result.trials = 0;
+	result.errors = 0;
+	testlatency_init(&result.latency);
+
+	for (i = 0; i < warmup; i++) {
+		std::cerr<<"warmup "<<(i+1)<<"/"<<warmup<<std::endl;
+		ptopology->fp_run(&cfg, &res);
+	}
+
+	for (i = 0; i < trials; i++) {
+		std::cerr<<"trial "<<(i+1)<<"/"<<trials<<std::endl;
+		ptopology->fp_run(&cfg, &res);
+
+		result.trials++;
+		if (res.error == true || res.time_ns == 0 || res.blocks == 0) {
+			result.errors++;
+			continue;
+		}
+
+		mbps.push_back(((double)res.bytes * 1000.0) / (double)res.time_ns);
+		blocksps.push_back(((double)res.blocks * 1e9) / (double)res.time_ns);
+		nsperblock.push_back((double)res.time_ns / (double)res.blocks);
+		testlatency_merge(&result.latency, &res.latency);
+	}
+
+	bench_stat_calc(result.mbps, mbps);
+	bench_stat_calc(result.blocksps, blocksps);
+	bench_stat_calc(result.nsperblock, nsperblock);
+
+	return result.errors == 0;
+}
+
+//---------------------------------------------------------------------------
+/*
+ * A swept parameter of the test_config. CBenchmark::run runs every combination
+ * of the values, the last entry changes fastest. A new option only needs an
+ * entry here (and its column in write_header and write_result).
+ */
+struct SBenchSweep
+{
+	const char * sName;					// in the progress log
+	std::vector<unsigned int> CBenchmark::* pvalues;
+	void (*fp_set)(struct test_config & cfg, unsigned int value);
+	const char * (*fp_name)(unsigned int value);		// NULL to log the value
+};
+
+static const SBenchSweep bench_sweep[] =
+{
+	{"fifo_size",	&CBenchmark::fifo_size,		[](struct test_config & cfg, unsigned int v) { cfg.fifo_size = v; }, NULL},
+	{"bd_count",	&CBenchmark::bd_count,		[](struct test_config & cfg, unsigned int v) { cfg.bd_count = v; }, NULL},
+	{"align",	&CBenchmark::align,		[](struct test_config & cfg, unsigned int v) { cfg.align = v; }, NULL},
+	{"block_size",	&CBenchmark::block_size,	[](struct test_config & cfg, unsigned int v) { cfg.block_size = v; }, NULL},
+	{"reader",	&CBenchmark::reader,		[](struct test_config & cfg, unsigned int v) { cfg.fifo_flags |= v; }, bench_reader_name},
+	{"layout",	&CBenchmark::layout,		[](struct test_config & cfg, unsigned int v) { cfg.fifo_flags |= v; }, bench_layout_name},
+	{"bd",		&CBenchmark::bd,		[](struct test_config & cfg, unsigned int v) { cfg.fifo_flags |= v; }, bench_bd_name},
+	{"window",	&CBenchmark::window,		[](struct test_config & cfg, unsigned int v) { cfg.pipe_window = v; }, NULL},
+	{"read_batch",	&CBenchmark::read_batch,	[](struct test_config & cfg, unsigned int v) { cfg.read_batch = v; }, NULL},
+	{"write_batch",	&CBenchmark::write_batch,	[](struct test_config & cfg, unsigned int v) { cfg.write_batch = v; }, NULL},
+	{"producers",	&CBenchmark::producers,		[](struct test_config & cfg, unsigned int v) { cfg.producers = v; }, NULL},
+	{"readers",	&CBenchmark::readers,		[](struct test_config & cfg, unsigned int v) { cfg.readers = v; }, NULL},
+	{"lossy",	&CBenchmark::lossy_readers,	[](struct test_config & cfg, unsigned int v) { cfg.lossy_readers = v; }, NULL},
+	{"hops",	&CBenchmark::hops,		[](struct test_config & cfg, unsigned int v) { cfg.hops = v; }, NULL},
+	{"workers",	&CBenchmark::pipe_workers,	[](struct test_config & cfg, unsigned int v) { cfg.pipe_workers = v; }, NULL},
+	{"pipe",	&CBenchmark::pipe_mode,		[](struct test_config & cfg, unsigned int v) { cfg.pipe_mode = (enum fifo_pipe_mode)v; }, bench_pipe_mode_name},
+	{"copy",	&CBenchmark::copy,		[](struct test_config & cfg, unsigned int v) { cfg.copy = (ECopyKernel)v; }, [](unsigned int v) { return copy_name((ECopyKernel)v); }},
+	{"data",	&CBenchmark::data,		[](struct test_config & cfg, unsigned int v) { cfg.data = (enum testdata_mode)v; }, bench_data_name},
+};
+
+static const unsigned int bench_sweep_count = sizeof(bench_sweep) / sizeof(bench_sweep[0]);
+
+//---------------------------------------------------------------------------
+/*
+ * Count up the odometer of value indexes, the last entry first.
+ * Returns false when it wrapped around, after the last combination.
+ */
+static bool
+bench_sweep_next(const CBenchmark & bench, std::vector<unsigned int> & index)
+{
+	unsigned int i;
+
+	for (i = bench_sweep_count; i > 0; i--) {
+		if (++index[i-1] < (bench.*bench_sweep[i-1].pvalues).size())
+			return true;
+		index[i-1] = 0;
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------
+bool
+CBenchmark::run(std::ostream & out)
+{
+	struct test_config cfg;
+	SBenchResult result;
+	std::vector<unsigned int> index(bench_sweep_count);	// value index of each sweep entry
+	const char * sError;
+	bool bFirst = true;
+	bool bOk = true;
+	unsigned int i;
+
+	test_config_default(&cfg);
+	cfg.count = count;
+	cfg.latency = latency;
+	cfg.blocking = blocking;
+
+	dma_ee.set_timing(dma_timing, dma_shared_bus ? &dma_bus : NULL);
+	dma_iop.set_timing(dma_timing, dma_shared_bus ? &dma_bus : NULL);
+
+	place_set(placement);
+	dma_ee.place();
+	dma_iop.place();
+	place_report(std::cerr, false);
+
+	write_header(out);
+
+	// No combinations when a parameter has no values
+	for (i = 0; i < bench_sweep_count; i++) {
+		if ((this->*bench_sweep[i].pvalues).empty()) {
+			write_footer(out);
+			return bOk;
+		}
+	}
+
+	for (const SBenchTopology * ptopology : topology) {
+		std::fill(index.begin(), index.end(), 0);
+		do {
+			cfg.fifo_flags = 0;
+			std::cerr<<"benchmark "<<ptopology->sName<<":";
+			for (i = 0; i < bench_sweep_count; i++) {
+				const SBenchSweep & sweep = bench_sweep[i];
+				unsigned int value = (this->*sweep.pvalues)[index[i]];
+
+				sweep.fp_set(cfg, value);
+				std::cerr<<" "<<sweep.sName<<"=";
+				if (sweep.fp_name != NULL)
+					std::cerr<<sweep.fp_name(value);
+				else
+					std::cerr<<value;
+			}
+			std::cerr<<std::endl;
+
+			sError = test_config_check(&cfg);
+			if ((sError == NULL) && (ptopology->fp_check != NULL))
+				sError = ptopology->fp_check(&cfg);
+			if (sError != NULL) {
+				std::cerr<<"  - skipped: "<<sError<<std::endl;
+				continue;
+			}
+
+			copy_set(cfg.copy);
+			dma_ee.set_copy(cfg.copy);
+			dma_iop.set_copy(cfg.copy);
+
+			if (run_one(ptopology, cfg, result) == false)
+				bOk = false;
+
+			write_result(out, result, bFirst);
+			bFirst = false;
+		} while (bench_sweep_next(*this, index));
+	}
+
+	write_footer(out);
+
+	return bOk;
+}
+
+//---------------------------------------------------------------------------
+static void
+write_stat_csv(std::ostream & out, const SBenchStat & stat)
+{
+	out<<","<<stat.mean<<","<<stat.stddev<<","<<stat.min<<","<<stat.max;
+}
+
+//---------------------------------------------------------------------------
+static void
+write_stat_json(std::ostream & out, const char * sName, const SBenchStat & stat)
+{
+	out<<"\""<<sName<<"\": {\"mean\": "<<stat.mean<<", \"stddev\": "<<stat.stddev<<", \"min\": "<<stat.min<<", \"max\": "<<stat.max<<"}";
+}
+
+//---------------------------------------------------------------------------
+static void
+write_latency_csv(std::ostream & out, const struct testlatency & lat)
+{
+	out<<","<<testlatency_mean(&lat);
+	out<<","<<testlatency_percentile(&lat, 50.0);
+	out<<","<<testlatency_percentile(&lat, 99.0);
+	out<<","<<testlatency_percentile(&lat, 99.9);
+	out<<","<<lat.max;
+}
+
+//---------------------------------------------------------------------------
+static void
+write_latency_json(std::ostream & out, const struct testlatency & lat)
+{
+	out<<"\"latency_ns\": {\"count\": "<<lat.count<<", \"mean\": "<<testlatency_mean(&lat);
+	out<<", \"p50\": "<<testlatency_percentile(&lat, 50.0);
+	out<<", \"p99\": "<<testlatency_percentile(&lat, 99.0);
+	out<<", \"p99.9\": "<<testlatency_percentile(&lat, 99.9);
+	out<<", \"max\": "<<lat.max<<"}";
+}
+
+//---------------------------------------------------------------------------
+void
+CBenchmark::write_header(std::ostream & out)
+{
+	if (format == BENCH_FORMAT_CSV) {
+		out<<"topology,wait,fifo_size,bd_count,align,block_size,reader,layout,bd,window,read_batch,write_batch,producers,readers,lossy,hops,workers,pipe,copy,data,count,trials,errors";
+		out<<",mbps_mean,mbps_stddev,mbps_min,mbps_max";
+		out<<",blocksps_mean,blocksps_stddev,blocksps_min,blocksps_max";
+		out<<",nsperblock_mean,nsperblock_stddev,nsperblock_min,nsperblock_max";
+		out<<",latency_mean_ns,latency_p50_ns,latency_p99_ns,latency_p999_ns,latency_max_ns";
+		out<<std::endl;
+	}
+	else {
+		out<<"{\"warmup\": "<<warmup<<", \"trials\": "<<trials;
+		out<<", \"dma\": {\"setup_ns\": "<<dma_timing.setup_ns<<", \"bandwidth\": "<<dma_timing.bandwidth;
+		out<<", \"burst_size\": "<<dma_timing.burst_size<<", \"shared_bus\": "<<(dma_shared_bus ? "true" : "false")<<"}";
+		out<<", ";
+		place_report(out, true);
+		out<<", \"results\": ["<<std::endl;
+	}
+}
+
+//---------------------------------------------------------------------------
+void
+CBenchmark::write_result(std::ostream & out, const SBenchResult & result, bool first)
+{
+	const struct test_config & cfg = result.cfg;
+
+	if (format == BENCH_FORMAT_CSV) {
+		out<<result.ptopology->sName<<","<<(cfg.blocking ? "block" : "spin")<<","<<cfg.fifo_size<<","<<cfg.bd_count<<","<<cfg.align<<","<<cfg.block_size<<","<<bench_reader_name(cfg.fifo_flags)<<","<<bench_layout_name(cfg.fifo_flags)<<","<<bench_bd_name(cfg.fifo_flags)<<","<<cfg.pipe_window<<","<<cfg.read_batch<<","<<cfg.write_batch<<","<<cfg.producers<<","<<cfg.readers<<","<<cfg.lossy_readers<<","<<cfg.hops<<","<<cfg.pipe_workers<<","<<bench_pipe_mode_name(cfg.pipe_mode)<<","<<copy_name(cfg.copy)<<","<<bench_data_name(cfg.data)<<","<<cfg.count;
+		out<<","<<result.trials<<","<<result.errors;
+		write_stat_csv(out, result.mbps);
+		write_stat_csv(out, result.blocksps);
+		write_stat_csv(out, result.nsperblock);
+		write_latency_csv(out, result.latency);
+		out<<std::endl;
+	}
+	else {
+		if (first == false)
+			out<<","<<std::endl;
+		out<<"  {\"topology\": \""<<result.ptopology->sName<<"\", \"wait\": \""<<(cfg.blocking ? "block" : "spin")<<"\"";
+		out<<", \"fifo_size\": "<<cfg.fifo_size<<", \"bd_count\": "<<cfg.bd_count<<", \"align\": "<<cfg.align;
+		out<<", \"block_size\": "<<cfg.block_size<<", \"reader\": \""<<bench_reader_name(cfg.fifo_flags)<<"\"";
+		out<<", \"layout\": \""<<bench_layout_name(cfg.fifo_flags)<<"\", \"bd\": "<<bench_bd_name(cfg.fifo_flags)<<", \"window\": "<<cfg.pipe_window<<", \"read_batch\": "<<cfg.read_batch<<", \"write_batch\": "<<cfg.write_batch<<", \"producers\": "<<cfg.producers<<", \"readers\": "<<cfg.readers<<", \"lossy\": "<<cfg.lossy_readers<<", \"hops\": "<<cfg.hops<<", \"workers\": "<<cfg.pipe_workers<<", \"pipe\": \""<<bench_pipe_mode_name(cfg.pipe_mode)<<"\", \"copy\": \""<<copy_name(cfg.copy)<<"\", \"data\": \""<<bench_data_name(cfg.data)<<"\", \"count\": "<<cfg.count;
+		out<<", \"trials\": "<<result.trials<<", \"errors\": "<<result.errors<<", ";
+		write_stat_json(out, "mbps", result.mbps);
+		out<<", ";
+		write_stat_json(out, "blocksps", result.blocksps);
+		out<<", ";
+		write_stat_json(out, "nsperblock", result.nsperblock);
+		if (result.cfg.latency) {
+			out<<", ";
+			write_latency_json(out, result.latency);
+		}
+		out<<"}"<<std::flush;
+	}
+}
+
+//---------------------------------------------------------------------------
+void
+CBenchmark::write_footer(std::ostream & out)
+{
+	if (format == BENCH_FORMAT_JSON)
+		out<<std::endl<<"]}"<<std::endl;
+}
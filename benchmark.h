@@ -0,0 +1,124 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "testcommon.h"
+#include "cdmasim.h"
+
+
+typedef void (*fp_test)(const struct test_config * pcfg, struct test_result * pres);
+typedef const char * (*fp_test_check)(const struct test_config * pcfg);
+
+/*
+ * A datapath that can be benchmarked
+ */
+struct SBenchTopology
+{
+	const char * sName;
+	const char * sDescription;
+	fp_test fp_run;
+	fp_test_check fp_check;	// NULL when every valid test_config can be run
+};
+
+extern const SBenchTopology bench_topologies[];
+
+/*
+ * Mean, standard deviation, min and max of one metric over all trials
+ */
+struct SBenchStat
+{
+	double mean;
+	double stddev;
+	double min;
+	double max;
+};
+
+/*
+ * Summary of all trials of one configuration
+ */
+struct SBenchResult
+{
+	const SBenchTopology * ptopology;
+	struct test_config cfg;
+
+	unsigned int trials;
+	unsigned int errors;
+
+	SBenchStat mbps;		// MB/s (10^6 bytes per second)
+	SBenchStat blocksps;		// blocks per second
+	SBenchStat nsperblock;		// nanoseconds per block
+
+	struct testlatency latency;	// all trials merged, when enabled
+};
+
+enum EBenchFormat
+{
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON,
+};
+
+/*
+ * Runs every combination of the sweep parameters, with a number of warmup
+ * runs (not measured) and trials (measured) for each combination.
+ */
+class CBenchmark
+{
+public:
+	CBenchmark();
+
+	std::vector<const SBenchTopology *> topology;
+	std::vector<unsigned int> fifo_size;
+	std::vector<unsigned int> bd_count;
+	std::vector<unsigned int> align;
+	std::vector<unsigned int> block_size;
+	std::vector<unsigned int> reader;	// 0 (scan) or FIFO_FLAG_READER_CURSOR
+	std::vector<unsigned int> layout;	// 0 (packed), FIFO_FLAG_CACHE_ALIGNED, FIFO_FLAG_MIRROR or both
+	std::vector<unsigned int> bd;		// 0 (32bit) or FIFO_FLAG_BD64
+	std::vector<unsigned int> window;	// outstanding transfers per pipe, 0 for no limit
+	std::vector<unsigned int> read_batch;	// blocks consumed at once, 0 for one at a time
+	std::vector<unsigned int> write_batch;	// blocks produced at once, 0 for one at a time
+	std::vector<unsigned int> producers;	// producer threads, only for the mpsc and fanin topologies
+	std::vector<unsigned int> readers;	// lossless readers, only for the bcast topology
+	std::vector<unsigned int> lossy_readers;	// lossy readers, only for the bcast topology
+	std::vector<unsigned int> hops;		// pipes in a row, only for the chain topology
+	std::vector<unsigned int> pipe_workers;	// executor threads, 0 for a thread per pipe, only for the chain topology
+	std::vector<unsigned int> pipe_mode;	// FIFO_PIPE_COPY or FIFO_PIPE_HANDOFF, only for the chain topology
+	std::vector<unsigned int> copy;		// ECopyKernel of the copying pipes and the DMA engines
+	std::vector<unsigned int> data;		// testdata_mode of the producers and consumers
+	unsigned int count;
+	bool latency;
+	bool blocking;
+
+	SDMATiming dma_timing;		// timing model of both DMA engines
+	bool dma_shared_bus;		// both DMA engines share one bus
+	SPlacement placement;		// CPUs of the threads and NUMA node of the fifos
+
+	unsigned int warmup;
+	unsigned int trials;
+
+	EBenchFormat format;
+
+	bool run(std::ostream & out);
+
+private:
+	bool run_one(const SBenchTopology * ptopology, const struct test_config & cfg, SBenchResult & result);
+
+	void write_header(std::ostream & out);
+	void write_result(std::ostream & out, const SBenchResult & result, bool first);
+	void write_footer(std::ostream & out);
+};
+
+
+const SBenchTopology * bench_find_topology(const char * sName);
+const char * bench_reader_name(unsigned int fifo_flags);
+const char * bench_layout_name(unsigned int fifo_flags);
+const char * bench_bd_name(unsigned int fifo_flags);
+const char * bench_data_name(unsigned int data);
+const char * bench_pipe_mode_name(unsigned int pipe_mode);
+
+
+#endif // BENCHMARK_H
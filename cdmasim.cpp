@@ -1,18 +1,77 @@
 #include <string.h> // memcpy
+#include <assert.h>
 #include <iostream>
+#include <chrono>
 
 #include "cdmasim.h"
+#include "placement.h"
+#include "fifo_pipe.h"
 
 
+/* Waits longer than this sleep, shorter waits spin */
+#define DMA_SPIN_NS	(50*1000)
+
+static_assert(FIFO_PIPE_MAX_SEGMENTS <= DMA_CHAIN_MAX, "A fifo_pipe transfer must fit in one DMA chain");
+
+
+CDMABus dma_bus;
 CDMASim dma_ee ("DMA_EE");
 CDMASim dma_iop("DMA_IOP");
 
 
+//---------------------------------------------------------------------------
+uint64_t
+dma_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//---------------------------------------------------------------------------
+static void
+dma_wait_until(uint64_t t_ns)
+{
+	uint64_t now = dma_now();
+
+	if (t_ns > now + DMA_SPIN_NS)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(t_ns - now - DMA_SPIN_NS));
+
+	while (dma_now() < t_ns)
+		std::this_thread::yield();
+}
+
+//---------------------------------------------------------------------------
+CDMABus::CDMABus()
+ : busy_until_ns(0)
+{
+}
+
+//---------------------------------------------------------------------------
+uint64_t
+CDMABus::reserve(uint64_t start_ns, uint64_t duration_ns)
+{
+	std::unique_lock<std::mutex> locker(mutex);
+
+	if (start_ns < busy_until_ns)
+		start_ns = busy_until_ns;
+	busy_until_ns = start_ns + duration_ns;
+
+	return busy_until_ns;
+}
+
+
 //---------------------------------------------------------------------------
 CDMASim::CDMASim(const char * sName)
  : sName(sName)
- , thr(&CDMASim::mainloop, this)
  , bExit(false)
+ , bSleeping(false)
+ , head(init_queue())
+ , tail(0)
+ , bTimed(false)
+ , timing{0, 0, 0}
+ , pbus(NULL)
+ , time_ns(0)
+ , copy(COPY_MEMCPY)
+ , thr(&CDMASim::mainloop, this)
 {
 }
 
@@ -27,71 +86,233 @@ CDMASim::~CDMASim()
 	thr.join();
 }
 
+//---------------------------------------------------------------------------
+unsigned int
+CDMASim::init_queue()
+{
+	unsigned int i;
+
+	for (i = 0; i < DMA_QUEUE_SIZE; i++)
+		queue[i].seq.store(i, std::memory_order_relaxed);
+
+	// First position
+	return 0;
+}
+
 //---------------------------------------------------------------------------
 void
 CDMASim::put(void *dst, const void *src, size_t size, fp_dma_completion_callback fp_compl, void * fp_compl_arg)
 {
-	SDMAOperation * pdmaop = new SDMAOperation;
+	SDMASegment segment = {dst, src, size};
+
+	put(&segment, 1, fp_compl, fp_compl_arg);
+}
+
+//---------------------------------------------------------------------------
+void
+CDMASim::put(const SDMASegment * psegment, unsigned int count, fp_dma_completion_callback fp_compl, void * fp_compl_arg)
+{
+	unsigned int pos = head.load(std::memory_order_relaxed);
+	SDMASlot * pslot;
+	unsigned int i;
+	int diff;
+
+	assert(count <= DMA_CHAIN_MAX);
+	if (bExit)
+		return;
+
+	// Reserve a slot
+	while (true) {
+		pslot = &queue[pos & (DMA_QUEUE_SIZE-1)];
+		diff = (int)(pslot->seq.load(std::memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			// Queue full, like hardware we stall until there is room
+			std::this_thread::yield();
+			pos = head.load(std::memory_order_relaxed);
+		}
+		else {
+			// Another put was faster
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
 
-	pdmaop->dst = dst;
-	pdmaop->src = src;
-	pdmaop->size = size;
-	pdmaop->fp_compl = fp_compl;
-	pdmaop->fp_compl_arg = fp_compl_arg;
+	pslot->op.count = count;
+	pslot->op.size = 0;
+	for (i = 0; i < count; i++) {
+		pslot->op.segment[i] = psegment[i];
+		pslot->op.size += psegment[i].size;
+	}
+	pslot->op.fp_compl = fp_compl;
+	pslot->op.fp_compl_arg = fp_compl_arg;
+	pslot->op.submit_ns = bTimed ? dma_now() : 0;
 
-	put(pdmaop);
+	// Queue the operation, then check if the DMA went to sleep (see mainloop)
+	pslot->seq.store(pos + 1, std::memory_order_seq_cst);
+	if (bSleeping.load(std::memory_order_seq_cst)) {
+		std::unique_lock<std::mutex> locker(mutex);
+		cv.notify_one();
+	}
+}
+
+//---------------------------------------------------------------------------
+bool
+CDMASim::ready()
+{
+	unsigned int pos = tail.load(std::memory_order_relaxed);
+
+	return queue[pos & (DMA_QUEUE_SIZE-1)].seq.load(std::memory_order_seq_cst) == (pos + 1);
 }
 
 //---------------------------------------------------------------------------
 void
 CDMASim::mainloop()
 {
-	std::cout<<sName<<" running"<<std::endl;
+	std::cerr<<sName<<" running"<<std::endl;
 
-	while(bExit == false)
+	while (true)
 	{
-		SDMAOperation * pdmaop = get();
-		if (pdmaop == NULL)
+		// Execute everything that is queued
+		while (ready()) {
+			unsigned int pos = tail.load(std::memory_order_relaxed);
+			SDMASlot * pslot = &queue[pos & (DMA_QUEUE_SIZE-1)];
+
+			execute(pslot->op);
+
+			pslot->seq.store(pos + DMA_QUEUE_SIZE, std::memory_order_release);
+			tail.store(pos + 1, std::memory_order_release);
+		}
+
+		// Empty, go to sleep. Check again after telling put we are sleeping.
+		std::unique_lock<std::mutex> locker(mutex);
+		bSleeping.store(true, std::memory_order_seq_cst);
+		if ((ready() == false) && (bExit == true))
 			break;
+		cv_idle.notify_all();
+		cv.wait(locker, [this]{ return ready() || bExit; });
+		bSleeping.store(false, std::memory_order_relaxed);
+	}
+
+	std::cerr<<sName<<" stopping"<<std::endl;
+}
+
+//---------------------------------------------------------------------------
+void
+CDMASim::execute(const SDMAOperation & op)
+{
+	fp_copy fp = copy_select(copy, op.size);
+	uint64_t t, duration;
+	size_t remaining, burst;
+	unsigned int i;
+
+	if (bTimed) {
+		// The engine can only start when the previous transfer is done, one setup for the entire chain
+		t = (op.submit_ns > time_ns) ? op.submit_ns : time_ns;
+		t += timing.setup_ns;
 
-		memcpy(pdmaop->dst, pdmaop->src, pdmaop->size);
-		if (pdmaop->fp_compl != NULL)
-			pdmaop->fp_compl(pdmaop->fp_compl_arg);
+		remaining = op.size;
+		do {
+			burst = ((timing.burst_size != 0) && (remaining > timing.burst_size)) ? timing.burst_size : remaining;
+			duration = (timing.bandwidth != 0) ? (burst * 1000000000ULL) / timing.bandwidth : 0;
 
-		delete pdmaop;
+			if (pbus != NULL) {
+				// Wait for each burst, so other engines can get the bus in between
+				t = pbus->reserve(t, duration);
+				dma_wait_until(t);
+			}
+			else {
+				t += duration;
+			}
+
+			remaining -= burst;
+		} while (remaining > 0);
+
+		for (i = 0; i < op.count; i++)
+			fp(op.segment[i].dst, op.segment[i].src, op.segment[i].size);
+		dma_wait_until(t);
+		time_ns = t;
+	}
+	else {
+		for (i = 0; i < op.count; i++)
+			fp(op.segment[i].dst, op.segment[i].src, op.segment[i].size);
 	}
 
-	std::cout<<sName<<" stopping"<<std::endl;
+	if (op.fp_compl != NULL)
+		op.fp_compl(op.fp_compl_arg);
+}
+
+//---------------------------------------------------------------------------
+void
+CDMASim::set_timing(const SDMATiming & timing, CDMABus * pbus)
+{
+	this->timing = timing;
+	this->pbus = pbus;
+	time_ns = 0;
+	bTimed = (timing.setup_ns != 0) || (timing.bandwidth != 0);
+}
+
+//---------------------------------------------------------------------------
+void
+CDMASim::set_copy(ECopyKernel kernel)
+{
+	copy = kernel;
 }
 
 //---------------------------------------------------------------------------
-SDMAOperation *
-CDMASim::get()
+void
+CDMASim::place()
 {
-	SDMAOperation * pdmaop;
+	place_thread(thr, PLACE_DMA);
+}
 
+//---------------------------------------------------------------------------
+void
+CDMASim::sync()
+{
 	std::unique_lock<std::mutex> locker(mutex);
-	cv.wait(locker, [this]{return (!queue.empty() || (queue.empty() && bExit));});
 
-	if (queue.empty() && bExit)
-		return NULL;
+	// Wait until all operations, including their completion callbacks, are done
+	cv_idle.wait(locker, [this]{ return tail.load() == head.load(); });
+}
 
-	pdmaop = queue.front();
-	queue.pop_front();
+//---------------------------------------------------------------------------
+static void
+cdmasim_transfer_complete(void * arg)
+{
+	struct fifo_pipe_transfer *ptransfer = (struct fifo_pipe_transfer *)arg;
 
-	return pdmaop;
+	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
 }
 
 //---------------------------------------------------------------------------
 void
-CDMASim::put(SDMAOperation * pdmaop)
+cdmasim_transfer(CDMASim & dma, struct fifo_pipe_transfer * ptransfer, fp_dma_completion_callback fp_compl)
 {
-	std::unique_lock<std::mutex> locker(mutex);
+	SDMASegment segment[FIFO_PIPE_MAX_SEGMENTS];
+	unsigned int i;
 
-	if (bExit)
-		return;
+	// One DMA chain for all segments
+	for (i = 0; i < ptransfer->segment_count; i++) {
+		segment[i].dst  = ptransfer->segment[i].dst;
+		segment[i].src  = ptransfer->segment[i].src;
+		segment[i].size = ptransfer->segment[i].size;
+	}
+	dma.put(segment, ptransfer->segment_count, (fp_compl != NULL) ? fp_compl : cdmasim_transfer_complete, ptransfer);
+}
 
-	queue.push_back(pdmaop);
+//---------------------------------------------------------------------------
+void
+cdmasim_transfer_ee(struct fifo_pipe_transfer * ptransfer)
+{
+	cdmasim_transfer(dma_ee, ptransfer);
+}
 
-	cv.notify_one();
+//---------------------------------------------------------------------------
+void
+cdmasim_transfer_iop(struct fifo_pipe_transfer * ptransfer)
+{
+	cdmasim_transfer(dma_iop, ptransfer);
 }
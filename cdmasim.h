@@ -5,19 +5,85 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <list>
+#include <atomic>
 #include <string>
+#include <stdint.h>
+
+#include "copykernel.h"
 
 typedef void (*fp_dma_completion_callback)(void * arg);
 
-struct SDMAOperation
+struct fifo_pipe_transfer;
+
+/* Max number of segments in one DMA chain */
+#define DMA_CHAIN_MAX	(8)
+
+struct SDMASegment
 {
 	void *dst;
 	const void *src;
 	size_t size;
+};
+
+/*
+ * A chain of segments, executed as one transfer with one completion
+ */
+struct SDMAOperation
+{
+	SDMASegment segment[DMA_CHAIN_MAX];
+	unsigned int count;
+	size_t size;		// total size of all segments
 
 	fp_dma_completion_callback fp_compl;
 	void * fp_compl_arg;
+
+	uint64_t submit_ns;	// time of put, only with a timing model
+};
+
+/*
+ * Timing model of a DMA engine
+ *
+ * A transfer takes setup_ns, followed by bursts of burst_size bytes at
+ * bandwidth bytes per second. Between bursts the bus can be used by another
+ * engine (see CDMABus). The completion callback is called when the transfer
+ * is done on this simulated timeline.
+ */
+struct SDMATiming
+{
+	uint64_t setup_ns;	// time from the start of a transfer to the first byte
+	uint64_t bandwidth;	// bytes per second, 0 for as fast as memcpy
+	size_t burst_size;	// bytes per burst, 0 for the entire transfer in one burst
+};
+
+/*
+ * Bus that is shared between DMA engines, only one burst at a time
+ */
+class CDMABus
+{
+public:
+	CDMABus();
+
+	uint64_t reserve(uint64_t start_ns, uint64_t duration_ns);
+
+private:
+	std::mutex mutex;
+	uint64_t busy_until_ns;
+};
+
+/* Number of operations that can be queued, must be a power of 2 */
+#define DMA_QUEUE_SIZE	(256)
+
+/*
+ * Slot in the DMA queue
+ *
+ * seq == position:                  free, the next put can use it
+ * seq == position + 1:              queued, the DMA can execute it
+ * seq == position + DMA_QUEUE_SIZE: done, free for the next round
+ */
+struct SDMASlot
+{
+	std::atomic<unsigned int> seq;
+	SDMAOperation op;
 };
 
 class CDMASim
@@ -27,27 +93,69 @@ public:
 	~CDMASim();
 
 	void put(void *dst, const void *src, size_t size, fp_dma_completion_callback fp_compl = NULL, void * compl_arg = NULL);
+	void put(const SDMASegment * psegment, unsigned int count, fp_dma_completion_callback fp_compl = NULL, void * compl_arg = NULL);
+	void sync();
+
+	// NOTE: Only change the timing when the DMA is idle
+	void set_timing(const SDMATiming & timing, CDMABus * pbus = NULL);
+
+	// NOTE: Only change the copy kernel when the DMA is idle
+	void set_copy(ECopyKernel kernel);
+
+	// Pin the DMA thread to the CPUs of PLACE_DMA (see placement.h)
+	void place();
 
 private:
 	void mainloop();
-	void put(SDMAOperation * pdmaop);
-	SDMAOperation * get();
+	void execute(const SDMAOperation & op);
+	unsigned int init_queue();
+	bool ready();
 
 private:
 	std::string sName;
 
-	std::thread thr;
 	volatile bool bExit;
 
+	// Only used when the DMA goes to sleep, or to wait for it in sync
 	std::mutex mutex;
 	std::condition_variable	cv;
+	std::condition_variable	cv_idle;
+	std::atomic<bool> bSleeping;
+
+	// Bounded queue, lock-free for (multiple) callers of put
+	SDMASlot queue[DMA_QUEUE_SIZE];
+	std::atomic<unsigned int> head;		// next position to put
+	std::atomic<unsigned int> tail;		// next position to execute
+
+	// Timing model, only used by the DMA thread
+	volatile bool bTimed;
+	SDMATiming timing;
+	CDMABus * pbus;
+	uint64_t time_ns;			// simulated time the last transfer completed
+
+	// Copy kernel, only used by the DMA thread
+	volatile ECopyKernel copy;
 
-	std::list<SDMAOperation *> queue;
+	// Must be last: the thread starts running before the constructor returns
+	std::thread thr;
 };
 
 
 extern CDMASim dma_ee;
 extern CDMASim dma_iop;
+extern CDMABus dma_bus;
+
+uint64_t dma_now();
+
+/*
+ * Transfer of a fifo_pipe as one DMA chain on dma, fp_compl must commit it
+ * (NULL for fifo_pipe_transfer_commit)
+ */
+void cdmasim_transfer(CDMASim & dma, struct fifo_pipe_transfer * ptransfer, fp_dma_completion_callback fp_compl = NULL);
+
+/* fp_pipe_transfer on dma_ee and dma_iop, committed with fifo_pipe_transfer_commit */
+void cdmasim_transfer_ee(struct fifo_pipe_transfer * ptransfer);
+void cdmasim_transfer_iop(struct fifo_pipe_transfer * ptransfer);
 
 
 #endif // CDMASIM_H
@@ -0,0 +1,244 @@
+#include <string.h> // memcpy
+#include <stdint.h>
+
+#include "copykernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COPY_X86
+#endif
+
+
+/* Smaller copies are done with memcpy by the streaming kernels, aligning the destination costs more than it saves */
+#define COPY_NT_MIN_SIZE	(256)
+
+static const char * kernel_name[COPY_KERNEL_COUNT] =
+{
+	"memcpy",
+	"auto",
+	"avx2",
+	"avx2-nt",
+	"avx512-nt",
+};
+
+static ECopyKernel kernel_current = COPY_MEMCPY;
+
+
+//---------------------------------------------------------------------------
+static void
+copy_memcpy(void * dst, const void * src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+#ifdef COPY_X86
+//---------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void
+copy_avx2(void * dst, const void * src, size_t size)
+{
+	uint8_t * d = (uint8_t *)dst;
+	const uint8_t * s = (const uint8_t *)src;
+	__m256i v0, v1, v2, v3;
+
+	while (size >= 128) {
+		v0 = _mm256_loadu_si256((const __m256i *)(s +  0));
+		v1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+		v2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+		v3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+		_mm256_storeu_si256((__m256i *)(d +  0), v0);
+		_mm256_storeu_si256((__m256i *)(d + 32), v1);
+		_mm256_storeu_si256((__m256i *)(d + 64), v2);
+		_mm256_storeu_si256((__m256i *)(d + 96), v3);
+		s += 128;
+		d += 128;
+		size -= 128;
+	}
+	while (size >= 32) {
+		_mm256_storeu_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+		s += 32;
+		d += 32;
+		size -= 32;
+	}
+	memcpy(d, s, size);
+}
+
+//---------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void
+copy_avx2_nt(void * dst, const void * src, size_t size)
+{
+	uint8_t * d = (uint8_t *)dst;
+	const uint8_t * s = (const uint8_t *)src;
+	__m256i v0, v1, v2, v3;
+	size_t head;
+
+	if (size < COPY_NT_MIN_SIZE) {
+		memcpy(d, s, size);
+		return;
+	}
+
+	// Streaming stores need an aligned destination
+	head = (32 - ((uintptr_t)d & 31)) & 31;
+	memcpy(d, s, head);
+	s += head;
+	d += head;
+	size -= head;
+
+	while (size >= 128) {
+		v0 = _mm256_loadu_si256((const __m256i *)(s +  0));
+		v1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+		v2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+		v3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+		_mm256_stream_si256((__m256i *)(d +  0), v0);
+		_mm256_stream_si256((__m256i *)(d + 32), v1);
+		_mm256_stream_si256((__m256i *)(d + 64), v2);
+		_mm256_stream_si256((__m256i *)(d + 96), v3);
+		s += 128;
+		d += 128;
+		size -= 128;
+	}
+	while (size >= 32) {
+		_mm256_stream_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+		s += 32;
+		d += 32;
+		size -= 32;
+	}
+	memcpy(d, s, size);
+
+	// Streaming stores are weakly ordered, finish them before the BDs are published
+	_mm_sfence();
+}
+
+//---------------------------------------------------------------------------
+__attribute__((target("avx512f")))
+static void
+copy_avx512_nt(void * dst, const void * src, size_t size)
+{
+	uint8_t * d = (uint8_t *)dst;
+	const uint8_t * s = (const uint8_t *)src;
+	__m512i v0, v1, v2, v3;
+	size_t head;
+
+	if (size < COPY_NT_MIN_SIZE) {
+		memcpy(d, s, size);
+		return;
+	}
+
+	// Streaming stores need an aligned destination
+	head = (64 - ((uintptr_t)d & 63)) & 63;
+	memcpy(d, s, head);
+	s += head;
+	d += head;
+	size -= head;
+
+	while (size >= 256) {
+		v0 = _mm512_loadu_si512((const void *)(s +   0));
+		v1 = _mm512_loadu_si512((const void *)(s +  64));
+		v2 = _mm512_loadu_si512((const void *)(s + 128));
+		v3 = _mm512_loadu_si512((const void *)(s + 192));
+		_mm512_stream_si512((__m512i *)(d +   0), v0);
+		_mm512_stream_si512((__m512i *)(d +  64), v1);
+		_mm512_stream_si512((__m512i *)(d + 128), v2);
+		_mm512_stream_si512((__m512i *)(d + 192), v3);
+		s += 256;
+		d += 256;
+		size -= 256;
+	}
+	while (size >= 64) {
+		_mm512_stream_si512((__m512i *)d, _mm512_loadu_si512((const void *)s));
+		s += 64;
+		d += 64;
+		size -= 64;
+	}
+	memcpy(d, s, size);
+
+	// Streaming stores are weakly ordered, finish them before the BDs are published
+	_mm_sfence();
+}
+#endif // COPY_X86
+
+//---------------------------------------------------------------------------
+const char *
+copy_name(ECopyKernel kernel)
+{
+	return (kernel < COPY_KERNEL_COUNT) ? kernel_name[kernel] : "unknown";
+}
+
+//---------------------------------------------------------------------------
+bool
+copy_supported(ECopyKernel kernel)
+{
+#ifdef COPY_X86
+	static const bool bAvx2 = __builtin_cpu_supports("avx2");
+	static const bool bAvx512 = __builtin_cpu_supports("avx512f");
+#else
+	static const bool bAvx2 = false;
+	static const bool bAvx512 = false;
+#endif
+
+	switch (kernel) {
+		case COPY_MEMCPY:
+		case COPY_AUTO:
+			return true;
+		case COPY_AVX2:
+		case COPY_AVX2_NT:
+			return bAvx2;
+		case COPY_AVX512_NT:
+			return bAvx512;
+		default:
+			return false;
+	}
+}
+
+//---------------------------------------------------------------------------
+fp_copy
+copy_select(ECopyKernel kernel, size_t size)
+{
+	// Small transfers stay in the cache, the reader is likely to find them there
+	if (kernel == COPY_AUTO) {
+		if (size < COPY_NT_THRESHOLD)
+			return copy_memcpy;
+		kernel = copy_supported(COPY_AVX512_NT) ? COPY_AVX512_NT : COPY_AVX2_NT;
+	}
+
+	if (copy_supported(kernel) == false)
+		return copy_memcpy;
+
+#ifdef COPY_X86
+	switch (kernel) {
+		case COPY_AVX2:		return copy_avx2;
+		case COPY_AVX2_NT:	return copy_avx2_nt;
+		case COPY_AVX512_NT:	return copy_avx512_nt;
+		default:		break;
+	}
+#endif
+
+	return copy_memcpy;
+}
+
+//---------------------------------------------------------------------------
+void
+copy_set(ECopyKernel kernel)
+{
+	kernel_current = kernel;
+}
+
+//---------------------------------------------------------------------------
+ECopyKernel
+copy_get()
+{
+	return kernel_current;
+}
+
+//---------------------------------------------------------------------------
+void
+copy_transfer(struct fifo_pipe_transfer * ptransfer)
+{
+	fp_copy fp = copy_select(kernel_current, ptransfer->size);
+	unsigned int seg;
+
+	for (seg = 0; seg < ptransfer->segment_count; seg++)
+		fp(ptransfer->segment[seg].dst, ptransfer->segment[seg].src, ptransfer->segment[seg].size);
+	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
+}
@@ -0,0 +1,47 @@
+#ifndef COPYKERNEL_H
+#define COPYKERNEL_H
+
+
+#include <stddef.h>
+
+#include "fifo_pipe.h"
+
+
+/*
+ * Copy kernels for the pipes and DMA engines
+ *
+ * The destination of a transfer is read by another thread, so for large
+ * transfers the streaming (non-temporal) kernels keep it out of the cache of
+ * the copying CPU. A kernel the CPU does not support falls back to memcpy.
+ */
+enum ECopyKernel
+{
+	COPY_MEMCPY = 0,
+	COPY_AUTO,		// memcpy for small transfers, the best streaming kernel for large ones
+	COPY_AVX2,		// 32 byte loads and stores
+	COPY_AVX2_NT,		// 32 byte loads and streaming stores
+	COPY_AVX512_NT,		// 64 byte loads and streaming stores
+	COPY_KERNEL_COUNT
+};
+
+/* Smallest transfer COPY_AUTO copies with streaming stores */
+#define COPY_NT_THRESHOLD	(8*1024)
+
+typedef void (*fp_copy)(void * dst, const void * src, size_t size);
+
+
+const char * copy_name(ECopyKernel kernel);
+bool copy_supported(ECopyKernel kernel);
+
+// The function that copies one transfer of size bytes
+fp_copy copy_select(ECopyKernel kernel, size_t size);
+
+// Kernel used by copy_transfer from now on
+void copy_set(ECopyKernel kernel);
+ECopyKernel copy_get();
+
+// Transfer function of a fifo_pipe (fifo_pipe.fp_transfer), copies the segments with the kernel of copy_set
+void copy_transfer(struct fifo_pipe_transfer * ptransfer);
+
+
+#endif // COPYKERNEL_H
@@ -1,23 +1,72 @@
 #include <iostream>
+#include <chrono>
 
 #include "cpipe.h"
+#include "placement.h"
 
-#include "fifo_pipe.h"
+
+static const char * state_name[FIFO_PIPE_STATUS_COUNT] =
+{
+	"empty",
+	"dst-full",
+	"window-full",
+	"submitted",
+};
+
+
+//---------------------------------------------------------------------------
+static uint64_t
+now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 
 //---------------------------------------------------------------------------
-CPipe::CPipe(const char * sName, struct fifo_pipe * ppipe)
+CPipe::CPipe(const char * sName, struct fifo_pipe * ppipe, fp_pipe_transfer fp_transfer)
  : sName(sName)
- , thr(&CPipe::mainloop, this)
  , bExit(false)
  , wake_count(0)
  , ppipe(ppipe)
+ , fp_transfer(fp_transfer)
+ , pfanin(NULL)
+ , state(FIFO_PIPE_EMPTY)
+ , state_since_ns(now_ns())
+ , time_ns{}
+ , count{}
+ , thr(&CPipe::mainloop, this)
+{
+}
+
+//---------------------------------------------------------------------------
+CPipe::CPipe(const char * sName, struct fifo_fanin * pfanin)
+ : sName(sName)
+ , bExit(false)
+ , wake_count(0)
+ , ppipe(NULL)
+ , fp_transfer(NULL)
+ , pfanin(pfanin)
+ , state(FIFO_PIPE_EMPTY)
+ , state_since_ns(now_ns())
+ , time_ns{}
+ , count{}
+ , thr(&CPipe::mainloop, this)
 {
 }
 
 //---------------------------------------------------------------------------
 CPipe::~CPipe()
 {
+	stop();
+}
+
+//---------------------------------------------------------------------------
+void
+CPipe::stop()
+{
+	if (thr.joinable() == false)
+		return;
+
 	bExit = true;
 	CPipe::wakeup(this);
 	thr.join();
@@ -27,12 +76,26 @@ CPipe::~CPipe()
 void
 CPipe::mainloop()
 {
-	std::cout<<sName<<" running"<<std::endl;
+	// No transfer pool: fifo_pipe_init of the pipe failed
+	if ((ppipe != NULL) && (ppipe->ptransfer_pool == NULL)) {
+		std::cerr<<sName<<" not running, the pipe is not initialized"<<std::endl;
+		return;
+	}
+
+	std::cerr<<sName<<" running"<<std::endl;
+	place_thread(PLACE_PIPE);
 
 	while(bExit == false)
 	{
 		// Fill the pipe
-		while (fifo_pipe_transfer(ppipe) > 1);
+		while (transfer() == FIFO_PIPE_SUBMITTED);
+
+		// Ask the fifos for a wake-up, then make sure we did not miss one
+		set_waiting(1);
+		if (transfer() == FIFO_PIPE_SUBMITTED) {
+			set_waiting(0);
+			continue;
+		}
 
 		// Wait for wake-ups
 		{
@@ -40,9 +103,59 @@ CPipe::mainloop()
 			cv.wait(locker, [this]{ return wake_count > 0; });
 			wake_count--;
 		}
+		set_waiting(0);
 	}
 
-	std::cout<<sName<<" stopping"<<std::endl;
+	transfer();
+	print_stats();
+	std::cerr<<sName<<" stopping"<<std::endl;
+}
+
+//---------------------------------------------------------------------------
+enum fifo_pipe_status
+CPipe::transfer()
+{
+	enum fifo_pipe_status status = (pfanin != NULL) ? fifo_fanin_transfer(pfanin) : fp_transfer(ppipe);
+	uint64_t now = now_ns();
+
+	// The time since the last transfer was spent in the state it returned
+	time_ns[state] += now - state_since_ns;
+	state_since_ns = now;
+	state = status;
+	count[status]++;
+
+	return status;
+}
+
+//---------------------------------------------------------------------------
+void
+CPipe::set_waiting(unsigned int waiting)
+{
+	if (pfanin != NULL)
+		fifo_fanin_set_waiting(pfanin, waiting);
+	else
+		fifo_pipe_set_waiting(ppipe, waiting);
+}
+
+//---------------------------------------------------------------------------
+void
+CPipe::print_stats()
+{
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < FIFO_PIPE_STATUS_COUNT; i++)
+		total += time_ns[i];
+	if (total == 0)
+		return;
+
+	if (pfanin != NULL)
+		std::cerr<<sName<<" sources="<<pfanin->source_count;
+	else
+		std::cerr<<sName<<" window="<<ppipe->window;
+	for (i = 0; i < FIFO_PIPE_STATUS_COUNT; i++)
+		std::cerr<<" "<<state_name[i]<<"="<<count[i]<<"/"<<(time_ns[i] * 100 / total)<<"%";
+	std::cerr<<std::endl;
 }
 
 //---------------------------------------------------------------------------
@@ -6,22 +6,39 @@
 #include <mutex>
 #include <condition_variable>
 #include <string>
+#include <stdint.h>
+
+#include "fifo_pipe.h"
+#include "fifo_fanin.h"
+
+typedef enum fifo_pipe_status (*fp_pipe_transfer)(struct fifo_pipe * ppipe);
 
 class CPipe
 {
 public:
-	CPipe(const char * sName, struct fifo_pipe * ppipe);
+	// fp_transfer: fifo_pipe_transfer, or a specialized version (see datafifo.h)
+	CPipe(const char * sName, struct fifo_pipe * ppipe, fp_pipe_transfer fp_transfer = fifo_pipe_transfer);
+	// Same thread for a fan-in, transfers from all its sources
+	CPipe(const char * sName, struct fifo_fanin * pfanin);
 	~CPipe();
 
+	void stop();
+
 	static void wakeup(void * arg);
 
+	// Time spent in each state, after the transfer that returned that state
+	uint64_t get_time_ns(enum fifo_pipe_status status) const { return time_ns[status]; }
+	unsigned int get_count(enum fifo_pipe_status status) const { return count[status]; }
+
 private:
 	void mainloop();
+	enum fifo_pipe_status transfer();
+	void set_waiting(unsigned int waiting);
+	void print_stats();
 
 private:
 	std::string sName;
 
-	std::thread thr;
 	volatile bool bExit;
 
 	std::mutex mutex;
@@ -29,6 +46,16 @@ private:
 	volatile int wake_count;
 
 	struct fifo_pipe * ppipe;
+	fp_pipe_transfer fp_transfer;
+	struct fifo_fanin * pfanin;		// instead of ppipe
+
+	enum fifo_pipe_status state;
+	uint64_t state_since_ns;
+	uint64_t time_ns[FIFO_PIPE_STATUS_COUNT];
+	unsigned int count[FIFO_PIPE_STATUS_COUNT];
+
+	// Must be last: the thread starts running before the constructor returns
+	std::thread thr;
 };
 
 
@@ -0,0 +1,302 @@
+#include <iostream>
+
+#include "cpipeexecutor.h"
+#include "placement.h"
+
+
+static const char * state_name[FIFO_PIPE_STATUS_COUNT] =
+{
+	"empty",
+	"dst-full",
+	"window-full",
+	"submitted",
+};
+
+
+//---------------------------------------------------------------------------
+CPipeExecutor::CPipeExecutor(unsigned int workers)
+ : bExit(false)
+{
+	SExecWorker * pworker;
+	unsigned int i, pos;
+
+	if (workers == 0)
+		workers = 1;
+
+	for (i = 0; i < workers; i++) {
+		pworker = new SExecWorker;
+		pworker->index = i;
+		for (pos = 0; pos < EXEC_QUEUE_SIZE; pos++)
+			pworker->queue[pos].seq.store(pos, std::memory_order_relaxed);
+		pworker->head.store(0, std::memory_order_relaxed);
+		pworker->tail.store(0, std::memory_order_relaxed);
+		pworker->bSleeping.store(false, std::memory_order_relaxed);
+		pworker->tasks = 0;
+		this->workers.push_back(pworker);
+	}
+
+	// Start the threads when all workers exist
+	for (i = 0; i < workers; i++)
+		this->workers[i]->thr = std::thread(&CPipeExecutor::mainloop, this, this->workers[i]);
+}
+
+//---------------------------------------------------------------------------
+CPipeExecutor::~CPipeExecutor()
+{
+	stop();
+
+	for (SExecWorker * pworker : workers)
+		delete pworker;
+	for (SPipeTask * ptask : tasks)
+		delete ptask;
+}
+
+//---------------------------------------------------------------------------
+SPipeTask *
+CPipeExecutor::add(const char * sName, struct fifo_pipe * ppipe, fp_pipe_transfer fp_transfer)
+{
+	// No transfer pool: fifo_pipe_init of the pipe failed
+	if (ppipe->ptransfer_pool == NULL)
+		return NULL;
+
+	SPipeTask * ptask = new SPipeTask;
+
+	ptask->sName = sName;
+	ptask->ppipe = ppipe;
+	ptask->fp_transfer = fp_transfer;
+	ptask->pfanin = NULL;
+
+	return add(ptask);
+}
+
+//---------------------------------------------------------------------------
+SPipeTask *
+CPipeExecutor::add(const char * sName, struct fifo_fanin * pfanin)
+{
+	SPipeTask * ptask = new SPipeTask;
+
+	ptask->sName = sName;
+	ptask->ppipe = NULL;
+	ptask->fp_transfer = NULL;
+	ptask->pfanin = pfanin;
+
+	return add(ptask);
+}
+
+//---------------------------------------------------------------------------
+SPipeTask *
+CPipeExecutor::add(SPipeTask * ptask)
+{
+	SExecWorker * pworker = workers[tasks.size() % workers.size()];
+
+	if ((bExit) || (pworker->tasks == EXEC_QUEUE_SIZE)) {
+		delete ptask;
+		return NULL;
+	}
+
+	ptask->pexec = this;
+	ptask->worker = pworker->index;
+	ptask->bReady.store(false, std::memory_order_relaxed);
+	ptask->runs = 0;
+	for (unsigned int i = 0; i < FIFO_PIPE_STATUS_COUNT; i++)
+		ptask->count[i] = 0;
+
+	pworker->tasks++;
+	tasks.push_back(ptask);
+
+	// Run it once, like a CPipe does when it starts
+	wakeup(ptask);
+
+	return ptask;
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::stop()
+{
+	if (bExit)
+		return;
+
+	bExit = true;
+	for (SExecWorker * pworker : workers) {
+		std::unique_lock<std::mutex> locker(pworker->mutex);
+		pworker->cv.notify_one();
+	}
+	for (SExecWorker * pworker : workers)
+		pworker->thr.join();
+
+	print_stats();
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::wakeup(void * arg)
+{
+	SPipeTask * ptask = (SPipeTask *)arg;
+
+	// Already queued: the worker will see this wakeup too
+	if (ptask->bReady.exchange(true, std::memory_order_seq_cst))
+		return;
+
+	ptask->pexec->put(ptask->pexec->workers[ptask->worker], ptask);
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::put(SExecWorker * pworker, SPipeTask * ptask)
+{
+	unsigned int pos = pworker->head.load(std::memory_order_relaxed);
+	SExecSlot * pslot;
+	int diff;
+
+	// Reserve a slot, there is always one: a task is queued at most once
+	while (true) {
+		pslot = &pworker->queue[pos & (EXEC_QUEUE_SIZE-1)];
+		diff = (int)(pslot->seq.load(std::memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (pworker->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			// The worker did not release the slot yet
+			std::this_thread::yield();
+			pos = pworker->head.load(std::memory_order_relaxed);
+		}
+		else {
+			// Another put was faster
+			pos = pworker->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	pslot->ptask = ptask;
+
+	// Queue the task, then check if the worker went to sleep (see mainloop)
+	pslot->seq.store(pos + 1, std::memory_order_seq_cst);
+	if (pworker->bSleeping.load(std::memory_order_seq_cst)) {
+		std::unique_lock<std::mutex> locker(pworker->mutex);
+		pworker->cv.notify_one();
+	}
+}
+
+//---------------------------------------------------------------------------
+bool
+CPipeExecutor::ready(SExecWorker * pworker)
+{
+	unsigned int pos = pworker->tail.load(std::memory_order_relaxed);
+
+	return pworker->queue[pos & (EXEC_QUEUE_SIZE-1)].seq.load(std::memory_order_seq_cst) == (pos + 1);
+}
+
+//---------------------------------------------------------------------------
+SPipeTask *
+CPipeExecutor::get(SExecWorker * pworker)
+{
+	unsigned int pos = pworker->tail.load(std::memory_order_relaxed);
+	SExecSlot * pslot = &pworker->queue[pos & (EXEC_QUEUE_SIZE-1)];
+	SPipeTask * ptask;
+
+	if (ready(pworker) == false)
+		return NULL;
+
+	ptask = pslot->ptask;
+	pslot->seq.store(pos + EXEC_QUEUE_SIZE, std::memory_order_release);
+	pworker->tail.store(pos + 1, std::memory_order_release);
+
+	return ptask;
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::mainloop(SExecWorker * pworker)
+{
+	SPipeTask * ptask;
+
+	std::cerr<<"Executor worker "<<pworker->index<<" running"<<std::endl;
+	place_thread(PLACE_PIPE);
+
+	while (true)
+	{
+		// Run everything that is ready
+		while ((ptask = get(pworker)) != NULL)
+			run(ptask);
+
+		// Empty, go to sleep. Check again after telling put we are sleeping.
+		std::unique_lock<std::mutex> locker(pworker->mutex);
+		pworker->bSleeping.store(true, std::memory_order_seq_cst);
+		if ((ready(pworker) == false) && (bExit == true))
+			break;
+		pworker->cv.wait(locker, [this, pworker]{ return ready(pworker) || bExit; });
+		pworker->bSleeping.store(false, std::memory_order_relaxed);
+	}
+
+	// Last transfer of every task, like CPipe
+	for (SPipeTask * ptask : tasks) {
+		if (ptask->worker == pworker->index)
+			transfer(ptask);
+	}
+
+	std::cerr<<"Executor worker "<<pworker->index<<" stopping"<<std::endl;
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::run(SPipeTask * ptask)
+{
+	unsigned int budget = EXEC_RUN_BUDGET;
+
+	// Wakeups from now on queue the task again
+	ptask->bReady.store(false, std::memory_order_seq_cst);
+	ptask->runs++;
+	set_waiting(ptask, 0);
+
+	while (true) {
+		// Fill the pipe, but give the other tasks a turn
+		while (transfer(ptask) == FIFO_PIPE_SUBMITTED) {
+			if (--budget == 0) {
+				wakeup(ptask);
+				return;
+			}
+		}
+
+		// Ask the fifos for a wake-up, then make sure we did not miss one
+		set_waiting(ptask, 1);
+		if (transfer(ptask) != FIFO_PIPE_SUBMITTED)
+			break;
+		set_waiting(ptask, 0);
+	}
+}
+
+//---------------------------------------------------------------------------
+enum fifo_pipe_status
+CPipeExecutor::transfer(SPipeTask * ptask)
+{
+	enum fifo_pipe_status status = (ptask->pfanin != NULL) ? fifo_fanin_transfer(ptask->pfanin) : ptask->fp_transfer(ptask->ppipe);
+
+	ptask->count[status]++;
+
+	return status;
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::set_waiting(SPipeTask * ptask, unsigned int waiting)
+{
+	if (ptask->pfanin != NULL)
+		fifo_fanin_set_waiting(ptask->pfanin, waiting);
+	else
+		fifo_pipe_set_waiting(ptask->ppipe, waiting);
+}
+
+//---------------------------------------------------------------------------
+void
+CPipeExecutor::print_stats()
+{
+	unsigned int i;
+
+	for (SPipeTask * ptask : tasks) {
+		std::cerr<<ptask->sName<<" worker="<<ptask->worker<<" runs="<<ptask->runs;
+		for (i = 0; i < FIFO_PIPE_STATUS_COUNT; i++)
+			std::cerr<<" "<<state_name[i]<<"="<<ptask->count[i];
+		std::cerr<<std::endl;
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef CPIPEEXECUTOR_H
+#define CPIPEEXECUTOR_H
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "cpipe.h"
+
+class CPipeExecutor;
+
+/*
+ * A pipe (or fan-in) run by the executor, the argument of its wakeup handlers
+ *
+ * bReady is set by a wakeup and cleared when the worker starts running the
+ * task. Only the wakeup that sets it queues the task, so wakeups that arrive
+ * while it is queued cost nothing.
+ */
+struct SPipeTask
+{
+	CPipeExecutor * pexec;
+	std::string sName;
+	unsigned int worker;		// index of the worker that runs it
+
+	struct fifo_pipe * ppipe;
+	fp_pipe_transfer fp_transfer;
+	struct fifo_fanin * pfanin;	// instead of ppipe
+
+	std::atomic<bool> bReady;
+
+	unsigned int runs;
+	unsigned int count[FIFO_PIPE_STATUS_COUNT];
+};
+
+/* Max number of tasks per worker, must be a power of 2 */
+#define EXEC_QUEUE_SIZE	(256)
+
+/* Max number of transfers in a row, before the other tasks of the worker get a turn */
+#define EXEC_RUN_BUDGET	(64)
+
+/*
+ * Slot in the run queue of a worker, the same scheme as the DMA queue (SDMASlot)
+ */
+struct SExecSlot
+{
+	std::atomic<unsigned int> seq;
+	SPipeTask * ptask;
+};
+
+/*
+ * Worker thread, with a run queue of the tasks that are ready
+ */
+struct SExecWorker
+{
+	unsigned int index;
+
+	// Bounded queue, lock-free for the callers of wakeup. A task is queued at most once.
+	SExecSlot queue[EXEC_QUEUE_SIZE];
+	std::atomic<unsigned int> head;		// next position to put
+	std::atomic<unsigned int> tail;		// next position to run
+
+	// Only used when the worker goes to sleep
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::atomic<bool> bSleeping;
+
+	unsigned int tasks;			// number of tasks assigned
+
+	std::thread thr;
+};
+
+/*
+ * Runs many pipes on a small pool of worker threads
+ *
+ * Instead of a thread per CPipe, every pipe is a task of one worker. A
+ * wakeup handler of the fifos queues the task, the worker runs transfers
+ * until the pipe stalls, the same way CPipe does. Set CPipeExecutor::wakeup
+ * as wakeup handler, with the task returned by add as argument.
+ */
+class CPipeExecutor
+{
+public:
+	CPipeExecutor(unsigned int workers);
+	~CPipeExecutor();
+
+	// The tasks are spread over the workers, round robin. Returns NULL when all workers are full,
+	// or the pipe is not initialized.
+	SPipeTask * add(const char * sName, struct fifo_pipe * ppipe, fp_pipe_transfer fp_transfer = fifo_pipe_transfer);
+	SPipeTask * add(const char * sName, struct fifo_fanin * pfanin);
+
+	void stop();
+
+	static void wakeup(void * arg);
+
+private:
+	SPipeTask * add(SPipeTask * ptask);
+	void put(SExecWorker * pworker, SPipeTask * ptask);
+	bool ready(SExecWorker * pworker);
+	SPipeTask * get(SExecWorker * pworker);
+	void mainloop(SExecWorker * pworker);
+	void run(SPipeTask * ptask);
+	enum fifo_pipe_status transfer(SPipeTask * ptask);
+	void set_waiting(SPipeTask * ptask, unsigned int waiting);
+	void print_stats();
+
+private:
+	volatile bool bExit;
+
+	std::vector<SExecWorker *> workers;
+	std::vector<SPipeTask *> tasks;
+};
+
+
+#endif // CPIPEEXECUTOR_H
@@ -10,6 +10,9 @@
  * - no atomics
  * - fixed size
  * - one writer, one reader
+ *
+ * The BDs are 32bit, or 64bit when initialized with bdring_init_64. Both
+ * need to be written in one atomic operation.
  */
 
 #include "linux_port.h"
@@ -46,21 +49,54 @@ struct bd
 #define BD_USED		((uint32_t)(1<<31))
 #define BD_USERDATA	(~BD_USED)
 
+/*!
+ * @brief 64bit Buffer descriptor (bd64)
+ *
+ * Same as the bd, with 63 bits of user defined data.
+ */
+struct bd64
+{
+	union {
+		uint64_t data;
+		struct {
+			uint64_t userdata:63;
+			uint64_t used:1;
+		} __attribute__ ((packed));
+	};
+} __attribute__ ((packed));
+#define BD64_USED	((uint64_t)1<<63)
+#define BD64_USERDATA	(~BD64_USED)
+
 /**
  * @brief Buffer descriptor ring (bdring)
  */
 struct bdring {
 	volatile struct bd *pbd;
+	volatile struct bd64 *pbd64; /* NULL for 32bit BDs */
 	unsigned int count;
 	unsigned int mask;
 };
 
 /**
- * @brief Initialize the bdring struct
+ * @brief Initialize the bdring struct, with 32bit BDs
  */
 static inline void bdring_init(struct bdring *pbdr, volatile void *pdata, unsigned int count)
 {
 	pbdr->pbd = (volatile struct bd *)pdata;
+	pbdr->pbd64 = NULL;
+	pbdr->count = count;
+	pbdr->mask = count - 1;
+}
+
+/**
+ * @brief Initialize the bdring struct, with 64bit BDs
+ *
+ * Only the bdring_bd_*64 functions can be used to get and put BDs.
+ */
+static inline void bdring_init_64(struct bdring *pbdr, volatile void *pdata, unsigned int count)
+{
+	pbdr->pbd = NULL;
+	pbdr->pbd64 = (volatile struct bd64 *)pdata;
 	pbdr->count = count;
 	pbdr->mask = count - 1;
 }
@@ -73,21 +109,34 @@ static inline unsigned int bdring_next(struct bdring *pbdr, unsigned int index)
 static inline void bdring_clear(struct bdring *pbdr)
 {
 	unsigned int idx;
-	for (idx = 0; idx < pbdr->count; idx++)
-		pbdr->pbd[idx].data = 0;
+	for (idx = 0; idx < pbdr->count; idx++) {
+		if (pbdr->pbd64 != NULL)
+			pbdr->pbd64[idx].data = 0;
+		else
+			pbdr->pbd[idx].data = 0;
+	}
+}
+
+static inline int bdring_bd_is_used64(struct bdring *pbdr, unsigned int idx)
+{
+	return pbdr->pbd64[idx].data >= BD64_USED;
 }
 
 static inline int bdring_bd_is_used(struct bdring *pbdr, unsigned int idx)
 {
-	uint32_t data = pbdr->pbd[idx].data;
+	if (pbdr->pbd64 != NULL)
+		return bdring_bd_is_used64(pbdr, idx);
 
-	return data >= BD_USED;
+	return pbdr->pbd[idx].data >= BD_USED;
 }
 
 static inline int bdring_bd_get(struct bdring *pbdr, unsigned int idx, uint32_t *pdata)
 {
 	uint32_t data = pbdr->pbd[idx].data;
 
+	/* Read the BD before the data it points to */
+	rmb();
+
 	*pdata = data & BD_USERDATA;
 
 	return data >= BD_USED;
@@ -95,11 +144,50 @@ static inline int bdring_bd_get(struct bdring *pbdr, unsigned int idx, uint32_t
 
 static inline void bdring_bd_put(struct bdring *pbdr, unsigned int idx, uint32_t data)
 {
+	/* Write the data before the BD that points to it */
+	wmb();
+
 	pbdr->pbd[idx].data = data | BD_USED;
 }
 
+static inline int bdring_bd_get64(struct bdring *pbdr, unsigned int idx, uint64_t *pdata)
+{
+	uint64_t data = pbdr->pbd64[idx].data;
+
+	/* Read the BD before the data it points to */
+	rmb();
+
+	*pdata = data & BD64_USERDATA;
+
+	return data >= BD64_USED;
+}
+
+static inline void bdring_bd_put64(struct bdring *pbdr, unsigned int idx, uint64_t data)
+{
+	/* Write the data before the BD that points to it */
+	wmb();
+
+	pbdr->pbd64[idx].data = data | BD64_USED;
+}
+
+static inline void bdring_bd_clear64(struct bdring *pbdr, unsigned int idx)
+{
+	/* Finish reading the data before the BD is given back, wmb() only orders stores */
+	release_mb();
+
+	pbdr->pbd64[idx].data = 0;
+}
+
 static inline void bdring_bd_clear(struct bdring *pbdr, unsigned int idx)
 {
+	if (pbdr->pbd64 != NULL) {
+		bdring_bd_clear64(pbdr, idx);
+		return;
+	}
+
+	/* Finish reading the data before the BD is given back, wmb() only orders stores */
+	release_mb();
+
 	pbdr->pbd[idx].data = 0;
 }
 
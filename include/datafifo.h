@@ -0,0 +1,349 @@
+#ifndef __DATAFIFO_H
+#define __DATAFIFO_H
+
+/**
+ * @file datafifo.h
+ * @brief Fifo with the geometry fixed at compile time, C++ only.
+ *
+ * Thin templates around the fifo, fifo_reader, fifo_writer and fifo_pipe.
+ * The size, BD count, alignment and flags are template parameters, so:
+ * - the BD mask, alignment and BD size are immediate values in the code
+ * - the layout is computed by the compiler (the same functions as fifo.h)
+ * - a geometry that does not fit the BDs fails to compile
+ *
+ * Usage:
+ *   typedef datafifo::fifo<64*1024, 128, 16> my_fifo;
+ *   my_fifo f;
+ *   datafifo::writer<my_fifo> w(f);
+ *   datafifo::reader<my_fifo> r(f);
+ *
+ * The C structs are available with native(), to mix with the C functions.
+ * Both see the same fifo, only the geometry comes from a different place.
+ */
+
+#ifndef __cplusplus
+#error "datafifo.h is C++ only, use fifo.h from C"
+#endif
+
+/* The layout functions are only constexpr from C++14 on (FIFO_CONSTEXPR) */
+#if __cplusplus < 201402L
+#error "datafifo.h needs C++14 or later"
+#endif
+
+#include <string.h> // memcpy
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_pipe.h"
+
+namespace datafifo
+{
+
+//---------------------------------------------------------------------------
+template <unsigned int Size, unsigned int BdCount, unsigned int Align = 16, unsigned int Flags = 0>
+class fifo
+{
+public:
+	static constexpr unsigned int size		= Size;
+	static constexpr unsigned int bd_count		= BdCount;
+	static constexpr unsigned int align		= Align;
+	static constexpr unsigned int flags		= Flags;
+
+	static constexpr unsigned int layout_align	= fifo_layout_align(Align, Flags);
+	static constexpr unsigned int header_size	= fifo_header_size(Align, Flags);
+	static constexpr unsigned int bdring_size	= fifo_bdring_size(BdCount, Align, Flags);
+	static constexpr unsigned int data_size		= fifo_data_size(Size, BdCount, Align, Flags);
+	static constexpr unsigned int block_max_size	= fifo_block_max_size(Flags);
+
+	static constexpr struct fifo_geometry geometry = {
+		BdCount - 1,
+		Align - 1,
+		(Flags & FIFO_FLAG_BD64) ? 1U : 0U,
+		fifo_block_max_size(Flags),
+		(Flags & FIFO_FLAG_BROADCAST_MASK) ? 1U : 0U,
+		(Flags & FIFO_FLAG_MIRROR) ? 1U : 0U,
+	};
+
+	static_assert((BdCount >= 2) && ((BdCount & (BdCount - 1)) == 0), "BdCount must be a power of 2");
+	static_assert(BdCount <= 0x8000, "BdCount does not fit in the fifo_header");
+	static_assert((Align >= 4) && ((Align & (Align - 1)) == 0), "Align must be a power of 2, of at least 4");
+	static_assert(Align <= 0x8000, "Align does not fit in the fifo_header");
+	static_assert(Size >= header_size + bdring_size + Align, "Size too small for the header and bdring");
+	static_assert(Size - header_size - bdring_size <= fifo_datasize_max(Flags), "Size too big for the BD offset, use FIFO_FLAG_BD64");
+	static_assert((Flags & FIFO_FLAG_MIRROR) == 0, "The data ring of a member array can not be mapped twice");
+
+	fifo()
+	{
+		fifo_init_create(&m_fifo, m_data, Size, BdCount, Align, Flags);
+	}
+
+	fifo(const fifo &) = delete;
+	fifo & operator=(const fifo &) = delete;
+
+	struct ::fifo * native() { return &m_fifo; }
+
+private:
+	struct ::fifo m_fifo;
+
+	// Aligned, so fifo_init_create uses the layout computed above
+	alignas(layout_align) uint8_t m_data[Size];
+};
+
+//---------------------------------------------------------------------------
+template <class Fifo>
+class reader
+{
+public:
+	static constexpr struct fifo_geometry geometry = Fifo::geometry;
+
+	explicit reader(Fifo & f)
+	{
+		fifo_reader_init(&m_reader, f.native());
+	}
+
+	reader(const reader &) = delete;
+	reader & operator=(const reader &) = delete;
+
+	struct fifo_reader * native() { return &m_reader; }
+
+	void set_wakeup_handler(fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+	{
+		fifo_reader_set_wakeup_handler(&m_reader, wakeup_handler, wakeup_handler_arg);
+	}
+
+	unsigned int get(void **pdata)
+	{
+		return _fifo_reader_get(&m_reader, geometry, pdata, m_reader.index_read);
+	}
+
+	unsigned int get_claim(void **pdata)
+	{
+		return _fifo_reader_get(&m_reader, geometry, pdata, m_reader.index_claimed);
+	}
+
+	void * get_batch(unsigned int *batch_count, unsigned int *batch_size, unsigned int batch_size_max, unsigned int batch_count_max)
+	{
+		return _fifo_reader_get_batch(&m_reader, geometry, batch_count, batch_size, batch_size_max, batch_count_max);
+	}
+
+	unsigned int get_blocks(struct fifo_block *pblocks, unsigned int max_count)
+	{
+		return _fifo_reader_get_blocks(&m_reader, geometry, pblocks, max_count);
+	}
+
+	void claim(unsigned int count, unsigned int size)
+	{
+		_fifo_reader_claim(&m_reader, geometry, count, size);
+	}
+
+	void free()
+	{
+		_fifo_reader_free(&m_reader, geometry);
+	}
+
+	void free_blocks(unsigned int count)
+	{
+		_fifo_reader_free_blocks(&m_reader, geometry, count);
+	}
+
+	int is_empty()
+	{
+		return _fifo_bd_is_used(m_reader.pbdr, geometry, m_reader.index_read) == 0;
+	}
+
+	void wakeup_writer(unsigned int force)
+	{
+		fifo_reader_wakeup_writer(&m_reader, force);
+	}
+
+private:
+	struct fifo_reader m_reader;
+};
+
+//---------------------------------------------------------------------------
+template <class Fifo>
+class writer
+{
+public:
+	static constexpr struct fifo_geometry geometry = Fifo::geometry;
+
+	explicit writer(Fifo & f)
+	{
+		fifo_writer_init(&m_writer, f.native());
+	}
+
+	writer(const writer &) = delete;
+	writer & operator=(const writer &) = delete;
+
+	struct fifo_writer * native() { return &m_writer; }
+
+	void set_wakeup_handler(fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+	{
+		fifo_writer_set_wakeup_handler(&m_writer, wakeup_handler, wakeup_handler_arg);
+	}
+
+	void update_reader()
+	{
+		_fifo_writer_update_reader(&m_writer, geometry);
+	}
+
+	void * get_pointer()
+	{
+		return fifo_writer_get_pointer(&m_writer);
+	}
+
+	unsigned int get_free_bd(unsigned int max_count)
+	{
+		return _fifo_writer_get_free_bd(&m_writer, geometry, max_count);
+	}
+
+	unsigned int get_free_contiguous(unsigned int min_size)
+	{
+		return _fifo_writer_get_free_contiguous(&m_writer, geometry, min_size);
+	}
+
+	unsigned int get_free_total()
+	{
+		return fifo_writer_get_free_total(&m_writer);
+	}
+
+	static constexpr unsigned int get_block_max_size()
+	{
+		return Fifo::block_max_size;
+	}
+
+	unsigned int commit(void *pdata, unsigned int size)
+	{
+		return _fifo_writer_commit(&m_writer, geometry, pdata, size);
+	}
+
+	void claim(unsigned int count, unsigned int size)
+	{
+		_fifo_writer_claim(&m_writer, geometry, count, size);
+	}
+
+	unsigned int reserve(struct fifo_block *pblocks, unsigned int max_count, unsigned int size)
+	{
+		return _fifo_writer_reserve(&m_writer, geometry, pblocks, max_count, size);
+	}
+
+	unsigned int commit_blocks(const struct fifo_block *pblocks, unsigned int count)
+	{
+		return _fifo_writer_commit_blocks(&m_writer, geometry, pblocks, count);
+	}
+
+	void wakeup_reader(unsigned int force)
+	{
+		fifo_writer_wakeup_reader(&m_writer, force);
+	}
+
+private:
+	struct fifo_writer m_writer;
+};
+
+//---------------------------------------------------------------------------
+/*
+ * The batch sizes follow the output fifo, instead of MAX_BATCH_SIZE and
+ * MAX_BATCH_SIZE_URGENT that assume a fifo of FIFO_SIZE.
+ */
+template <class FifoIn, class FifoOut>
+class pipe
+{
+public:
+	static constexpr unsigned int batch_size_max	= FifoOut::data_size / 2;
+	static constexpr unsigned int batch_size_urgent	= (batch_size_max < 2*1024) ? batch_size_max : 2*1024;
+
+	/* Check is_valid() before using the pipe, the transfer pool is allocated here */
+	pipe(reader<FifoIn> & r, writer<FifoOut> & w)
+	{
+		m_valid = (fifo_pipe_init(&m_pipe, r.native(), w.native()) == 0);
+		fifo_pipe_set_batch_size(&m_pipe, batch_size_max, batch_size_urgent);
+		m_pipe.fp_transfer = transfer_default;
+	}
+
+	~pipe()
+	{
+		fifo_pipe_deinit(&m_pipe);
+	}
+
+	pipe(const pipe &) = delete;
+	pipe & operator=(const pipe &) = delete;
+
+	struct fifo_pipe * native() { return &m_pipe; }
+
+	bool is_valid() const { return m_valid; }
+
+	/**
+	 * @brief Set the function doing the transfer, it must call commit when done
+	 */
+	void set_transfer(void (*fp_transfer)(struct fifo_pipe_transfer *ptransfer))
+	{
+		m_pipe.fp_transfer = fp_transfer;
+	}
+
+	void set_window(unsigned int window)
+	{
+		fifo_pipe_set_window(&m_pipe, window);
+	}
+
+	void set_wakeup_handler(fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+	{
+		fifo_pipe_set_wakeup_handler(&m_pipe, wakeup_handler, wakeup_handler_arg);
+	}
+
+	void set_waiting(unsigned int waiting)
+	{
+		fifo_pipe_set_waiting(&m_pipe, waiting);
+	}
+
+	enum fifo_pipe_status transfer()
+	{
+		return transfer(&m_pipe);
+	}
+
+	/* Same as transfer(), usable as a C function pointer */
+	static enum fifo_pipe_status transfer(struct fifo_pipe *ppipe)
+	{
+		return _fifo_pipe_transfer(ppipe, FifoIn::geometry, FifoOut::geometry);
+	}
+
+	static void commit(struct fifo_pipe_transfer *ptransfer)
+	{
+		_fifo_pipe_transfer_commit(ptransfer->ppipe, FifoIn::geometry, FifoOut::geometry, ptransfer);
+	}
+
+	static void transfer_default(struct fifo_pipe_transfer *ptransfer)
+	{
+		unsigned int seg;
+
+		for (seg = 0; seg < ptransfer->segment_count; seg++)
+			memcpy(ptransfer->segment[seg].dst, ptransfer->segment[seg].src, ptransfer->segment[seg].size);
+		commit(ptransfer);
+	}
+
+private:
+	struct fifo_pipe m_pipe;
+	bool m_valid;
+};
+
+//---------------------------------------------------------------------------
+/*
+ * The geometry is passed by value to the _fifo_* functions, which odr-uses it.
+ * Before C++17 a static constexpr member is not implicitly inline, and needs a
+ * definition outside of the class.
+ */
+#if __cplusplus < 201703L
+template <unsigned int Size, unsigned int BdCount, unsigned int Align, unsigned int Flags>
+constexpr struct fifo_geometry fifo<Size, BdCount, Align, Flags>::geometry;
+
+template <class Fifo>
+constexpr struct fifo_geometry reader<Fifo>::geometry;
+
+template <class Fifo>
+constexpr struct fifo_geometry writer<Fifo>::geometry;
+#endif
+
+} // namespace datafifo
+
+#endif
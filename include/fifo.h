@@ -7,8 +7,10 @@
  *
  * The fifo is a block of data, containing:
  * - a header (fifo_header)
+ * - optional: the reader cursor (fifo_cursor), in its own cache line
+ * - optional: a slot per reader and the writer line, see FIFO_FLAG_BROADCAST
  * - a buffer descriptor ring (bdring)
- * - a data ring
+ * - a data ring, optionally mapped twice back to back (FIFO_FLAG_MIRROR)
  *
  * The fifo_writer is needed to write data into the fifo
  * The fifo_reader is needed to read data out of the fifo
@@ -28,10 +30,69 @@ typedef void (*fifo_wakeup_handler)(void * arg);
 #define FIFO_SIZE		(64*1024)
 #define FIFO_BD_COUNT		(128)
 
+#define FIFO_CACHE_LINE_SIZE	(64)
+
+/* Page size of the mirrored layout (FIFO_FLAG_MIRROR), a multiple of the page size of the system */
+#ifndef FIFO_MIRROR_PAGE_SIZE
+#define FIFO_MIRROR_PAGE_SIZE	(4096)
+#endif
+
+/* The layout functions can be evaluated at compile time by C++ (see datafifo.h) */
+#if defined(__cplusplus) && (__cplusplus >= 201402L)
+#define FIFO_CONSTEXPR		constexpr
+#else
+#define FIFO_CONSTEXPR
+#endif
+
+/**
+ * @brief Geometry of a fifo, as needed by the reader and writer for every block
+ *
+ * The reader and writer functions get it from the fifo at runtime. The
+ * private functions taking a geometry are also used by the templates in
+ * datafifo.h, with compile time constants that fold into the code.
+ */
+struct fifo_geometry
+{
+	unsigned int bd_mask;		/* bd_count - 1 */
+	unsigned int align_bits;	/* align - 1 */
+	unsigned int bd64;		/* 64bit BDs (FIFO_FLAG_BD64) */
+	unsigned int block_max_size;	/* see fifo_block_max_size */
+	unsigned int broadcast;		/* many readers (FIFO_FLAG_BROADCAST) */
+	unsigned int mirror;		/* data ring mapped twice (FIFO_FLAG_MIRROR) */
+};
+
 /**
  * @brief Describes the fifo
  *
  * The fifo is a simple block of data, this header should be at the beginning.
+ *
+ * Default (packed) layout, as used on the Playstation 2:
+ *   header | cursor (optional, own cache line) | bdring | data
+ *
+ * Cache aligned layout (FIFO_FLAG_CACHE_ALIGNED), every part starts on a new
+ * cache line, so the reader and writer never write to the same cache line
+ * except for the bdring:
+ *   line 0: header, read-only after creation
+ *   line 1: reader owned, reader status + cursor (optional)
+ *   line 2: writer owned, writer status
+ *   bdring | data
+ * The reader_status and writer_status of the header itself are not used.
+ *
+ * With 64bit BDs (FIFO_FLAG_BD64) the data ring can be larger than 64KiB, its
+ * size is in datasize64 and datasize is 0.
+ *
+ * Broadcast layout (FIFO_FLAG_BROADCAST), after the header lines above:
+ *   one line per reader: fifo_broadcast_slot
+ *   one writer line: the reclaim seq
+ *   bdring | data
+ *
+ * Mirrored layout (FIFO_FLAG_MIRROR), the header and bdring are aligned to
+ * pages and the data ring is a whole number of pages. The memory must map
+ * the data ring a second time, right after the first (fifo_shm_create_mirror):
+ *   header | bdring | data | data again
+ * A block can then start anywhere in the ring and run past its end, the
+ * writer never skips the space at the end and the reader batches never stop
+ * at the wrap.
  */
 struct fifo_header
 {
@@ -39,12 +100,65 @@ struct fifo_header
 	uint16_t datasize;
 	uint32_t reader_status;
 	uint32_t writer_status;
-	uint32_t align;
+	uint16_t align;
+	uint16_t flags;
+	uint32_t datasize64;
 } __attribute__ ((packed));
 /* Reader status flags */
 #define RD_STS_WAITING		(1<<0)
 /* Writer status flags */
 #define WR_STS_WAITING		(1<<0)
+/* Fifo flags */
+#define FIFO_FLAG_READER_CURSOR	(1<<0) /* The reader publishes its position in a fifo_cursor */
+#define FIFO_FLAG_CACHE_ALIGNED	(1<<1) /* Cache aligned layout, see above */
+#define FIFO_FLAG_BD64		(1<<2) /* 64bit BDs, see fifo_bd64 */
+#define FIFO_FLAG_MIRROR	(1<<3) /* The data ring is mapped twice, see above */
+#define FIFO_FLAG_BROADCAST(readers)	(((readers) & 0xff) << 8) /* 1 to 255 readers, see fifo_broadcast_slot */
+#define FIFO_FLAG_BROADCAST_MASK	(0xff << 8)
+
+/**
+ * @brief Number of readers of a broadcast fifo, 0 for a normal fifo
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_reader_count(unsigned int flags)
+{
+	return (flags & FIFO_FLAG_BROADCAST_MASK) >> 8;
+}
+
+/**
+ * @brief Position of the reader, published by the reader
+ *
+ * Without a cursor the writer finds the reader by scanning the bdring. With a
+ * cursor the writer only needs to read this cache line, that is written by
+ * nobody but the reader:
+ * - seq: number of blocks freed by the reader (wraps around)
+ * - offset: end of the last freed block in the data ring, in bytes
+ */
+struct fifo_cursor
+{
+	uint32_t seq;
+	uint32_t offset;
+} __attribute__ ((packed));
+
+/**
+ * @brief A reader of a broadcast fifo, in a cache line of its own
+ *
+ * Every block is read by all readers. The readers do not clear the BDs, they
+ * only publish their cursor. The writer clears the BD after the last one it
+ * commits, and reclaims a block once all lossless readers have freed it.
+ *
+ * A lossy reader is never waited for. The writer publishes the seq of the
+ * oldest block it may overwrite (reclaim seq), a lossy reader checks it with
+ * fifo_reader_sync after using a block.
+ */
+struct fifo_broadcast_slot
+{
+	struct fifo_cursor cursor;
+	uint32_t mode;
+	uint8_t pad[FIFO_CACHE_LINE_SIZE - sizeof(struct fifo_cursor) - sizeof(uint32_t)];
+} __attribute__ ((packed));
+#define FIFO_READER_NONE	(0) /* slot not used */
+#define FIFO_READER_LOSSLESS	(1) /* the writer waits for this reader */
+#define FIFO_READER_LOSSY	(2) /* the writer overwrites what this reader did not read in time */
 
 /**
  * @brief fifo struct used by the fifo_reader and fifo_writer
@@ -52,8 +166,25 @@ struct fifo_header
 struct fifo
 {
 	volatile struct fifo_header *pheader;
+	volatile uint32_t *preader_status;
+	volatile uint32_t *pwriter_status;
+	volatile struct fifo_cursor *pcursor; /* NULL without FIFO_FLAG_READER_CURSOR, slot 0 when broadcast */
+	volatile struct fifo_broadcast_slot *pslots; /* NULL without FIFO_FLAG_BROADCAST */
+	volatile uint32_t *preclaim;	/* NULL without FIFO_FLAG_BROADCAST */
+	unsigned int reader_count;	/* 0 without FIFO_FLAG_BROADCAST */
 	struct bdring bdr;
 	uint8_t *pdata;
+	unsigned int datasize;
+	struct fifo_geometry geometry;
+};
+
+/**
+ * @brief A block in the fifo, see fifo_reader_get_blocks and fifo_writer_reserve
+ */
+struct fifo_block
+{
+	void		*pdata;
+	unsigned int	size;
 };
 
 /**
@@ -82,71 +213,454 @@ struct fifo_bd
 } __attribute__ ((packed));
 
 /**
- * @brief Initialize the fifo struct
+ * @brief 64bit Buffer Descriptor as it is used by the fifo (FIFO_FLAG_BD64)
+ *
+ * For large fifos and blocks, it has:
+ * - An offset into the data ring buffer, in bytes
+ * - A size in bytes
  */
-static inline void fifo_init_create(struct fifo *pfifo, void *pfifodata, unsigned int fifosize, unsigned int bd_count, unsigned int align)
+#define FIFO_BD64_SIZE_BITS	31 /* Max   2GiB - 1 */
+#define FIFO_BLOCK_MAX_SIZE_64	((1U<<FIFO_BD64_SIZE_BITS)-1)
+struct fifo_bd64
+{
+	union {
+		uint64_t data;
+		struct {
+			uint32_t offset;
+			uint32_t size   : FIFO_BD64_SIZE_BITS;
+			uint32_t used   : 1;
+		} __attribute__ ((packed));
+	};
+} __attribute__ ((packed));
+
+/**
+ * @brief Size of one BD in the bdring
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_bd_size(unsigned int flags)
+{
+	return (flags & FIFO_FLAG_BD64) ? sizeof(struct bd64) : sizeof(struct bd);
+}
+
+/**
+ * @brief Biggest block that fits in a BD
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_block_max_size(unsigned int flags)
+{
+	return (flags & FIFO_FLAG_BD64) ? FIFO_BLOCK_MAX_SIZE_64 : FIFO_BLOCK_MAX_SIZE;
+}
+
+/**
+ * @brief Biggest data ring, the offset needs to fit in a BD
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_datasize_max(unsigned int flags)
+{
+	return (flags & FIFO_FLAG_BD64) ? 0xffffffff : 0xffff;
+}
+
+/*
+ * Private function: next BD index
+ */
+static inline unsigned int _fifo_bd_next(struct fifo_geometry g, unsigned int idx)
+{
+	return ((idx + 1) & g.bd_mask);
+}
+
+/*
+ * Private function: get a BD of either size, returns if it is used
+ */
+static inline int _fifo_bd_get(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx, unsigned int *poffset, unsigned int *psize)
+{
+	struct fifo_bd bd;
+	struct fifo_bd64 bd64;
+	uint32_t data;
+	uint64_t data64;
+	int used;
+
+	/* Through a local, the BD structs are packed */
+	if (g.bd64) {
+		used = bdring_bd_get64(pbdr, idx, &data64);
+		bd64.data = data64;
+		*poffset = bd64.offset;
+		*psize   = bd64.size;
+	}
+	else {
+		used = bdring_bd_get(pbdr, idx, &data);
+		bd.data = data;
+		*poffset = bd.offset;
+		*psize   = bd.size;
+	}
+
+	return used;
+}
+
+/*
+ * Private function: put a BD of either size
+ */
+static inline void _fifo_bd_put(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx, unsigned int offset, unsigned int size)
+{
+	struct fifo_bd bd;
+	struct fifo_bd64 bd64;
+
+	if (g.bd64) {
+		bd64.data   = 0;
+		bd64.offset = offset;
+		bd64.size   = size;
+		bdring_bd_put64(pbdr, idx, bd64.data);
+	}
+	else {
+		bd.data   = 0;
+		bd.offset = offset;
+		bd.size   = size;
+		bdring_bd_put(pbdr, idx, bd.data);
+	}
+}
+
+/*
+ * Private function: set a BD of either size to used, without a barrier
+ */
+static inline void _fifo_bd_set(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx, unsigned int offset, unsigned int size)
+{
+	struct fifo_bd bd;
+	struct fifo_bd64 bd64;
+
+	if (g.bd64) {
+		bd64.data   = 0;
+		bd64.offset = offset;
+		bd64.size   = size;
+		pbdr->pbd64[idx].data = bd64.data | BD64_USED;
+	}
+	else {
+		bd.data   = 0;
+		bd.offset = offset;
+		bd.size   = size;
+		pbdr->pbd[idx].data = bd.data | BD_USED;
+	}
+}
+
+/*
+ * Private function: offset of a block in the data ring
+ *
+ * With FIFO_FLAG_MIRROR the block may be in the second mapping of the ring.
+ */
+static inline unsigned int _fifo_data_offset(struct fifo_geometry g, uint8_t *pdata, unsigned int datasize, const void *pblock)
+{
+	unsigned int offset = (const uint8_t *)pblock - pdata;
+
+	if ((g.mirror) && (offset >= datasize))
+		offset -= datasize;
+
+	return offset;
+}
+
+/*
+ * Private function: put count BDs of either size, for blocks in pdata
+ *
+ * The first BD is written last, the reader sees the whole range at once.
+ */
+static inline void _fifo_bd_put_range(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx, uint8_t *pdata, unsigned int datasize, const struct fifo_block *pblocks, unsigned int count)
+{
+	unsigned int i;
+	unsigned int idx_i = idx;
+
+	if (count == 0)
+		return;
+
+	/* Write the data before the BDs that point to it */
+	wmb();
+
+	for (i = 1; i < count; i++) {
+		idx_i = _fifo_bd_next(g, idx_i);
+		_fifo_bd_set(pbdr, g, idx_i, _fifo_data_offset(g, pdata, datasize, pblocks[i].pdata), pblocks[i].size);
+	}
+
+	/* Release the whole range with the first BD */
+	_fifo_bd_put(pbdr, g, idx, _fifo_data_offset(g, pdata, datasize, pblocks[0].pdata), pblocks[0].size);
+}
+
+/*
+ * Private function: check if a BD of either size is used
+ */
+static inline int _fifo_bd_is_used(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx)
+{
+	if (g.bd64)
+		return bdring_bd_is_used64(pbdr, idx);
+
+	return bdring_bd_is_used(pbdr, idx);
+}
+
+/*
+ * Private function: give a BD of either size back to the writer
+ */
+static inline void _fifo_bd_clear(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx)
+{
+	if (g.bd64)
+		bdring_bd_clear64(pbdr, idx);
+	else
+		bdring_bd_clear(pbdr, idx);
+}
+
+/*
+ * Private function: clear a BD of either size, without a barrier
+ */
+static inline void _fifo_bd_clear_nobarrier(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx)
+{
+	if (g.bd64)
+		pbdr->pbd64[idx].data = 0;
+	else
+		pbdr->pbd[idx].data = 0;
+}
+
+/*
+ * Private function: give count BDs of either size back to the writer, with one barrier
+ */
+static inline void _fifo_bd_clear_range(struct bdring *pbdr, struct fifo_geometry g, unsigned int idx, unsigned int count)
+{
+	/* Finish reading the data before the BDs are given back, wmb() only orders stores */
+	release_mb();
+
+	while (count--) {
+		_fifo_bd_clear_nobarrier(pbdr, g, idx);
+		idx = _fifo_bd_next(g, idx);
+	}
+}
+
+/**
+ * @brief Alignment of the fifo itself, the bdring and the data ring
+ *
+ * NOTE: align must already be at least 4
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_layout_align(unsigned int align, unsigned int flags)
+{
+	if ((flags & FIFO_FLAG_MIRROR) && (align < FIFO_MIRROR_PAGE_SIZE))
+		return FIFO_MIRROR_PAGE_SIZE;
+	if ((flags & FIFO_FLAG_CACHE_ALIGNED) && (align < FIFO_CACHE_LINE_SIZE))
+		return FIFO_CACHE_LINE_SIZE;
+
+	return align;
+}
+
+/**
+ * @brief Size of the header, including the optional cursor, before the bdring
+ *
+ * NOTE: align must already be at least 4
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_header_size(unsigned int align, unsigned int flags)
 {
-	uint8_t *pbdring;
 	unsigned int header_size = sizeof(struct fifo_header);
-	unsigned int bdring_size = sizeof(struct bd) * bd_count;
-	unsigned int datasize;
-	size_t offset;
 
-	/* Align needs to be at least 4 bytes, becouse the bdring right shifts the offset */
-	align = (align < 4) ? 4 : align;
+	align = fifo_layout_align(align, flags);
 
-	/* align fifo */
-	offset = (size_t)pfifodata & (align-1);
-	pfifodata = (void *)(((size_t)pfifodata + (align-1)) & ~(align-1));
-	fifosize -= offset;
+	if (flags & FIFO_FLAG_CACHE_ALIGNED) {
+		/* header, reader and writer line */
+		header_size = 3 * FIFO_CACHE_LINE_SIZE;
+	}
+	else if (flags & FIFO_FLAG_BROADCAST_MASK) {
+		header_size = (header_size + (FIFO_CACHE_LINE_SIZE-1)) & ~(FIFO_CACHE_LINE_SIZE-1);
+	}
+	else if (flags & FIFO_FLAG_READER_CURSOR) {
+		/* The cursor gets a cache line of its own */
+		header_size = (header_size + (FIFO_CACHE_LINE_SIZE-1)) & ~(FIFO_CACHE_LINE_SIZE-1);
+		header_size += FIFO_CACHE_LINE_SIZE;
+	}
+
+	/* A line per reader, and the writer line */
+	header_size += (fifo_reader_count(flags) > 0) ? (fifo_reader_count(flags) + 1) * FIFO_CACHE_LINE_SIZE : 0;
 
 	/* align bdring */
-	header_size = (header_size + (align-1)) & ~(align-1);
+	return (header_size + (align-1)) & ~(align-1);
+}
 
-	/* align data */
-	bdring_size = (bdring_size + (align-1)) & ~(align-1);
+/**
+ * @brief Size of the bdring, including the alignment of the data ring
+ *
+ * NOTE: align must already be at least 4
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_bdring_size(unsigned int bd_count, unsigned int align, unsigned int flags)
+{
+	unsigned int layout_align = fifo_layout_align(align, flags);
+
+	return (fifo_bd_size(flags) * bd_count + (layout_align-1)) & ~(layout_align-1);
+}
+
+/**
+ * @brief Size of the data ring, when the fifo is created in aligned memory
+ *
+ * Returns 0 when there is no space for the data ring.
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_data_size(unsigned int fifosize, unsigned int bd_count, unsigned int align, unsigned int flags)
+{
+	unsigned int overhead = 0;
+	unsigned int datasize = 0;
+
+	/* Align needs to be at least 4 bytes, becouse the bdring right shifts the offset */
+	align = (align < 4) ? 4 : align;
+
+	/* header, status, cursor and bdring */
+	overhead = fifo_header_size(align, flags) + fifo_bdring_size(bd_count, align, flags);
+	if (fifosize < overhead)
+		return 0;
 
 	/* whatever is left is our fifo data, at an aligned starting position */
-	datasize = fifosize - header_size - bdring_size;
+	datasize = fifosize - overhead;
 
 	/* remove unused data at the end */
-	datasize = datasize & ~(align-1);
+	if (datasize > fifo_datasize_max(flags))
+		datasize = fifo_datasize_max(flags);
+
+	/* whole pages, to be mapped twice */
+	if (flags & FIFO_FLAG_MIRROR)
+		return datasize & ~(fifo_layout_align(align, flags)-1);
+
+	return datasize & ~(align-1);
+}
+
+/**
+ * @brief Offset of the data ring, when the fifo is created in aligned memory
+ */
+static inline FIFO_CONSTEXPR unsigned int fifo_data_offset(unsigned int bd_count, unsigned int align, unsigned int flags)
+{
+	align = (align < 4) ? 4 : align;
+
+	return fifo_header_size(align, flags) + fifo_bdring_size(bd_count, align, flags);
+}
+
+/*
+ * Private function: setup the fifo struct from an initialized header
+ */
+static inline void _fifo_init_layout(struct fifo *pfifo, void *pfifodata)
+{
+	volatile struct fifo_header *pheader = (volatile struct fifo_header *)pfifodata;
+	unsigned int flags = pheader->flags;
+	unsigned int header_size = fifo_header_size(pheader->align, flags);
+	unsigned int bdring_size = fifo_bdring_size(pheader->bd_count, pheader->align, flags);
+	uint8_t *pbase = (uint8_t *)pfifodata;
+	uint8_t *pbdring;
 
 	/* header */
-	pfifo->pheader = (struct fifo_header *)pfifodata;
-	pfifo->pheader->bd_count	= bd_count;
-	pfifo->pheader->datasize	= datasize;
-	pfifo->pheader->reader_status	= 0;
-	pfifo->pheader->writer_status	= 0;
-	pfifo->pheader->align		= align;
+	pfifo->pheader = pheader;
+
+	/* status and cursor */
+	if (flags & FIFO_FLAG_CACHE_ALIGNED) {
+		pfifo->preader_status = (volatile uint32_t *)(pbase + 1 * FIFO_CACHE_LINE_SIZE);
+		pfifo->pwriter_status = (volatile uint32_t *)(pbase + 2 * FIFO_CACHE_LINE_SIZE);
+		pfifo->pcursor = (volatile struct fifo_cursor *)(pbase + 1 * FIFO_CACHE_LINE_SIZE + sizeof(uint32_t));
+	}
+	else {
+		/* The header is packed, but the status words are 32bit aligned in it */
+		pfifo->preader_status = (volatile uint32_t *)(pbase + offsetof(struct fifo_header, reader_status));
+		pfifo->pwriter_status = (volatile uint32_t *)(pbase + offsetof(struct fifo_header, writer_status));
+		pfifo->pcursor = (volatile struct fifo_cursor *)(pbase + header_size - FIFO_CACHE_LINE_SIZE);
+	}
+	if ((flags & FIFO_FLAG_READER_CURSOR) == 0)
+		pfifo->pcursor = NULL;
+
+	/* broadcast, the slots and writer line follow the header lines */
+	pfifo->reader_count = fifo_reader_count(flags);
+	pfifo->pslots = NULL;
+	pfifo->preclaim = NULL;
+	if (pfifo->reader_count > 0) {
+		pfifo->pslots = (volatile struct fifo_broadcast_slot *)(pbase + ((flags & FIFO_FLAG_CACHE_ALIGNED) ? 3 : 1) * FIFO_CACHE_LINE_SIZE);
+		pfifo->preclaim = (volatile uint32_t *)&pfifo->pslots[pfifo->reader_count];
+		pfifo->pcursor = &pfifo->pslots[0].cursor;
+	}
 
 	/* bdring */
-	pbdring = (uint8_t *)pfifodata + sizeof(struct fifo_header);
-	bdring_init(&pfifo->bdr, (volatile void *)pbdring, bd_count);
-	bdring_clear(&pfifo->bdr);
+	pbdring = pbase + header_size;
+	if (flags & FIFO_FLAG_BD64)
+		bdring_init_64(&pfifo->bdr, (volatile void *)pbdring, pheader->bd_count);
+	else
+		bdring_init(&pfifo->bdr, (volatile void *)pbdring, pheader->bd_count);
 
 	/* data */
 	pfifo->pdata = pbdring + bdring_size;
+	pfifo->datasize = (flags & FIFO_FLAG_BD64) ? pheader->datasize64 : pheader->datasize;
+
+	/* geometry */
+	pfifo->geometry.bd_mask		= pheader->bd_count - 1;
+	pfifo->geometry.align_bits	= pheader->align - 1;
+	pfifo->geometry.bd64		= (flags & FIFO_FLAG_BD64) ? 1 : 0;
+	pfifo->geometry.block_max_size	= fifo_block_max_size(flags);
+	pfifo->geometry.broadcast	= (pfifo->reader_count > 0) ? 1 : 0;
+	pfifo->geometry.mirror		= (flags & FIFO_FLAG_MIRROR) ? 1 : 0;
 }
 
 /**
  * @brief Initialize the fifo struct
+ *
+ * @param flags FIFO_FLAG_* options, 0 for the default layout
+ *
+ * NOTE: Without FIFO_FLAG_BD64 the data ring can not be larger than 64KiB
+ *       (fifo_datasize_max), the rest of the memory is not used.
+ * NOTE: With FIFO_FLAG_MIRROR pfifodata must be page aligned, and followed
+ *       by the second mapping of the data ring (fifo_shm_create_mirror).
  */
-static inline void fifo_init_connect(struct fifo *pfifo, void *pfifodata)
+static inline void fifo_init_create(struct fifo *pfifo, void *pfifodata, unsigned int fifosize, unsigned int bd_count, unsigned int align, unsigned int flags)
 {
-	#if 0 // FIXME: where does the header start?
-	uint8_t *pbdring;
+	unsigned int layout_align;
+	unsigned int datasize;
+	unsigned int idx;
+	size_t offset;
+
+	/* Align needs to be at least 4 bytes, becouse the bdring right shifts the offset */
+	align = (align < 4) ? 4 : align;
+	layout_align = fifo_layout_align(align, flags);
+
+	/* align fifo */
+	offset = (size_t)pfifodata & (layout_align-1);
+	if (offset != 0) {
+		pfifodata = (uint8_t *)pfifodata + (layout_align - offset);
+		fifosize -= layout_align - offset;
+	}
+
+	/* header, status, cursor and bdring are aligned, whatever is left is our fifo data */
+	datasize = fifo_data_size(fifosize, bd_count, align, flags);
 
 	/* header */
 	pfifo->pheader = (struct fifo_header *)pfifodata;
+	pfifo->pheader->bd_count	= bd_count;
+	pfifo->pheader->datasize	= (flags & FIFO_FLAG_BD64) ? 0 : datasize;
+	pfifo->pheader->datasize64	= (flags & FIFO_FLAG_BD64) ? datasize : 0;
+	pfifo->pheader->reader_status	= 0;
+	pfifo->pheader->writer_status	= 0;
+	pfifo->pheader->align		= align;
+	pfifo->pheader->flags		= flags;
+
+	_fifo_init_layout(pfifo, pfifodata);
+
+	/* status and cursor */
+	*pfifo->preader_status = 0;
+	*pfifo->pwriter_status = 0;
+	if (pfifo->pcursor != NULL) {
+		pfifo->pcursor->seq	= 0;
+		pfifo->pcursor->offset	= 0;
+	}
+
+	/* broadcast, the readers take a slot with fifo_reader_init_broadcast */
+	for (idx = 0; idx < pfifo->reader_count; idx++) {
+		pfifo->pslots[idx].cursor.seq		= 0;
+		pfifo->pslots[idx].cursor.offset	= 0;
+		pfifo->pslots[idx].mode			= FIFO_READER_NONE;
+	}
+	if (pfifo->preclaim != NULL)
+		*pfifo->preclaim = 0;
 
 	/* bdring */
-	pbdring = (uint8_t *)pfifodata + sizeof(struct fifo_header);
-	bdring_init(&pfifo->bdr, (volatile void *)pbdring, pfifo->pheader->bd_count);
+	bdring_clear(&pfifo->bdr);
+}
 
-	/* data */
-	pfifo->pdata = pbdring + bdring_size;
-	#endif
+/**
+ * @brief Initialize the fifo struct, for a fifo that has already been created
+ *
+ * Used to connect to a fifo created by someone else, for instance another
+ * process sharing the same memory. Everything needed is read from the header.
+ *
+ * NOTE: pfifodata must point to the header. fifo_init_create will move the
+ *       header forward if the memory it gets is not aligned, so the easiest
+ *       is to create the fifo in aligned memory (like a shared memory mapping).
+ */
+static inline void fifo_init_connect(struct fifo *pfifo, void *pfifodata)
+{
+	_fifo_init_layout(pfifo, pfifodata);
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,296 @@
+#ifndef __FIFO_FANIN_H
+#define __FIFO_FANIN_H
+
+/**
+ * @file fifo_fanin.h
+ * @brief Pipe data from many fifo_readers into one fifo_writer.
+ *
+ * Every source is a fifo_pipe into the same writer. One thread calls
+ * fifo_fanin_transfer, which picks the source with a deficit round robin
+ * scheduler:
+ * 1 - when the scheduler gets to a source, its deficit grows by its quantum
+ * 2 - the source transfers batches while the first block fits in the deficit
+ * 3 - a source that is empty loses its deficit, one with a block that does
+ *     not fit yet keeps it for the next round
+ *
+ * So over time every source that has data gets a share of the bytes in
+ * proportion to its weight. Each batch is still one fifo_pipe_transfer, with
+ * the fp_transfer hook of the pipes, so an async DMA still works.
+ *
+ * NOTE: The transfers must complete in the order they were started, over all
+ * sources. They commit into the same writer, in the order the space was
+ * claimed. This holds for the default memcpy and for a single DMA queue.
+ */
+
+#include <stdlib.h> // malloc / free
+
+#include "linux_port.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_pipe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------------
+struct fifo_fanin_source
+{
+	struct fifo_pipe pipe;			// from the source reader into the shared writer
+
+	unsigned int	quantum;		// bytes added to the deficit every round
+	unsigned int	deficit;		// bytes the source can still transfer this round
+	uint64_t	bytes;			// bytes transferred, for statistics
+};
+
+//---------------------------------------------------------------------------
+struct fifo_fanin
+{
+	struct fifo_writer *pwriter;
+
+	struct fifo_fanin_source *psource;
+	unsigned int	source_count;		// number of sources added
+	unsigned int	source_max;		// number of sources allocated
+
+	unsigned int	current;		// source the scheduler is at
+	unsigned int	current_fresh;		// the current source did not get its quantum yet
+
+	unsigned int	quantum;		// quantum of a source with weight 1
+	unsigned int	batch_size_max;		// max size of a transfer, also limited by the deficit
+	unsigned int	batch_size_urgent;	// max size of a transfer, when the writer is almost empty
+};
+
+/**
+ * @brief Initialize the fifo_fanin struct
+ *
+ * The quantum of a source with weight 1 defaults to the biggest block of the
+ * writer, so every source can transfer a block in every round.
+ *
+ * @param source_max max number of sources (fifo_fanin_add_source)
+ * @return 0 on success, -1 when the sources can not be allocated
+ */
+static inline int fifo_fanin_init(struct fifo_fanin *pfanin, struct fifo_writer *pwriter, unsigned int source_max)
+{
+	pfanin->pwriter = pwriter;
+
+	pfanin->psource = (struct fifo_fanin_source *)malloc(sizeof(struct fifo_fanin_source) * source_max);
+	pfanin->source_count = 0;
+	pfanin->source_max = (pfanin->psource != NULL) ? source_max : 0;
+
+	pfanin->current = 0;
+	pfanin->current_fresh = 1;
+
+	pfanin->quantum = fifo_writer_get_block_max_size(pwriter);
+	pfanin->batch_size_max = MAX_BATCH_SIZE;
+	pfanin->batch_size_urgent = MAX_BATCH_SIZE_URGENT;
+
+	return (pfanin->psource != NULL) ? 0 : -1;
+}
+
+/**
+ * @brief Add a source, with a pipe from preader into the writer
+ *
+ * The pipe of the source can be tuned like any other fifo_pipe, for example
+ * its fp_transfer hook and window (see fifo_fanin_get_pipe). But the batch
+ * size is set by the fan-in (fifo_fanin_set_batch_size).
+ *
+ * @param weight share of the bytes, relative to the other sources, at least 1
+ * @return index of the source, or -1 when source_max sources were added or
+ *         the pipe of the source can not be initialized
+ */
+static inline int fifo_fanin_add_source(struct fifo_fanin *pfanin, struct fifo_reader *preader, unsigned int weight)
+{
+	struct fifo_fanin_source *psource;
+
+	if (pfanin->source_count == pfanin->source_max)
+		return -1;
+
+	psource = &pfanin->psource[pfanin->source_count];
+	if (fifo_pipe_init(&psource->pipe, preader, pfanin->pwriter) != 0) {
+		fifo_pipe_deinit(&psource->pipe);
+		return -1;
+	}
+	psource->quantum = ((weight == 0) ? 1 : weight) * pfanin->quantum;
+	psource->deficit = 0;
+	psource->bytes = 0;
+
+	return pfanin->source_count++;
+}
+
+/**
+ * @brief Get the pipe of a source, to set its fp_transfer, window or wakeup handler
+ */
+static inline struct fifo_pipe * fifo_fanin_get_pipe(struct fifo_fanin *pfanin, unsigned int source)
+{
+	return &pfanin->psource[source].pipe;
+}
+
+/**
+ * @brief Set the fp_transfer hook of all sources
+ */
+static inline void fifo_fanin_set_transfer(struct fifo_fanin *pfanin, void (*fp_transfer)(struct fifo_pipe_transfer *ptransfer))
+{
+	unsigned int i;
+
+	for (i = 0; i < pfanin->source_count; i++)
+		pfanin->psource[i].pipe.fp_transfer = fp_transfer;
+}
+
+/**
+ * @brief Limit the number of transfers in flight, of every source
+ *
+ * @param window max number of transfers, 0 for no limit (one per BD of the writer)
+ */
+static inline void fifo_fanin_set_window(struct fifo_fanin *pfanin, unsigned int window)
+{
+	unsigned int i;
+
+	for (i = 0; i < pfanin->source_count; i++)
+		fifo_pipe_set_window(&pfanin->psource[i].pipe, window);
+}
+
+/**
+ * @brief Set a wakeup handler to be called when a transfer completes, while a window is full
+ */
+static inline void fifo_fanin_set_wakeup_handler(struct fifo_fanin *pfanin, fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+{
+	unsigned int i;
+
+	for (i = 0; i < pfanin->source_count; i++)
+		fifo_pipe_set_wakeup_handler(&pfanin->psource[i].pipe, wakeup_handler, wakeup_handler_arg);
+}
+
+/**
+ * @brief Limit the size of the transfers
+ *
+ * @param batch_size_max max size of a transfer (default MAX_BATCH_SIZE)
+ * @param batch_size_urgent max size while the writer is almost empty (default MAX_BATCH_SIZE_URGENT)
+ */
+static inline void fifo_fanin_set_batch_size(struct fifo_fanin *pfanin, unsigned int batch_size_max, unsigned int batch_size_urgent)
+{
+	pfanin->batch_size_max = batch_size_max;
+	pfanin->batch_size_urgent = batch_size_urgent;
+}
+
+/*
+ * Private function: move the scheduler to the next source
+ */
+static inline void _fifo_fanin_next(struct fifo_fanin *pfanin)
+{
+	if (++pfanin->current == pfanin->source_count)
+		pfanin->current = 0;
+	pfanin->current_fresh = 1;
+}
+
+/** @brief Start one transfer from the source that is next in line
+ *
+ *  Call it until it no longer returns FIFO_PIPE_SUBMITTED, like
+ *  fifo_pipe_transfer.
+ *
+ *  @param pfanin the fifo_fanin object
+ *  @return FIFO_PIPE_SUBMITTED when a transfer is started, FIFO_PIPE_DST_FULL
+ *          when the writer is full, FIFO_PIPE_WINDOW_FULL when the sources
+ *          with data all have a full window, FIFO_PIPE_EMPTY when all sources
+ *          are empty
+ */
+static inline enum fifo_pipe_status fifo_fanin_transfer(struct fifo_fanin *pfanin)
+{
+	struct fifo_fanin_source *psource;
+	struct fifo_reader *preader;
+	enum fifo_pipe_status status = FIFO_PIPE_EMPTY;
+	enum fifo_pipe_status status_source;
+	unsigned int idle = 0;
+	unsigned int size;
+	void *blockin;
+
+	/*
+	 * Stop after a round where no source could transfer. A source with a
+	 * block bigger than its deficit does not count: its deficit grows every
+	 * round, until the block fits.
+	 */
+	while (idle < pfanin->source_count) {
+		psource = &pfanin->psource[pfanin->current];
+		preader = psource->pipe.preader;
+
+		if (pfanin->current_fresh) {
+			psource->deficit += psource->quantum;
+			pfanin->current_fresh = 0;
+		}
+
+		/* The first block must fit in the deficit */
+		size = _fifo_reader_get(preader, preader->pfifo->geometry, &blockin, preader->index_read);
+		if (size == 0) {
+			psource->deficit = 0;
+			_fifo_fanin_next(pfanin);
+			idle++;
+			continue;
+		}
+		if (size > psource->deficit) {
+			_fifo_fanin_next(pfanin);
+			idle = 0;
+			continue;
+		}
+
+		/* The whole batch must fit in the deficit */
+		fifo_pipe_set_batch_size(&psource->pipe,
+			(pfanin->batch_size_max < psource->deficit) ? pfanin->batch_size_max : psource->deficit,
+			(pfanin->batch_size_urgent < psource->deficit) ? pfanin->batch_size_urgent : psource->deficit);
+
+		status_source = fifo_pipe_transfer(&psource->pipe);
+		if (status_source == FIFO_PIPE_SUBMITTED) {
+			size = fifo_pipe_get_submitted_size(&psource->pipe);
+			psource->deficit -= size;
+			psource->bytes += size;
+			return FIFO_PIPE_SUBMITTED;
+		}
+
+		/* The writer is shared, no other source can continue either: keep our turn */
+		if (status_source == FIFO_PIPE_DST_FULL)
+			return FIFO_PIPE_DST_FULL;
+
+		/* Window full: the source can not use its turn, it is not waiting for it either */
+		psource->deficit = 0;
+		status = FIFO_PIPE_WINDOW_FULL;
+		_fifo_fanin_next(pfanin);
+		idle++;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Tell all fifos the fan-in is going to sleep (or is awake again)
+ *
+ * Same as fifo_pipe_set_waiting, for the readers of all sources and the
+ * writer.
+ */
+static inline void fifo_fanin_set_waiting(struct fifo_fanin *pfanin, unsigned int waiting)
+{
+	unsigned int i;
+
+	for (i = 0; i < pfanin->source_count; i++)
+		fifo_pipe_set_waiting(&pfanin->psource[i].pipe, waiting);
+}
+
+/**
+ * @brief Free the resources of the fifo_fanin struct
+ *
+ * NOTE: All transfers must be completed
+ */
+static inline void fifo_fanin_deinit(struct fifo_fanin *pfanin)
+{
+	unsigned int i;
+
+	for (i = 0; i < pfanin->source_count; i++)
+		fifo_pipe_deinit(&pfanin->psource[i].pipe);
+
+	free(pfanin->psource);
+	pfanin->psource = NULL;
+	pfanin->source_count = 0;
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
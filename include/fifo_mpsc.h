@@ -0,0 +1,223 @@
+#ifndef __FIFO_MPSC_H
+#define __FIFO_MPSC_H
+
+/**
+ * @file fifo_mpsc.h
+ * @brief Write data into the fifo from many threads (multi producer, single consumer).
+ *
+ * All producers share one fifo_mpsc. A producer:
+ * 1 - reserves a block and its BD with one compare and swap (fifo_mpsc_reserve)
+ * 2 - fills the block, at the same time as the other producers
+ * 3 - commits the block (fifo_mpsc_commit), in any order
+ *
+ * The reader still gets the blocks in the order they were reserved: it stops
+ * at the first BD that is not committed yet. The fifo layout is the same, so
+ * the fifo_reader and fifo_pipe work as before.
+ *
+ * Only for fifos with FIFO_FLAG_READER_CURSOR. Without a cursor the writer
+ * scans the bdring for the reader, and a BD that is reserved but not yet
+ * committed looks the same as a BD the reader has freed.
+ *
+ * NOTE: A fifo is written by a fifo_writer or a fifo_mpsc, never by both.
+ */
+
+#include "linux_port.h"
+#include "bdring.h"
+#include "fifo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fifo_mpsc
+{
+	struct fifo	*pfifo;
+	uint8_t		*pdata;
+	unsigned int	datasize;
+
+	struct bdring	*pbdr;
+	volatile struct fifo_cursor *pcursor;
+
+	fifo_wakeup_handler wakeup_handler;
+	void		*wakeup_handler_arg;
+
+	/* Written by all producers, in a cache line of its own: blocks reserved << 32 | write offset */
+	uint64_t	head __attribute__ ((aligned(FIFO_CACHE_LINE_SIZE)));
+} __attribute__ ((aligned(FIFO_CACHE_LINE_SIZE)));
+
+/**
+ * @brief Initialize the fifo_mpsc struct, before any producer uses it
+ *
+ * @return 0 on success, -1 when the fifo has no reader cursor, or is a broadcast fifo
+ */
+static inline int fifo_mpsc_init(struct fifo_mpsc *pmpsc, struct fifo *pfifo)
+{
+	if ((pfifo->pcursor == NULL) || (pfifo->reader_count > 0))
+		return -1;
+
+	pmpsc->pfifo = pfifo;
+	pmpsc->pdata = pfifo->pdata;
+	pmpsc->datasize = pfifo->datasize;
+
+	pmpsc->pbdr = &pfifo->bdr;
+	pmpsc->pcursor = pfifo->pcursor;
+
+	pmpsc->wakeup_handler = NULL;
+	pmpsc->wakeup_handler_arg = NULL;
+
+	pmpsc->head = 0;
+
+	return 0;
+}
+
+/**
+ * @brief Set a wakeup handler to be called when a producer wants to wakeup the reader
+ */
+static inline void fifo_mpsc_set_wakeup_handler(struct fifo_mpsc *pmpsc, fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+{
+	pmpsc->wakeup_handler = wakeup_handler;
+	pmpsc->wakeup_handler_arg = wakeup_handler_arg;
+}
+
+/**
+ * @brief Get the biggest block that can be reserved
+ *
+ * At most half the data ring. Then there is always room for a block, at the
+ * write offset or at the beginning, once the reader has freed everything.
+ */
+static inline unsigned int fifo_mpsc_get_block_max_size(struct fifo_mpsc *pmpsc)
+{
+	unsigned int half = pmpsc->datasize / 2;
+
+	return (pmpsc->pfifo->geometry.block_max_size < half) ? pmpsc->pfifo->geometry.block_max_size : half;
+}
+
+/*
+ * Private function: find where a block of aligned_size fits, for a given head
+ *
+ * Same rules as _fifo_writer_update_reader_cursor, without a writer that owns
+ * the fifo: the free space follows from the head and the reader cursor.
+ */
+static inline int _fifo_mpsc_find(struct fifo_mpsc *pmpsc, struct fifo_geometry g, uint64_t head, unsigned int aligned_size, unsigned int *pstart)
+{
+	uint32_t seq    = (uint32_t)(head >> 32);
+	unsigned int offset = (uint32_t)head;
+	uint32_t rseq;
+	unsigned int roffset;
+
+	/* The reader writes the offset before the seq, so read them the other way around */
+	rseq = pmpsc->pcursor->seq;
+	rmb();
+	roffset = (pmpsc->pcursor->offset + g.align_bits) & ~g.align_bits;
+
+	/* Read the cursor before writing into the space it frees */
+	rmb();
+
+	/* A block needs a free BD, one is always kept free */
+	if ((uint32_t)(seq - rseq) >= g.bd_mask)
+		return 0;
+
+	if ((seq == rseq) || (offset > roffset)) {
+		/* Free from the write offset to the end, and from the beginning to the reader */
+		if (offset + aligned_size <= pmpsc->datasize)
+			*pstart = offset;
+		else if (aligned_size <= roffset)
+			*pstart = 0;
+		else
+			return 0;
+	}
+	else if (offset < roffset) {
+		/* The writer wrapped, the reader did not */
+		if (offset + aligned_size > roffset)
+			return 0;
+		*pstart = offset;
+	}
+	else {
+		/* Not empty, and the writer is at the reader: full */
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Reserve a block of size bytes, and the BD for it
+ *
+ * Can be called by many producers at the same time. The block must be
+ * committed with fifo_mpsc_commit, also when there is nothing to write in it,
+ * the reader waits for every reserved block.
+ *
+ * @param pseq returns the sequence number of the block, to commit it with
+ * @return a pointer to the block, or NULL when there is no free space or BD
+ */
+static inline void * fifo_mpsc_reserve(struct fifo_mpsc *pmpsc, unsigned int size, uint32_t *pseq)
+{
+	struct fifo_geometry g = pmpsc->pfifo->geometry;
+	unsigned int aligned_size = (size + g.align_bits) & ~g.align_bits;
+	unsigned int start = 0;
+	uint64_t head, head_next;
+
+	if ((size == 0) || (size > fifo_mpsc_get_block_max_size(pmpsc)))
+		return NULL;
+
+	head = __atomic_load_n(&pmpsc->head, __ATOMIC_RELAXED);
+	do {
+		if (_fifo_mpsc_find(pmpsc, g, head, aligned_size, &start) == 0)
+			return NULL;
+
+		head_next = ((uint64_t)((uint32_t)(head >> 32) + 1) << 32) | (start + aligned_size);
+	} while (__atomic_compare_exchange_n(&pmpsc->head, &head, head_next, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) == 0);
+
+	*pseq = (uint32_t)(head >> 32);
+
+	return pmpsc->pdata + start;
+}
+
+/**
+ * @brief Commit a reserved block for the reader to pickup
+ *
+ * The blocks can be committed in any order, the reader gets them in the order
+ * they were reserved.
+ *
+ * @param size at least 1, at most the reserved size
+ */
+static inline void fifo_mpsc_commit(struct fifo_mpsc *pmpsc, uint32_t seq, void *pdata, unsigned int size)
+{
+	struct fifo_geometry g = pmpsc->pfifo->geometry;
+
+	_fifo_bd_put(pmpsc->pbdr, g, seq & g.bd_mask, (uint8_t *)pdata - pmpsc->pdata, size);
+}
+
+/**
+ * @brief Check if a block of min_size can be reserved now
+ */
+static inline int fifo_mpsc_has_free(struct fifo_mpsc *pmpsc, unsigned int min_size)
+{
+	struct fifo_geometry g = pmpsc->pfifo->geometry;
+	unsigned int start;
+
+	return _fifo_mpsc_find(pmpsc, g, __atomic_load_n(&pmpsc->head, __ATOMIC_RELAXED), (min_size + g.align_bits) & ~g.align_bits, &start);
+}
+
+/**
+ * @brief Wakeup a reader that is waiting for data
+ *
+ * Same as fifo_writer_wakeup_reader, can be called by many producers.
+ */
+static inline void fifo_mpsc_wakeup_reader(struct fifo_mpsc *pmpsc, unsigned int force)
+{
+	if (pmpsc->wakeup_handler == NULL)
+		return;
+
+	/* Publish the BDs before checking if the reader went to sleep */
+	mb();
+
+	if ((force) || (*pmpsc->pfifo->preader_status & RD_STS_WAITING))
+		pmpsc->wakeup_handler(pmpsc->wakeup_handler_arg);
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -15,6 +15,8 @@
 
 #define USE_BATCHES
 
+/* The batch sizes can be overridden (-D), for tuning with the timing model of cdmasim.h */
+#ifndef MAX_BATCH_SIZE
 #if 1
 /* Use small batches if the receiver is needing data urgently */
 #define MAX_BATCH_SIZE		(FIFO_SIZE/2)
@@ -24,7 +26,10 @@
 #define MAX_BATCH_SIZE		(FIFO_SIZE)
 #define MAX_BATCH_SIZE_URGENT	(FIFO_SIZE)
 #endif
-#define MAX_FREE_SIZE_URGENT	(FIFO_SIZE-MAX_BATCH_SIZE_URGENT)
+#endif
+#ifndef MAX_BATCH_SIZE_URGENT
+#define MAX_BATCH_SIZE_URGENT	(MAX_BATCH_SIZE)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,6 +38,27 @@ extern "C" {
 struct fifo_pipe;
 struct fifo_pipe_transfer;
 
+/* What the pipe puts into the writer, see fifo_pipe_set_mode */
+enum fifo_pipe_mode
+{
+	FIFO_PIPE_COPY = 0,		/* a copy of the data (default) */
+	FIFO_PIPE_HANDOFF,		/* a descriptor of the data in the reader */
+	FIFO_PIPE_HANDOFF_FORWARD,	/* the reader has descriptors, pass them on */
+};
+
+/* Max number of descriptors passed on at once, in a handoff mode */
+#define FIFO_PIPE_HANDOFF_BATCH	(64)
+
+/* Result of fifo_pipe_transfer */
+enum fifo_pipe_status
+{
+	FIFO_PIPE_EMPTY = 0,		/* nothing to transfer, the reader is empty */
+	FIFO_PIPE_DST_FULL,		/* no space or BDs in the writer */
+	FIFO_PIPE_WINDOW_FULL,		/* the max number of transfers are in flight */
+	FIFO_PIPE_SUBMITTED,		/* a transfer has been started */
+	FIFO_PIPE_STATUS_COUNT
+};
+
 //---------------------------------------------------------------------------
 struct fifo_pipe
 {
@@ -40,13 +66,38 @@ struct fifo_pipe
 	struct fifo_writer *pwriter;
 
 	void (*fp_transfer)(struct fifo_pipe_transfer *ptransfer);
+
+	/*
+	 * Pool of transfers, one for every BD of the writer. Transfers are
+	 * allocated by the pipe and freed by fifo_pipe_transfer_commit, in the
+	 * same order.
+	 */
+	struct fifo_pipe_transfer *ptransfer_pool;
+	unsigned int	transfer_mask;
+	unsigned int	transfer_alloc;		// number of transfers allocated
+	volatile unsigned int transfer_free;	// number of transfers freed
+
+	unsigned int	window;			// max number of transfers in flight
+	volatile unsigned int window_waiting;	// wakeup the pipe when a transfer completes
+
+	unsigned int	batch_size_max;		// max size of a transfer
+	unsigned int	batch_size_urgent;	// max size of a transfer, when the writer is almost empty
+	unsigned int	submitted_size;		// bytes of the reader in the last transfer, see fifo_pipe_get_submitted_size
+
+	enum fifo_pipe_mode mode;
+	unsigned int	handoff_index;		// first BD of the writer that its reader did not free yet
+	unsigned int	handoff_count;		// number of BDs of the writer that its reader did not free yet
+
+	fifo_wakeup_handler wakeup_handler;
+	void		*wakeup_handler_arg;
 };
 
 //---------------------------------------------------------------------------
-struct fifo_pipe_transfer
+/*
+ * Continuous data in both fifos
+ */
+struct fifo_pipe_segment
 {
-	struct fifo_pipe *ppipe;
-
 	void *dst;
 	const void *src;
 	size_t size;
@@ -54,6 +105,67 @@ struct fifo_pipe_transfer
 	unsigned int batch_count;
 };
 
+/* Max number of segments in one transfer, like a DMA chain */
+#define FIFO_PIPE_MAX_SEGMENTS	(4)
+
+//---------------------------------------------------------------------------
+struct fifo_pipe_transfer
+{
+	struct fifo_pipe *ppipe;
+
+	size_t size;				// total size of all segments
+
+	unsigned int segment_count;
+	struct fifo_pipe_segment segment[FIFO_PIPE_MAX_SEGMENTS];
+};
+
+/*
+ * Private function: same as fifo_pipe_transfer_commit, for the given geometries
+ */
+static inline void _fifo_pipe_transfer_commit(struct fifo_pipe *ppipe, struct fifo_geometry greader, struct fifo_geometry gwriter, struct fifo_pipe_transfer *ptransfer)
+{
+	struct fifo_reader *preader = ppipe->preader;
+	struct fifo_writer *pwriter = ppipe->pwriter;
+	struct fifo_pipe_segment *psegment;
+	unsigned int seg;
+
+	for (seg = 0; seg < ptransfer->segment_count; seg++) {
+		psegment = &ptransfer->segment[seg];
+#ifndef USE_BATCHES
+		_fifo_writer_commit(pwriter, gwriter, psegment->dst, psegment->size);
+		_fifo_reader_free(preader, greader);
+#else
+		uint8_t *blockout = (uint8_t *)psegment->dst;
+		uint8_t *offset;
+		uint8_t *offset_first;
+		size_t distance;
+		unsigned int size;
+		unsigned int i;
+
+		/* Commit all packets */
+		for (i = 0; i < psegment->batch_count; i++) {
+			size = _fifo_reader_get(preader, greader, (void **)(&offset), preader->index_claimed);
+			if (i == 0) offset_first = offset;
+			distance = (offset >= offset_first) ? (offset - offset_first) : (offset + preader->datasize - offset_first); // mirrored reader wrapped
+			_fifo_writer_commit(pwriter, gwriter, blockout + distance, size);
+			_fifo_reader_free(preader, greader);
+		}
+#endif // USE_BATCHES
+	}
+
+	fifo_reader_wakeup_writer(preader, 0);
+	fifo_writer_wakeup_reader(pwriter, 0);
+
+	/* Give the transfer back to the pool, after we are done with it */
+	release_mb();
+	ppipe->transfer_free++;
+
+	/* Wakeup the pipe if it is waiting for the window */
+	mb();
+	if ((ppipe->window_waiting) && (ppipe->wakeup_handler != NULL))
+		ppipe->wakeup_handler(ppipe->wakeup_handler_arg);
+}
+
 /** @brief Commit a transfer into the fifo
  *
  *  The output fifo will be notified of the new data
@@ -66,125 +178,364 @@ struct fifo_pipe_transfer
  *  @param ptransfer the fifo_pipe_transfer object
  */
 static inline void fifo_pipe_transfer_commit(struct fifo_pipe *ppipe, struct fifo_pipe_transfer *ptransfer)
+{
+	_fifo_pipe_transfer_commit(ppipe, ppipe->preader->pfifo->geometry, ppipe->pwriter->pfifo->geometry, ptransfer);
+}
+
+//---------------------------------------------------------------------------
+static inline void fifo_pipe_transfer_default(struct fifo_pipe_transfer *ptransfer)
+{
+	unsigned int seg;
+
+	for (seg = 0; seg < ptransfer->segment_count; seg++)
+		memcpy(ptransfer->segment[seg].dst, ptransfer->segment[seg].src, ptransfer->segment[seg].size);
+	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
+}
+
+/*
+ * Private function: free the blocks of the reader, whose descriptors are freed in the writer
+ */
+static inline void _fifo_pipe_handoff_release(struct fifo_pipe *ppipe, struct fifo_geometry greader, struct fifo_geometry gwriter)
+{
+	struct bdring *pbdr = ppipe->pwriter->pbdr;
+	unsigned int count = 0;
+
+	/* The reader of the writer frees the descriptors in order */
+	while ((count < ppipe->handoff_count) && (_fifo_bd_is_used(pbdr, gwriter, (ppipe->handoff_index + count) & gwriter.bd_mask) == 0))
+		count++;
+	if (count == 0)
+		return;
+
+	/* The last reader is done with the data, before it is given back */
+	rmb();
+
+	_fifo_reader_free_blocks(ppipe->preader, greader, count);
+	fifo_reader_wakeup_writer(ppipe->preader, 0);
+
+	ppipe->handoff_index = (ppipe->handoff_index + count) & gwriter.bd_mask;
+	ppipe->handoff_count -= count;
+}
+
+/*
+ * Private function: same as fifo_pipe_transfer, in a handoff mode
+ */
+static inline enum fifo_pipe_status _fifo_pipe_handoff(struct fifo_pipe *ppipe, struct fifo_geometry greader, struct fifo_geometry gwriter)
 {
 	struct fifo_reader *preader = ppipe->preader;
 	struct fifo_writer *pwriter = ppipe->pwriter;
+	struct fifo_block blockin[FIFO_PIPE_HANDOFF_BATCH];
+	struct fifo_block blockout[FIFO_PIPE_HANDOFF_BATCH];
+	unsigned int count, free_count, i;
 
-#ifndef USE_BATCHES
-	fifo_writer_commit(pwriter, ptransfer->dst, ptransfer->size);
-	fifo_reader_free(preader);
-#else
-	uint8_t *blockout = (uint8_t *)ptransfer->dst;
-	uint8_t *offset;
-	uint8_t *offset_first;
-	unsigned int size;
-	unsigned int i;
-
-	/* Commit all packets */
-	for (i = 0; i < ptransfer->batch_count; i++) {
-		size = fifo_reader_get_claim(preader, (void **)(&offset));
-		if (i == 0) offset_first = offset;
-		fifo_writer_commit(pwriter, blockout + (offset - offset_first), size);
-		fifo_reader_free(preader);
+	ppipe->submitted_size = 0;
+	_fifo_pipe_handoff_release(ppipe, greader, gwriter);
+
+	count = _fifo_reader_get_blocks(preader, greader, blockin, FIFO_PIPE_HANDOFF_BATCH);
+	if (count == 0)
+		return FIFO_PIPE_EMPTY;
+
+	/*
+	 * Never more descriptors than BDs in either fifo: a BD the reader of the
+	 * writer freed can not be written again before the data it referred to
+	 * is released, and all BDs of the reader stay claimed until then
+	 */
+	free_count = ((greader.bd_mask < gwriter.bd_mask) ? greader.bd_mask : gwriter.bd_mask) + 1 - ppipe->handoff_count;
+	if (count > free_count)
+		count = free_count;
+
+	_fifo_writer_update_reader(pwriter, gwriter);
+	count = _fifo_writer_reserve(pwriter, gwriter, blockout, count, sizeof(struct fifo_block));
+	if (count == 0)
+		return FIFO_PIPE_DST_FULL;
+
+	for (i = 0; i < count; i++) {
+		if (ppipe->mode == FIFO_PIPE_HANDOFF_FORWARD)
+			memcpy(blockout[i].pdata, blockin[i].pdata, sizeof(struct fifo_block));
+		else
+			memcpy(blockout[i].pdata, &blockin[i], sizeof(struct fifo_block));
+		ppipe->submitted_size += blockin[i].size;
 	}
-#endif // USE_BATCHES
 
-	fifo_reader_wakeup_writer(preader, 0);
+	/* The blocks of the reader stay claimed, until the descriptors are freed */
+	_fifo_reader_claim(preader, greader, count, 0);
+	_fifo_writer_commit_blocks(pwriter, gwriter, blockout, count);
 	fifo_writer_wakeup_reader(pwriter, 0);
 
-	free(ptransfer);
-}
+	ppipe->handoff_count += count;
 
-//---------------------------------------------------------------------------
-static inline void fifo_pipe_transfer_default(struct fifo_pipe_transfer *ptransfer)
-{
-	memcpy(ptransfer->dst, ptransfer->src, ptransfer->size);
-	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
+	return FIFO_PIPE_SUBMITTED;
 }
 
-/** @brief Transfer as much data as possible from the reader to the writer
- *
- *  The pipe will stop when either the reader is empty, or the writer is full
- *
- *  @param ppipe the fifo_pipe object
+/*
+ * Private function: same as fifo_pipe_transfer, for the given geometries
  */
-static inline uint32_t fifo_pipe_transfer(struct fifo_pipe *ppipe)
+static inline enum fifo_pipe_status _fifo_pipe_transfer(struct fifo_pipe *ppipe, struct fifo_geometry greader, struct fifo_geometry gwriter)
 {
 	struct fifo_reader *preader = ppipe->preader;
 	struct fifo_writer *pwriter = ppipe->pwriter;
 	void *blockin, *blockout;
 	unsigned int batch_size = 0, batch_size_min, batch_size_max;
 	unsigned int batch_count = 0;
+	unsigned int total_size_max = ppipe->batch_size_max;
+	struct fifo_pipe_transfer *ptransfer;
+	struct fifo_pipe_segment *psegment;
+
+	ppipe->submitted_size = 0;
+	if (ppipe->mode != FIFO_PIPE_COPY)
+		return _fifo_pipe_handoff(ppipe, greader, gwriter);
 
 	/*
 	 * 1 get minimal size needed by first block in reader
 	 * 2 get maximum size free in writer, using minimum space required
 	 * 3 get maximum number of continuous blocks from reader, using maximum space
+	 * 4 repeat for the next segment
 	 */
 
 	/* 1 get minimal size needed by first block */
-	batch_size_min = fifo_reader_get(preader, &blockin);
+	batch_size_min = _fifo_reader_get(preader, greader, &blockin, preader->index_read);
 	if (batch_size_min == 0)
-		return 0;
+		return FIFO_PIPE_EMPTY;
+
+	/* Window full, ask for a wakeup, then make sure we did not miss one */
+	if ((ppipe->transfer_alloc - ppipe->transfer_free) >= ppipe->window) {
+		ppipe->window_waiting = 1;
+		mb();
+		if ((ppipe->transfer_alloc - ppipe->transfer_free) >= ppipe->window)
+			return FIFO_PIPE_WINDOW_FULL;
+	}
+	ppipe->window_waiting = 0;
+	rmb();
 
 	/* Update so we know how much free space there is */
-	fifo_writer_update_reader(pwriter);
-
-	/* 2 get maximum size free in writer */
-	batch_size_max = fifo_writer_get_free_contiguous(pwriter, batch_size_min);
-	if (batch_size_max < batch_size_min)
-		return 1;
+	_fifo_writer_update_reader(pwriter, gwriter);
 
 #ifdef USE_BATCHES
-	/* Limit the batch size when urgent */
-	if (fifo_writer_get_free_total(pwriter) >= MAX_FREE_SIZE_URGENT) {
-		if (batch_size_max > MAX_BATCH_SIZE_URGENT)
-			batch_size_max = MAX_BATCH_SIZE_URGENT;
-	}
+	/* Limit the batch size when urgent: the writer has almost no data left */
+	if (fifo_writer_get_free_total(pwriter) + ppipe->batch_size_urgent >= pwriter->datasize)
+		total_size_max = ppipe->batch_size_urgent;
+#endif
 
-	/* Limit the batch size to prevent batches from taking too long */
-	if (batch_size_max > MAX_BATCH_SIZE)
-		batch_size_max = MAX_BATCH_SIZE;
+	ptransfer = &ppipe->ptransfer_pool[ppipe->transfer_alloc & ppipe->transfer_mask];
+	ptransfer->ppipe = ppipe;
+	ptransfer->size = 0;
+	ptransfer->segment_count = 0;
 
-	/* Not smaller than the minimum batch size */
-	if (batch_size_max < batch_size_min)
-		batch_size_max = batch_size_min;
+	while (1) {
+		/* 2 get maximum size free in writer */
+		batch_size_max = _fifo_writer_get_free_contiguous(pwriter, gwriter, batch_size_min);
+		if (batch_size_max < batch_size_min)
+			break;
 
-	/* 3 get maximum number of continuous blocks */
-	blockin  = fifo_reader_get_batch(preader, &batch_count, &batch_size, batch_size_max);
+#ifdef USE_BATCHES
+		/* Limit the batch size to prevent batches from taking too long */
+		if (ptransfer->size + batch_size_min > total_size_max) {
+			/* Not smaller than the minimum batch size, but only for the first segment */
+			if (ptransfer->segment_count != 0)
+				break;
+			batch_size_max = batch_size_min;
+		}
+		else if (batch_size_max > total_size_max - ptransfer->size) {
+			batch_size_max = total_size_max - ptransfer->size;
+		}
+
+		/* 3 get maximum number of continuous blocks, that the writer has BDs for */
+		blockin  = _fifo_reader_get_batch(preader, greader, &batch_count, &batch_size, batch_size_max, _fifo_writer_get_free_bd(pwriter, gwriter, gwriter.bd_mask + 1));
 #else
-	batch_size = batch_size_min;
-	batch_count = 1;
+		batch_size = batch_size_min;
+		batch_count = 1;
 #endif
-	/* Get write pointer */
-	blockout = fifo_writer_get_pointer(pwriter);
+		/* Get write pointer */
+		blockout = fifo_writer_get_pointer(pwriter);
 
-	struct fifo_pipe_transfer *ptransfer = (struct fifo_pipe_transfer *)malloc(sizeof(struct fifo_pipe_transfer));
-	ptransfer->ppipe = ppipe;
-	ptransfer->dst = blockout;
-	ptransfer->src = blockin;
-	ptransfer->size = batch_size;
-	ptransfer->batch_count = batch_count;
+		psegment = &ptransfer->segment[ptransfer->segment_count++];
+		psegment->dst = blockout;
+		psegment->src = blockin;
+		psegment->size = batch_size;
+		psegment->batch_count = batch_count;
+		ptransfer->size += batch_size;
+
+		/* Claim the packets in both fifo's */
+		_fifo_writer_claim(pwriter, gwriter, batch_count, batch_size);
+		_fifo_reader_claim(preader, greader, batch_count, batch_size);
 
-	/* Claim the packets in both fifo's */
-	fifo_writer_claim(pwriter, batch_count, batch_size);
-	fifo_reader_claim(preader, batch_count, batch_size);
+#ifndef USE_BATCHES
+		break;
+#endif
+		/* 4 next segment */
+		if (ptransfer->segment_count == FIFO_PIPE_MAX_SEGMENTS)
+			break;
+		batch_size_min = _fifo_reader_get(preader, greader, &blockin, preader->index_read);
+		if ((batch_size_min == 0) || (_fifo_writer_get_free_bd(pwriter, gwriter, 1) == 0))
+			break;
+	}
 
-	/* Transter the data, possibly async */
+	if (ptransfer->segment_count == 0)
+		return FIFO_PIPE_DST_FULL;
+
+	/* Transter the data, possibly async: it may be done and reused when fp_transfer returns */
+	ppipe->submitted_size = ptransfer->size;
+	ppipe->transfer_alloc++;
 	ppipe->fp_transfer(ptransfer);
 
-	return batch_size;
+	return FIFO_PIPE_SUBMITTED;
+}
+
+/** @brief Transfer as much data as possible from the reader to the writer
+ *
+ *  The pipe will stop when either the reader is empty, or the writer is full
+ *
+ *  All data goes into one transfer, with a segment for every part that is
+ *  continuous in both fifos. So wrapping around the end of either fifo does
+ *  not need another transfer.
+ *
+ *  @param ppipe the fifo_pipe object
+ *  @return FIFO_PIPE_SUBMITTED when a transfer is started, otherwise the
+ *          reason why not (see fifo_pipe_status)
+ */
+static inline enum fifo_pipe_status fifo_pipe_transfer(struct fifo_pipe *ppipe)
+{
+	return _fifo_pipe_transfer(ppipe, ppipe->preader->pfifo->geometry, ppipe->pwriter->pfifo->geometry);
+}
+
+/**
+ * @brief Get the bytes of the reader in the transfer the last fifo_pipe_transfer started
+ *
+ * @return the size, 0 when the last fifo_pipe_transfer did not return FIFO_PIPE_SUBMITTED
+ */
+static inline unsigned int fifo_pipe_get_submitted_size(struct fifo_pipe *ppipe)
+{
+	return ppipe->submitted_size;
+}
+
+/**
+ * @brief Tell both fifos the pipe is going to sleep (or is awake again)
+ *
+ * While waiting, the writer of the input fifo and the reader of the output
+ * fifo will call their wakeup handler. After setting the waiting flags, call
+ * fifo_pipe_transfer once more before going to sleep, to make sure no data or
+ * free space arrived before the flags were visible.
+ */
+static inline void fifo_pipe_set_waiting(struct fifo_pipe *ppipe, unsigned int waiting)
+{
+	volatile uint32_t *preader_status = ppipe->preader->pfifo->preader_status;
+	volatile uint32_t *pwriter_status = ppipe->pwriter->pfifo->pwriter_status;
+
+	if (waiting) {
+		*preader_status |= RD_STS_WAITING;
+		*pwriter_status |= WR_STS_WAITING;
+		mb();
+	}
+	else {
+		*preader_status &= ~RD_STS_WAITING;
+		*pwriter_status &= ~WR_STS_WAITING;
+	}
 }
 
 /**
  * @brief Initialize the fifo_pipe struct
+ *
+ * The fifos can use different BD sizes. But every block from the reader must
+ * fit in a BD of the writer (fifo_writer_get_block_max_size).
+ *
+ * @return 0 on success, -1 when the transfer pool can not be allocated
  */
-static inline void fifo_pipe_init(struct fifo_pipe *ppipe, struct fifo_reader *preader, struct fifo_writer *pwriter)
+static inline int fifo_pipe_init(struct fifo_pipe *ppipe, struct fifo_reader *preader, struct fifo_writer *pwriter)
 {
 	ppipe->preader = preader;
 	ppipe->pwriter = pwriter;
 
 	ppipe->fp_transfer = fifo_pipe_transfer_default;
+
+	/* There can never be more transfers than BDs in the writer */
+	ppipe->ptransfer_pool = (struct fifo_pipe_transfer *)malloc(sizeof(struct fifo_pipe_transfer) * pwriter->pbdr->count);
+	ppipe->transfer_mask = pwriter->pbdr->count - 1;
+	ppipe->transfer_alloc = 0;
+	ppipe->transfer_free = 0;
+
+	ppipe->window = pwriter->pbdr->count;
+	ppipe->window_waiting = 0;
+
+	ppipe->batch_size_max = MAX_BATCH_SIZE;
+	ppipe->batch_size_urgent = MAX_BATCH_SIZE_URGENT;
+	ppipe->submitted_size = 0;
+
+	ppipe->mode = FIFO_PIPE_COPY;
+	ppipe->handoff_index = 0;
+	ppipe->handoff_count = 0;
+
+	ppipe->wakeup_handler = NULL;
+	ppipe->wakeup_handler_arg = NULL;
+
+	return (ppipe->ptransfer_pool != NULL) ? 0 : -1;
+}
+
+/**
+ * @brief Limit the number of transfers in flight
+ *
+ * @param window max number of transfers, 0 for no limit (one per BD of the writer)
+ */
+static inline void fifo_pipe_set_window(struct fifo_pipe *ppipe, unsigned int window)
+{
+	if ((window == 0) || (window > ppipe->transfer_mask + 1))
+		window = ppipe->transfer_mask + 1;
+
+	ppipe->window = window;
+}
+
+/**
+ * @brief Limit the size of the transfers
+ *
+ * @param batch_size_max max size of a transfer (default MAX_BATCH_SIZE)
+ * @param batch_size_urgent max size while the writer is almost empty (default MAX_BATCH_SIZE_URGENT)
+ *
+ * NOTE: A single block bigger than the max is still transferred on its own
+ */
+static inline void fifo_pipe_set_batch_size(struct fifo_pipe *ppipe, unsigned int batch_size_max, unsigned int batch_size_urgent)
+{
+	ppipe->batch_size_max = batch_size_max;
+	ppipe->batch_size_urgent = batch_size_urgent;
+}
+
+/**
+ * @brief Pass descriptors instead of copying the data (handoff)
+ *
+ * In a handoff mode the writer gets a descriptor (struct fifo_block) of every
+ * block, that refers to the data in the reader. The data is not copied, and
+ * its block in the reader is freed only when the reader of the writer frees
+ * the descriptor. Read the data with fifo_reader_get_handoff.
+ *
+ * In a pipeline of fifos, the first pipe uses FIFO_PIPE_HANDOFF and the next
+ * ones FIFO_PIPE_HANDOFF_FORWARD. Every pipe then costs the same per block,
+ * whatever the size of the data. The data is given back to the first fifo
+ * when the last reader is done with it.
+ *
+ * NOTE: Only for fifos in the same address space, the descriptors are pointers
+ * NOTE: The writer can not be a broadcast fifo, its readers do not free the BDs
+ * NOTE: Only change the mode before the first transfer
+ */
+static inline void fifo_pipe_set_mode(struct fifo_pipe *ppipe, enum fifo_pipe_mode mode)
+{
+	ppipe->mode = mode;
+}
+
+/**
+ * @brief Set a wakeup handler to be called when a transfer completes, while the window is full
+ */
+static inline void fifo_pipe_set_wakeup_handler(struct fifo_pipe *ppipe, fifo_wakeup_handler wakeup_handler, void *wakeup_handler_arg)
+{
+	ppipe->wakeup_handler = wakeup_handler;
+	ppipe->wakeup_handler_arg = wakeup_handler_arg;
+}
+
+/**
+ * @brief Free the resources of the fifo_pipe struct
+ *
+ * NOTE: All transfers must be completed
+ */
+static inline void fifo_pipe_deinit(struct fifo_pipe *ppipe)
+{
+	free(ppipe->ptransfer_pool);
+	ppipe->ptransfer_pool = NULL;
 }
 
 #ifdef __cplusplus
@@ -6,6 +6,8 @@
  * @brief Read data from a fifo.
  */
 
+#include <string.h> // memcpy
+
 #include "linux_port.h"
 #include "bdring.h"
 #include "fifo.h"
@@ -26,16 +28,23 @@ struct fifo_reader
 
 	fifo_wakeup_handler wakeup_handler;
 	void		*wakeup_handler_arg;
+
+	unsigned int	wait_spin;     // adaptive spin count, see fifo_wait.h
+
+	volatile struct fifo_cursor *pcursor; // NULL when the writer scans the bdring
+	uint32_t	cursor_seq;    // number of blocks freed
+
+	unsigned int	lossy;         // broadcast only, see fifo_reader_sync
 };
 
-/**
- * @brief Initialize the fifo_reader struct
+/*
+ * Private function
  */
-static inline void fifo_reader_init(struct fifo_reader *preader, struct fifo *pfifo)
+static inline void _fifo_reader_init(struct fifo_reader *preader, struct fifo *pfifo)
 {
 	preader->pfifo = pfifo;
 	preader->pdata = pfifo->pdata;
-	preader->datasize = pfifo->pheader->datasize;
+	preader->datasize = pfifo->datasize;
 
 	preader->pbdr = &pfifo->bdr;
 	preader->index_claimed = 0;
@@ -43,6 +52,63 @@ static inline void fifo_reader_init(struct fifo_reader *preader, struct fifo *pf
 
 	preader->wakeup_handler = NULL;
 	preader->wakeup_handler_arg = NULL;
+
+	preader->wait_spin = 0;
+
+	preader->pcursor = pfifo->pcursor;
+	preader->cursor_seq = 0;
+
+	preader->lossy = 0;
+}
+
+/**
+ * @brief Initialize the fifo_reader struct
+ *
+ * For a broadcast fifo, this is the lossless reader in slot 0.
+ */
+static inline void fifo_reader_init(struct fifo_reader *preader, struct fifo *pfifo)
+{
+	_fifo_reader_init(preader, pfifo);
+
+	if (pfifo->reader_count > 0)
+		pfifo->pslots[0].mode = FIFO_READER_LOSSLESS;
+}
+
+/**
+ * @brief Initialize the fifo_reader struct, as one of the readers of a broadcast fifo
+ *
+ * Every reader takes its own slot, from 0 to the number of readers - 1. All
+ * readers must be initialized before the writer starts.
+ *
+ * @param mode FIFO_READER_LOSSLESS, or FIFO_READER_LOSSY for a reader the writer never waits for
+ */
+static inline void fifo_reader_init_broadcast(struct fifo_reader *preader, struct fifo *pfifo, unsigned int slot, unsigned int mode)
+{
+	_fifo_reader_init(preader, pfifo);
+
+	preader->pcursor = &pfifo->pslots[slot].cursor;
+	preader->lossy = (mode == FIFO_READER_LOSSY) ? 1 : 0;
+
+	pfifo->pslots[slot].mode = mode;
+}
+
+/**
+ * @brief Stop reading a broadcast fifo, the writer no longer waits for this reader
+ */
+static inline void fifo_reader_detach(struct fifo_reader *preader)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < preader->pfifo->reader_count; slot++) {
+		if (&preader->pfifo->pslots[slot].cursor == preader->pcursor)
+			preader->pfifo->pslots[slot].mode = FIFO_READER_NONE;
+	}
+
+	/* A writer waiting for this reader can continue now */
+	if (preader->wakeup_handler != NULL) {
+		mb();
+		preader->wakeup_handler(preader->wakeup_handler_arg);
+	}
 }
 
 /**
@@ -54,50 +120,63 @@ static inline void fifo_reader_set_wakeup_handler(struct fifo_reader *preader, f
 	preader->wakeup_handler_arg = wakeup_handler_arg;
 }
 
-/**
- * @brief Try to get the most blocks, fitting into "batch_size_max"
+/*
+ * Private function: same as fifo_reader_get_batch, for a given geometry
  */
-static inline void * fifo_reader_get_batch(struct fifo_reader *preader, unsigned int *batch_count, unsigned int *batch_size, unsigned int batch_size_max)
+static inline void * _fifo_reader_get_batch(struct fifo_reader *preader, struct fifo_geometry g, unsigned int *batch_count, unsigned int *batch_size, unsigned int batch_size_max, unsigned int batch_count_max)
 {
 	unsigned int offset_first;
 	unsigned int temp_size;
+	unsigned int distance;
 	struct bdring *pbdr = preader->pbdr;
 	unsigned int index = preader->index_read;
-	struct fifo_bd bd;
+	unsigned int offset, size;
 
 	/* Get first BD */
-	if (bdring_bd_get(pbdr, index, &bd.data) == 0)
+	if ((batch_count_max == 0) || (_fifo_bd_get(pbdr, g, index, &offset, &size) == 0))
 		return NULL;
 
-	if (bd.size > batch_size_max)
+	if (size > batch_size_max)
 		return NULL; // too big
 
-	offset_first = bd.offset;
+	offset_first = offset;
 
 	*batch_count = 1;
-	*batch_size = bd.size;
+	*batch_size = size;
 
 	/* Find all continuous data */
-	index = bdring_next(pbdr, index);
-	while (bdring_bd_get(pbdr, index, &bd.data)) {
+	index = _fifo_bd_next(g, index);
+	while ((*batch_count < batch_count_max) && _fifo_bd_get(pbdr, g, index, &offset, &size)) {
 
-		if (bd.offset <= offset_first)
-			break; // not continuous
+		distance = offset - offset_first;
+		if (offset <= offset_first) {
+			if (!g.mirror)
+				break; // not continuous
+			distance += preader->datasize; // continues in the second mapping
+		}
 
-		temp_size = (bd.offset - offset_first) + bd.size;
+		temp_size = distance + size;
 		if (temp_size > batch_size_max)
 			break; // too big
 
 		(*batch_count)++;
 		*batch_size = temp_size;
 
-		index = bdring_next(pbdr, index);
+		index = _fifo_bd_next(g, index);
 
 	}
 
 	return (preader->pdata + offset_first);
 }
 
+/**
+ * @brief Try to get the most blocks, fitting into "batch_size_max" and "batch_count_max"
+ */
+static inline void * fifo_reader_get_batch(struct fifo_reader *preader, unsigned int *batch_count, unsigned int *batch_size, unsigned int batch_size_max, unsigned int batch_count_max)
+{
+	return _fifo_reader_get_batch(preader, preader->pfifo->geometry, batch_count, batch_size, batch_size_max, batch_count_max);
+}
+
 /**
  * @brief Clear the entire fifo
  */
@@ -117,7 +196,10 @@ static inline void fifo_reader_wakeup_writer(struct fifo_reader *preader, unsign
 	if (preader->wakeup_handler == NULL)
 		return;
 
-	if ((force) || (preader->pfifo->pheader->writer_status & WR_STS_WAITING))
+	/* Publish the freed BDs before checking if the writer went to sleep */
+	mb();
+
+	if ((force) || (*preader->pfifo->pwriter_status & WR_STS_WAITING))
 		preader->wakeup_handler(preader->wakeup_handler_arg);
 }
 
@@ -128,22 +210,22 @@ static inline void fifo_reader_wakeup_writer(struct fifo_reader *preader, unsign
  */
 static inline int fifo_reader_is_empty(struct fifo_reader *preader)
 {
-	return bdring_bd_is_used(preader->pbdr, preader->index_read) == 0;
+	return _fifo_bd_is_used(preader->pbdr, preader->pfifo->geometry, preader->index_read) == 0;
 }
 
 /*
  * Private function
  */
-static inline unsigned int _fifo_reader_get(struct fifo_reader *preader, void ** pdata, unsigned int index)
+static inline unsigned int _fifo_reader_get(struct fifo_reader *preader, struct fifo_geometry g, void ** pdata, unsigned int index)
 {
-	struct fifo_bd bd;
+	unsigned int offset, size;
 
-	bdring_bd_get(preader->pbdr, index, &bd.data);
+	_fifo_bd_get(preader->pbdr, g, index, &offset, &size);
 
 	if (pdata != NULL)
-		*pdata = (bd.size == 0) ? NULL : (preader->pdata + bd.offset);
+		*pdata = (size == 0) ? NULL : (preader->pdata + offset);
 
-	return bd.size;
+	return size;
 }
 
 /**
@@ -151,7 +233,7 @@ static inline unsigned int _fifo_reader_get(struct fifo_reader *preader, void **
  */
 static inline unsigned int fifo_reader_get_claim(struct fifo_reader *preader, void ** pdata)
 {
-	return _fifo_reader_get(preader, pdata, preader->index_claimed);
+	return _fifo_reader_get(preader, preader->pfifo->geometry, pdata, preader->index_claimed);
 }
 
 /**
@@ -159,35 +241,209 @@ static inline unsigned int fifo_reader_get_claim(struct fifo_reader *preader, vo
  */
 static inline unsigned int fifo_reader_get(struct fifo_reader *preader, void ** pdata)
 {
-	return _fifo_reader_get(preader, pdata, preader->index_read);
+	return _fifo_reader_get(preader, preader->pfifo->geometry, pdata, preader->index_read);
 }
 
-/**
- * @brief Free packets, so the writer can use them again
+/*
+ * Private function: same as fifo_reader_free, for a given geometry
  */
-static inline void fifo_reader_free(struct fifo_reader *preader)
+static inline void _fifo_reader_free(struct fifo_reader *preader, struct fifo_geometry g)
 {
-	// Free the data to the writer
-	bdring_bd_clear(preader->pbdr, preader->index_claimed);
+	unsigned int offset = 0, size = 0;
+
+	if (preader->pcursor != NULL)
+		_fifo_bd_get(preader->pbdr, g, preader->index_claimed, &offset, &size);
+
+	// Free the data to the writer, a broadcast fifo only has the cursor
+	if (!g.broadcast)
+		_fifo_bd_clear(preader->pbdr, g, preader->index_claimed);
+
+	if (preader->pcursor != NULL) {
+		// Publish our position, the data and the BD must be free before the writer sees it
+		preader->cursor_seq++;
+		release_mb();
+		preader->pcursor->offset = offset + size;
+		// The offset before the seq, the writers read them the other way around
+		wmb();
+		preader->pcursor->seq = preader->cursor_seq;
+	}
 
 	if (preader->index_claimed == preader->index_read) {
 		// Advance both indices
-		preader->index_claimed = bdring_next(preader->pbdr, preader->index_claimed);
+		preader->index_claimed = _fifo_bd_next(g, preader->index_claimed);
 		preader->index_read = preader->index_claimed;
 	}
 	else {
 		// Advance the read index only
-		preader->index_claimed = bdring_next(preader->pbdr, preader->index_claimed);
+		preader->index_claimed = _fifo_bd_next(g, preader->index_claimed);
 	}
 }
 
+/**
+ * @brief Free packets, so the writer can use them again
+ */
+static inline void fifo_reader_free(struct fifo_reader *preader)
+{
+	_fifo_reader_free(preader, preader->pfifo->geometry);
+}
+
+/*
+ * Private function: same as fifo_reader_get_blocks, for a given geometry
+ */
+static inline unsigned int _fifo_reader_get_blocks(struct fifo_reader *preader, struct fifo_geometry g, struct fifo_block *pblocks, unsigned int max_count)
+{
+	unsigned int index = preader->index_read;
+	unsigned int offset, size;
+	unsigned int count;
+
+	for (count = 0; count < max_count; count++) {
+		if (_fifo_bd_get(preader->pbdr, g, index, &offset, &size) == 0)
+			break;
+
+		pblocks[count].pdata = preader->pdata + offset;
+		pblocks[count].size  = size;
+
+		index = _fifo_bd_next(g, index);
+	}
+
+	return count;
+}
+
+/**
+ * @brief Get all blocks that are ready, up to max_count, without copying
+ *
+ * Like fifo_reader_get, for many blocks at once. The blocks are not claimed,
+ * claim them with fifo_reader_claim and free them with fifo_reader_free_blocks:
+ *   count = fifo_reader_get_blocks(preader, blocks, max_count);
+ *   fifo_reader_claim(preader, count, 0);
+ *   ... use the blocks ...
+ *   fifo_reader_free_blocks(preader, count);
+ *   fifo_reader_wakeup_writer(preader, 0);
+ *
+ * @return the number of blocks written into pblocks
+ */
+static inline unsigned int fifo_reader_get_blocks(struct fifo_reader *preader, struct fifo_block *pblocks, unsigned int max_count)
+{
+	return _fifo_reader_get_blocks(preader, preader->pfifo->geometry, pblocks, max_count);
+}
+
+/*
+ * Private function: same as fifo_reader_free_blocks, for a given geometry
+ */
+static inline void _fifo_reader_free_blocks(struct fifo_reader *preader, struct fifo_geometry g, unsigned int count)
+{
+	unsigned int offset = 0, size = 0;
+	unsigned int claimed;
+
+	if (count == 0)
+		return;
+
+	if (preader->pcursor != NULL)
+		_fifo_bd_get(preader->pbdr, g, (preader->index_claimed + count - 1) & g.bd_mask, &offset, &size);
+
+	// Free the data to the writer, a broadcast fifo only has the cursor
+	if (!g.broadcast)
+		_fifo_bd_clear_range(preader->pbdr, g, preader->index_claimed, count);
+
+	if (preader->pcursor != NULL) {
+		// Publish our position once, the data and the BDs must be free before the writer sees it
+		preader->cursor_seq += count;
+		release_mb();
+		preader->pcursor->offset = offset + size;
+		// The offset before the seq, the writers read them the other way around
+		wmb();
+		preader->pcursor->seq = preader->cursor_seq;
+	}
+
+	// Advance the read index too, when more blocks are freed than were claimed
+	claimed = (preader->index_read - preader->index_claimed) & g.bd_mask;
+	preader->index_claimed = (preader->index_claimed + count) & g.bd_mask;
+	if (count > claimed)
+		preader->index_read = preader->index_claimed;
+}
+
+/**
+ * @brief Free count blocks at once, so the writer can use them again
+ *
+ * Same as calling fifo_reader_free count times, but with one barrier and
+ * one cursor update.
+ */
+static inline void fifo_reader_free_blocks(struct fifo_reader *preader, unsigned int count)
+{
+	_fifo_reader_free_blocks(preader, preader->pfifo->geometry, count);
+}
+
+/**
+ * @brief Check a lossy reader of a broadcast fifo is still ahead of the writer
+ *
+ * The writer may overwrite the blocks of a lossy reader, while it reads them.
+ * Call this after using the claimed blocks, before freeing them. When blocks
+ * were lost, the data just read may be corrupt: the claimed blocks are
+ * dropped and the reader continues at the oldest block that is still valid.
+ *
+ * @return the number of blocks lost, 0 when everything read is valid
+ */
+static inline unsigned int fifo_reader_sync(struct fifo_reader *preader)
+{
+	uint32_t reclaim;
+	unsigned int lost;
+
+	if (preader->lossy == 0)
+		return 0;
+
+	/* Read the data before the reclaim seq, the writer updates it before the data */
+	rmb();
+	reclaim = *preader->pfifo->preclaim;
+
+	lost = reclaim - preader->cursor_seq;
+	if ((int32_t)lost <= 0)
+		return 0;
+
+	// Skip to the oldest valid block, the writer never waits for this cursor
+	preader->cursor_seq = reclaim;
+	preader->index_claimed = reclaim & preader->pfifo->geometry.bd_mask;
+	preader->index_read = preader->index_claimed;
+	preader->pcursor->seq = reclaim;
+
+	return lost;
+}
+
+/**
+ * @brief Get the data a handoff descriptor refers to
+ *
+ * A fifo written by a pipe in handoff mode (see fifo_pipe_set_mode) has a
+ * descriptor (struct fifo_block) in every block, instead of the data. The data
+ * stays in the first fifo of the pipeline, until the descriptor is freed.
+ *
+ * @param pdesc a block of the fifo, from fifo_reader_get or fifo_reader_get_blocks
+ * @param pdata returns the data the descriptor refers to
+ * @return the size of the data
+ */
+static inline unsigned int fifo_reader_get_handoff(const void *pdesc, void **pdata)
+{
+	struct fifo_block block;
+
+	memcpy(&block, pdesc, sizeof(block)); // block may only be 32bit aligned
+	*pdata = block.pdata;
+
+	return block.size;
+}
+
+/*
+ * Private function: same as fifo_reader_claim, for a given geometry
+ */
+static inline void _fifo_reader_claim(struct fifo_reader *preader, struct fifo_geometry g, unsigned int count, unsigned int size)
+{
+	while(count--)
+		preader->index_read = _fifo_bd_next(g, preader->index_read);
+}
+
 /**
  * @brief Claim a number of messages in the fifo, but do not free the data to the writer
  */
 static inline void fifo_reader_claim(struct fifo_reader *preader, unsigned int count, unsigned int size)
 {
-	while(count--)
-		preader->index_read = bdring_next(preader->pbdr, preader->index_read);
+	_fifo_reader_claim(preader, preader->pfifo->geometry, count, size);
 }
 
 #ifdef __cplusplus
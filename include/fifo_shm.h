@@ -0,0 +1,286 @@
+#ifndef __FIFO_SHM_H
+#define __FIFO_SHM_H
+
+/**
+ * @file fifo_shm.h
+ * @brief Fifo memory shared between processes, Linux only.
+ *
+ * One process creates the memory and the fifo in it:
+ *   fifo_shm_create(&shm, "/name", size);
+ *   fifo_init_create(&fifo, shm.pdata, shm.size, bd_count, align, flags);
+ *
+ * Other processes map the same memory, and connect to the fifo without
+ * copying anything:
+ *   fifo_shm_open(&shm, "/name");
+ *   fifo_init_connect(&fifo, shm.pdata);
+ *
+ * Without a name an anonymous memfd is created. It can only be shared by
+ * passing the file descriptor, or by fork.
+ *
+ * The mapping is page aligned, so the fifo header is at the start of it. The
+ * futexes of fifo_wait.h also work between processes.
+ *
+ * fifo_shm_create_flags can back the memory with hugepages, to save TLB
+ * entries on large fifos. Hugetlb pages need an anonymous memfd, a named
+ * fifo can only ask for transparent hugepages.
+ *
+ * fifo_shm_create_mirror maps the data ring of a FIFO_FLAG_MIRROR fifo a
+ * second time, right after the first. fifo_shm_open does the same, when the
+ * fifo it maps was created with FIFO_FLAG_MIRROR.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "linux_port.h"
+#include "fifo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Flags of fifo_shm_create_flags */
+#define FIFO_SHM_HUGE_2M	(1 << 0)	/* hugetlb pages of 2 MiB, anonymous memfd only */
+#define FIFO_SHM_HUGE_1G	(1 << 1)	/* hugetlb pages of 1 GiB, anonymous memfd only */
+#define FIFO_SHM_THP		(1 << 2)	/* advise transparent hugepages (shmem_enabled=advise) */
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB		0x0004U
+#endif
+#ifndef MFD_HUGE_SHIFT
+#define MFD_HUGE_SHIFT		26
+#endif
+
+struct fifo_shm
+{
+	void	*pdata;
+	size_t	size;
+	size_t	mirror;	/* size of the second mapping of the data ring, after size */
+	int	fd;
+};
+
+/*
+ * Private function
+ */
+static inline int _fifo_shm_map(struct fifo_shm *pshm, int fd, size_t size)
+{
+	void *pdata;
+
+	pdata = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pdata == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	pshm->pdata = pdata;
+	pshm->size = size;
+	pshm->mirror = 0;
+	pshm->fd = fd;
+
+	return 0;
+}
+
+/*
+ * Private function: map size bytes, and the data ring from data_offset again right after them
+ */
+static inline int _fifo_shm_map_mirror(struct fifo_shm *pshm, int fd, size_t size, size_t data_offset)
+{
+	size_t datasize = size - data_offset;
+	uint8_t *pbase;
+
+	/* Reserve the address space for both mappings, then map the memory over it */
+	pbase = (uint8_t *)mmap(NULL, size + datasize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pbase == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	if ((mmap(pbase, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+	    (mmap(pbase + size, datasize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, data_offset) == MAP_FAILED)) {
+		munmap(pbase, size + datasize);
+		close(fd);
+		return -1;
+	}
+
+	pshm->pdata = pbase;
+	pshm->size = size;
+	pshm->mirror = datasize;
+	pshm->fd = fd;
+
+	return 0;
+}
+
+/*
+ * Private function: open the memory, with a size
+ */
+static inline int _fifo_shm_create_fd(const char *name, size_t size, unsigned int memfd_flags)
+{
+	int fd;
+
+	if (name != NULL)
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	else
+		fd = syscall(SYS_memfd_create, "fifo", memfd_flags);
+	if (fd < 0)
+		return -1;
+
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		if (name != NULL)
+			shm_unlink(name);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Create shared memory for a fifo, with hugepages
+ *
+ * With hugetlb pages the size is rounded up to a whole number of pages,
+ * pshm->size is the rounded size. It fails (ENOMEM) when the pages are not
+ * reserved (vm.nr_hugepages).
+ *
+ * @param name shm_open name ("/something"), or NULL for an anonymous memfd
+ * @param flags FIFO_SHM_HUGE_2M, FIFO_SHM_HUGE_1G or FIFO_SHM_THP, or 0
+ * @return 0 on success, -1 on error (see errno)
+ */
+static inline int fifo_shm_create_flags(struct fifo_shm *pshm, const char *name, size_t size, unsigned int flags)
+{
+	unsigned int memfd_flags = 0;
+	size_t page;
+	int fd;
+
+	if (flags & (FIFO_SHM_HUGE_2M | FIFO_SHM_HUGE_1G)) {
+		if (name != NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+		page = (flags & FIFO_SHM_HUGE_1G) ? (1UL << 30) : (1UL << 21);
+		memfd_flags = MFD_HUGETLB | ((flags & FIFO_SHM_HUGE_1G) ? (30U << MFD_HUGE_SHIFT) : (21U << MFD_HUGE_SHIFT));
+		size = (size + page - 1) & ~(page - 1);
+	}
+
+	fd = _fifo_shm_create_fd(name, size, memfd_flags);
+	if (fd < 0)
+		return -1;
+
+	if (_fifo_shm_map(pshm, fd, size) != 0)
+		return -1;
+
+	// Only a hint, the kernel may not support it
+	if (flags & FIFO_SHM_THP)
+		madvise(pshm->pdata, size, MADV_HUGEPAGE);
+
+	return 0;
+}
+
+/**
+ * @brief Create shared memory for a fifo
+ *
+ * @param name shm_open name ("/something"), or NULL for an anonymous memfd
+ * @return 0 on success, -1 on error (see errno)
+ */
+static inline int fifo_shm_create(struct fifo_shm *pshm, const char *name, size_t size)
+{
+	return fifo_shm_create_flags(pshm, name, size, 0);
+}
+
+/**
+ * @brief Create shared memory for a fifo with FIFO_FLAG_MIRROR, its data ring mapped twice
+ *
+ * The memory is just big enough for the fifo, pshm->size can be smaller
+ * than fifosize. Create the fifo in it with the same bd_count, align and
+ * flags, before another process opens it.
+ *
+ * @param name shm_open name ("/something"), or NULL for an anonymous memfd
+ * @return 0 on success, -1 on error (see errno)
+ */
+static inline int fifo_shm_create_mirror(struct fifo_shm *pshm, const char *name, unsigned int fifosize, unsigned int bd_count, unsigned int align, unsigned int flags)
+{
+	unsigned int data_offset = fifo_data_offset(bd_count, align, flags);
+	unsigned int datasize = fifo_data_size(fifosize, bd_count, align, flags);
+	int fd;
+
+	if (((flags & FIFO_FLAG_MIRROR) == 0) || (datasize == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = _fifo_shm_create_fd(name, data_offset + datasize, 0);
+	if (fd < 0)
+		return -1;
+
+	return _fifo_shm_map_mirror(pshm, fd, data_offset + datasize, data_offset);
+}
+
+/**
+ * @brief Map shared memory created by fifo_shm_create
+ *
+ * A fifo with FIFO_FLAG_MIRROR is mapped with its data ring twice, it must be
+ * created (fifo_init_create) before it is opened.
+ *
+ * @return 0 on success, -1 on error (see errno)
+ */
+static inline int fifo_shm_open(struct fifo_shm *pshm, const char *name)
+{
+	volatile struct fifo_header *pheader;
+	unsigned int data_offset;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	if (_fifo_shm_map(pshm, fd, st.st_size) != 0)
+		return -1;
+
+	/* Map a mirrored fifo again, with the data ring twice */
+	pheader = (volatile struct fifo_header *)pshm->pdata;
+	if (pheader->flags & FIFO_FLAG_MIRROR) {
+		data_offset = fifo_data_offset(pheader->bd_count, pheader->align, pheader->flags);
+		munmap(pshm->pdata, pshm->size);
+		return _fifo_shm_map_mirror(pshm, fd, st.st_size, data_offset);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Unmap the shared memory
+ *
+ * The name stays, until it is removed with fifo_shm_unlink.
+ */
+static inline void fifo_shm_close(struct fifo_shm *pshm)
+{
+	munmap(pshm->pdata, pshm->size + pshm->mirror);
+	close(pshm->fd);
+
+	pshm->pdata = NULL;
+	pshm->size = 0;
+	pshm->mirror = 0;
+	pshm->fd = -1;
+}
+
+/**
+ * @brief Remove the name of the shared memory
+ */
+static inline int fifo_shm_unlink(const char *name)
+{
+	return shm_unlink(name);
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
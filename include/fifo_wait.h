@@ -0,0 +1,290 @@
+#ifndef __FIFO_WAIT_H
+#define __FIFO_WAIT_H
+
+/**
+ * @file fifo_wait.h
+ * @brief Blocking wait for data (reader) or free space (writer), Linux only.
+ *
+ * A wait first spins for a while, then sleeps on a futex:
+ * 1 - spin: check the condition for wait_spin iterations
+ * 2 - set RD_STS_WAITING / WR_STS_WAITING in the fifo status
+ * 3 - check the condition again, the other side may have missed the flag
+ * 4 - sleep on the status word (futex)
+ *
+ * The other side only needs to call fifo_writer_wakeup_reader or
+ * fifo_reader_wakeup_writer. To wake a sleeping reader or writer, set
+ * fifo_wait_wakeup_reader or fifo_wait_wakeup_writer as wakeup handler. These
+ * handlers only make a system call when the waiting flag is set.
+ *
+ * The spin count adapts: it doubles when spinning was enough, and halves when
+ * we had to sleep.
+ *
+ * Many producers of a fifo_mpsc can wait at the same time. They only set
+ * WR_STS_WAITING, the reader clears it and wakes all of them with
+ * fifo_wait_wakeup_writers. The same for the readers of a broadcast fifo and
+ * fifo_wait_wakeup_readers.
+ */
+
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "linux_port.h"
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_mpsc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIFO_WAIT_FOREVER	(~(uint64_t)0)
+
+#define FIFO_WAIT_SPIN_MIN	(16)
+#define FIFO_WAIT_SPIN_INIT	(1024)
+#define FIFO_WAIT_SPIN_MAX	(16*1024)
+
+/*
+ * Private function
+ *
+ * NOTE: Not FUTEX_PRIVATE_FLAG, so a fifo in shared memory also works
+ */
+static inline void _fifo_futex_wait(volatile uint32_t *paddr, uint32_t value, uint64_t timeout_ns)
+{
+	struct timespec ts;
+
+	if (timeout_ns == FIFO_WAIT_FOREVER) {
+		syscall(SYS_futex, (uint32_t *)paddr, FUTEX_WAIT, value, NULL, NULL, 0);
+	}
+	else {
+		ts.tv_sec  = timeout_ns / 1000000000ULL;
+		ts.tv_nsec = timeout_ns % 1000000000ULL;
+		syscall(SYS_futex, (uint32_t *)paddr, FUTEX_WAIT, value, &ts, NULL, 0);
+	}
+}
+
+/*
+ * Private function
+ */
+static inline void _fifo_futex_wake(volatile uint32_t *paddr, int count)
+{
+	syscall(SYS_futex, (uint32_t *)paddr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+/*
+ * Private function
+ */
+static inline uint64_t _fifo_wait_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/*
+ * Private function
+ */
+static inline int _fifo_reader_has_data(void *arg, unsigned int unused)
+{
+	(void)unused;
+
+	return fifo_reader_is_empty((struct fifo_reader *)arg) == 0;
+}
+
+/*
+ * Private function
+ */
+static inline int _fifo_writer_has_free(void *arg, unsigned int min_size)
+{
+	struct fifo_writer *pwriter = (struct fifo_writer *)arg;
+
+	fifo_writer_update_reader(pwriter);
+
+	return fifo_writer_get_free_contiguous(pwriter, min_size) >= min_size;
+}
+
+/*
+ * Private function
+ */
+static inline int _fifo_mpsc_has_free(void *arg, unsigned int min_size)
+{
+	return fifo_mpsc_has_free((struct fifo_mpsc *)arg, min_size);
+}
+
+/*
+ * Private function: the adaptive spin/sleep loop shared by reader and writer
+ *
+ * With shared set, many threads wait on the same flag. The flag is set
+ * atomically and only the thread waking them clears it.
+ */
+static inline int _fifo_wait(unsigned int *pspin, volatile uint32_t *pstatus, uint32_t flag, int shared,
+	int (*fp_ready)(void *arg, unsigned int param), void *arg, unsigned int param, uint64_t timeout_ns)
+{
+	uint64_t deadline = 0, now;
+	unsigned int spin;
+
+	if (*pspin == 0)
+		*pspin = FIFO_WAIT_SPIN_INIT;
+
+	/* 1 - spin */
+	for (spin = 0; spin < *pspin; spin++) {
+		if (fp_ready(arg, param)) {
+			if (*pspin < FIFO_WAIT_SPIN_MAX)
+				*pspin *= 2;
+			return 1;
+		}
+		cpu_relax();
+	}
+	if (*pspin > FIFO_WAIT_SPIN_MIN)
+		*pspin /= 2;
+
+	if (timeout_ns != FIFO_WAIT_FOREVER)
+		deadline = _fifo_wait_now() + timeout_ns;
+
+	while (1) {
+		/* 2 - tell the other side we are going to sleep */
+		if (shared) {
+			__atomic_fetch_or((uint32_t *)pstatus, flag, __ATOMIC_SEQ_CST);
+		}
+		else {
+			*pstatus |= flag;
+			mb();
+		}
+
+		/* 3 - check again, the other side could have missed the flag */
+		if (fp_ready(arg, param)) {
+			if (!shared)
+				*pstatus &= ~flag;
+			return 1;
+		}
+
+		/* 4 - sleep */
+		if (timeout_ns == FIFO_WAIT_FOREVER) {
+			_fifo_futex_wait(pstatus, flag, FIFO_WAIT_FOREVER);
+		}
+		else {
+			now = _fifo_wait_now();
+			if (now >= deadline) {
+				if (!shared)
+					*pstatus &= ~flag;
+				return 0;
+			}
+			_fifo_futex_wait(pstatus, flag, deadline - now);
+		}
+		if (!shared)
+			*pstatus &= ~flag;
+
+		if (fp_ready(arg, param))
+			return 1;
+	}
+}
+
+/**
+ * @brief Wait until there is data in the fifo
+ *
+ * @param timeout_ns maximum time to wait, or FIFO_WAIT_FOREVER
+ * @return 1 when there is data, 0 on timeout
+ */
+static inline int fifo_reader_wait(struct fifo_reader *preader, uint64_t timeout_ns)
+{
+	volatile uint32_t *pstatus = preader->pfifo->preader_status;
+
+	return _fifo_wait(&preader->wait_spin, pstatus, RD_STS_WAITING, preader->pfifo->reader_count > 0, _fifo_reader_has_data, preader, 0, timeout_ns);
+}
+
+/**
+ * @brief Wait until there is at least min_size of contiguous free space (and a free BD)
+ *
+ * @param timeout_ns maximum time to wait, or FIFO_WAIT_FOREVER
+ * @return 1 when there is free space, 0 on timeout
+ */
+static inline int fifo_writer_wait_free(struct fifo_writer *pwriter, unsigned int min_size, uint64_t timeout_ns)
+{
+	volatile uint32_t *pstatus = pwriter->pfifo->pwriter_status;
+
+	return _fifo_wait(&pwriter->wait_spin, pstatus, WR_STS_WAITING, 0, _fifo_writer_has_free, pwriter, min_size, timeout_ns);
+}
+
+/**
+ * @brief Wait until a block of min_size can be reserved in the fifo_mpsc
+ *
+ * Can be called by many producers at the same time, the reader must use
+ * fifo_wait_wakeup_writers as wakeup handler.
+ *
+ * @param pspin adaptive spin count of the calling producer, start with 0
+ * @param timeout_ns maximum time to wait, or FIFO_WAIT_FOREVER
+ * @return 1 when there is free space, 0 on timeout
+ */
+static inline int fifo_mpsc_wait_free(struct fifo_mpsc *pmpsc, unsigned int *pspin, unsigned int min_size, uint64_t timeout_ns)
+{
+	volatile uint32_t *pstatus = pmpsc->pfifo->pwriter_status;
+
+	return _fifo_wait(pspin, pstatus, WR_STS_WAITING, 1, _fifo_mpsc_has_free, pmpsc, min_size, timeout_ns);
+}
+
+/**
+ * @brief Wakeup handler for the fifo_writer, wakes a reader sleeping in fifo_reader_wait
+ *
+ * @param arg the struct fifo
+ */
+static inline void fifo_wait_wakeup_reader(void *arg)
+{
+	volatile uint32_t *pstatus = ((struct fifo *)arg)->preader_status;
+
+	if (*pstatus & RD_STS_WAITING)
+		_fifo_futex_wake(pstatus, 1);
+}
+
+/**
+ * @brief Wakeup handler for the fifo_writer, wakes all readers of a broadcast fifo sleeping in fifo_reader_wait
+ *
+ * @param arg the struct fifo
+ */
+static inline void fifo_wait_wakeup_readers(void *arg)
+{
+	volatile uint32_t *pstatus = ((struct fifo *)arg)->preader_status;
+
+	if (*pstatus & RD_STS_WAITING) {
+		__atomic_fetch_and((uint32_t *)pstatus, ~RD_STS_WAITING, __ATOMIC_SEQ_CST);
+		_fifo_futex_wake(pstatus, INT_MAX);
+	}
+}
+
+/**
+ * @brief Wakeup handler for the fifo_reader, wakes a writer sleeping in fifo_writer_wait_free
+ *
+ * @param arg the struct fifo
+ */
+static inline void fifo_wait_wakeup_writer(void *arg)
+{
+	volatile uint32_t *pstatus = ((struct fifo *)arg)->pwriter_status;
+
+	if (*pstatus & WR_STS_WAITING)
+		_fifo_futex_wake(pstatus, 1);
+}
+
+/**
+ * @brief Wakeup handler for the fifo_reader, wakes all producers sleeping in fifo_mpsc_wait_free
+ *
+ * @param arg the struct fifo
+ */
+static inline void fifo_wait_wakeup_writers(void *arg)
+{
+	volatile uint32_t *pstatus = ((struct fifo *)arg)->pwriter_status;
+
+	if (*pstatus & WR_STS_WAITING) {
+		__atomic_fetch_and((uint32_t *)pstatus, ~WR_STS_WAITING, __ATOMIC_SEQ_CST);
+		_fifo_futex_wake(pstatus, INT_MAX);
+	}
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
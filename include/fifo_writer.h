@@ -34,7 +34,9 @@ struct fifo_writer
 	unsigned int	bdring_last_reader_idx;
 	uint8_t		*plast_read;
 
-	unsigned int	align_bits;
+	unsigned int	wait_spin;     // adaptive spin count, see fifo_wait.h
+
+	volatile struct fifo_cursor *pcursor; // NULL when scanning the bdring for the reader
 };
 
 /**
@@ -44,7 +46,7 @@ static inline void fifo_writer_init(struct fifo_writer *pwriter, struct fifo *pf
 {
 	pwriter->pfifo = pfifo;
 	pwriter->pdata = pfifo->pdata;
-	pwriter->datasize = pfifo->pheader->datasize;
+	pwriter->datasize = pfifo->datasize;
 
 	pwriter->pbdr = &pfifo->bdr;
 	pwriter->index_claimed = 0;
@@ -60,7 +62,11 @@ static inline void fifo_writer_init(struct fifo_writer *pwriter, struct fifo *pf
 	pwriter->bdring_last_reader_idx = 0;
 	pwriter->plast_read = pwriter->pdata - 1;
 
-	pwriter->align_bits = pfifo->pheader->align-1;
+	pwriter->wait_spin = 0;
+
+	pwriter->pcursor = pfifo->pcursor;
+	if (pwriter->pcursor != NULL)
+		pwriter->plast_read = pwriter->pdata;
 }
 
 /**
@@ -75,58 +81,212 @@ static inline void fifo_writer_set_wakeup_handler(struct fifo_writer *pwriter, f
 /*
  * Private function
  */
-static inline unsigned int _fifo_writer_align_up(struct fifo_writer *pwriter, unsigned int size)
+static inline unsigned int _fifo_writer_align_up(struct fifo_geometry g, unsigned int size)
 {
-	return ((size + pwriter->align_bits) & ~pwriter->align_bits);
+	return ((size + g.align_bits) & ~g.align_bits);
 }
 
 /*
- * Private function
+ * Private function: returns the index_claimed the bdring was scanned up to
+ *
+ * A fifo_pipe may commit from another thread (DMA completion) while this one
+ * scans, so index_claimed is read once. The BDs up to it are committed.
  */
-static inline void _fifo_writer_get_reader(struct fifo_writer *pwriter, unsigned int *poffset, unsigned int *psize)
+static inline unsigned int _fifo_writer_get_reader(struct fifo_writer *pwriter, struct fifo_geometry g, unsigned int *poffset, unsigned int *psize)
 {
-	struct fifo_bd bd;
 	unsigned int *plast_reader_idx = &pwriter->bdring_last_reader_idx;
+	unsigned int claimed = *(volatile unsigned int *)&pwriter->index_claimed;
 	unsigned int idx;
 
+	/* Read the index before the BDs it covers */
+	rmb();
+
 	/* Try to find where the reader is */
-	for (idx = *plast_reader_idx; idx != pwriter->index_claimed; idx = bdring_next(pwriter->pbdr, idx)) {
-		if (bdring_bd_get(pwriter->pbdr, idx, &bd.data)) {
+	for (idx = *plast_reader_idx; idx != claimed; idx = _fifo_bd_next(g, idx)) {
+		if (_fifo_bd_get(pwriter->pbdr, g, idx, poffset, psize)) {
 			*plast_reader_idx = idx;
-			*poffset = bd.offset;
-			*psize   = bd.size;
-			return;
+			return claimed;
 		}
 	}
 
 	/* Reader is at the same location as the writer, so we are full, or empty */
-	*plast_reader_idx = pwriter->index_claimed;
-	if (bdring_bd_get(pwriter->pbdr, pwriter->index_claimed, &bd.data)) {
+	*plast_reader_idx = claimed;
+	if (_fifo_bd_get(pwriter->pbdr, g, claimed, poffset, psize)) {
 		/* full */
-		*poffset = bd.offset;
-		*psize   = bd.size;
-		return;
+		return claimed;
 	}
 	else {
 		/* empty */
 		*poffset = 0;
 		*psize   = 0;
+		return claimed;
+	}
+}
+
+/*
+ * Private function: update the free space of a mirrored fifo, from the start of the oldest block in use
+ *
+ * All free space is contiguous, from the writer up to the reader. When they
+ * are at the same position the fifo is full, the caller checked it is not empty.
+ */
+static inline void _fifo_writer_update_mirror(struct fifo_writer *pwriter, uint8_t *plast_read)
+{
+	unsigned int used;
+
+	pwriter->plast_read = plast_read;
+
+	used = (pwriter->pwrite >= plast_read) ? (pwriter->pwrite - plast_read) : (pwriter->datasize - (plast_read - pwriter->pwrite));
+	pwriter->freesize = (used == 0) ? 0 : (pwriter->datasize - used);
+	pwriter->freesize_next = 0;
+}
+
+/*
+ * Private function: update the free space from a reader cursor (seq and offset)
+ *
+ * The reader has freed everything up to the cursor offset, so this is the
+ * start of the oldest block still in use. Except when we wrapped to the
+ * beginning right there, then it is a conservative guess.
+ *
+ * An old cursor is always safe to use, it only results in less free space.
+ */
+static inline void _fifo_writer_update_reader_pos(struct fifo_writer *pwriter, struct fifo_geometry g, uint32_t seq, unsigned int offset)
+{
+	/* Read once, a fifo_pipe may commit from another thread */
+	unsigned int claimed = *(volatile unsigned int *)&pwriter->index_claimed;
+
+	offset = _fifo_writer_align_up(g, offset);
+
+	pwriter->bdring_last_reader_idx = seq & g.bd_mask;
+
+	if ((pwriter->bdring_last_reader_idx == claimed) && (claimed == pwriter->index_write)) {
+		/* Empty, keep writing where we are, the reader will continue there */
+		pwriter->plast_read = pwriter->pwrite;
+		pwriter->freesize = pwriter->datasize - ((g.mirror) ? 0 : (pwriter->pwrite - pwriter->pdata));
+		pwriter->freesize_next = (g.mirror) ? 0 : (pwriter->pwrite - pwriter->pdata);
+		return;
+	}
+
+	if (g.mirror) {
+		/* The block freed last may end in the second mapping */
+		if (offset >= pwriter->datasize)
+			offset -= pwriter->datasize;
+		_fifo_writer_update_mirror(pwriter, pwriter->pdata + offset);
 		return;
 	}
+
+	pwriter->plast_read = pwriter->pdata + offset;
+	if (pwriter->plast_read >= pwriter->pwrite) {
+		/* The writer wrapped, the reader did not */
+		pwriter->freesize = pwriter->plast_read - pwriter->pwrite;
+		pwriter->freesize_next = 0;
+	}
+	else {
+		pwriter->freesize = pwriter->datasize - (pwriter->pwrite - pwriter->pdata);
+		pwriter->freesize_next = offset;
+	}
 }
 
-/**
- * @brief Update where the reader is
+/*
+ * Private function
  *
- * The writer needs to know where the reader is so we know how much free space
- * there is in the fifo.
+ * Same as fifo_writer_update_reader, but in constant time using the cursor the
+ * reader publishes.
  */
-static inline void fifo_writer_update_reader(struct fifo_writer *pwriter)
+static inline void _fifo_writer_update_reader_cursor(struct fifo_writer *pwriter, struct fifo_geometry g)
+{
+	volatile struct fifo_cursor *pcursor = pwriter->pcursor;
+	unsigned int offset;
+	uint32_t seq;
+
+	/* The reader writes the offset before the seq, so read them the other way around */
+	seq    = pcursor->seq;
+	rmb();
+	offset = pcursor->offset;
+
+	/* Read the cursor before writing into the space it frees */
+	rmb();
+
+	_fifo_writer_update_reader_pos(pwriter, g, seq, offset);
+}
+
+/*
+ * Private function
+ *
+ * Same as _fifo_writer_update_reader_cursor, for the slowest lossless reader
+ * of a broadcast fifo. The seq of that reader is published as reclaim seq,
+ * before any of the space it frees is written.
+ */
+static inline void _fifo_writer_update_reader_broadcast(struct fifo_writer *pwriter, struct fifo_geometry g)
 {
-	unsigned int offset, size;
+	volatile struct fifo_broadcast_slot *pslot;
+	unsigned int idx;
+	unsigned int used, used_max = 0;
+	unsigned int offset, slow_offset = 0;
+	uint32_t seq, slow_seq = 0;
+	int found = 0;
+
+	for (idx = 0; idx < pwriter->pfifo->reader_count; idx++) {
+		pslot = &pwriter->pfifo->pslots[idx];
+		if (pslot->mode != FIFO_READER_LOSSLESS)
+			continue;
+
+		/* Same order as _fifo_writer_update_reader_cursor */
+		seq    = pslot->cursor.seq;
+		rmb();
+		offset = pslot->cursor.offset;
+
+		/* The reader furthest behind the writer */
+		used = (pwriter->index_claimed - seq) & g.bd_mask;
+		if ((found == 0) || (used > used_max)) {
+			used_max = used;
+			slow_offset = offset;
+			slow_seq = seq;
+			found = 1;
+		}
+	}
+
+	/* Read the cursors before writing into the space they free */
+	rmb();
+
+	/*
+	 * No lossless reader (left): the lossy readers never block the writer,
+	 * reclaim everything up to our own position. One BD is always free, so
+	 * the distance from the last reclaim seq is not ambiguous.
+	 */
+	if (found == 0) {
+		slow_seq = *pwriter->pfifo->preclaim;
+		slow_seq += (pwriter->index_claimed - slow_seq) & g.bd_mask;
+		slow_offset = pwriter->pwrite - pwriter->pdata;
+	}
+
+	*pwriter->pfifo->preclaim = slow_seq;
+	wmb();
 
-	_fifo_writer_get_reader(pwriter, &offset, &size);
-	if (size != 0) {
+	_fifo_writer_update_reader_pos(pwriter, g, slow_seq, slow_offset);
+}
+
+/*
+ * Private function: same as fifo_writer_update_reader, for a given geometry
+ */
+static inline void _fifo_writer_update_reader(struct fifo_writer *pwriter, struct fifo_geometry g)
+{
+	unsigned int offset, size, claimed;
+
+	if (g.broadcast) {
+		_fifo_writer_update_reader_broadcast(pwriter, g);
+		return;
+	}
+
+	if (pwriter->pcursor != NULL) {
+		_fifo_writer_update_reader_cursor(pwriter, g);
+		return;
+	}
+
+	claimed = _fifo_writer_get_reader(pwriter, g, &offset, &size);
+	if ((size != 0) && (g.mirror)) {
+		_fifo_writer_update_mirror(pwriter, pwriter->pdata + offset);
+	}
+	else if (size != 0) {
 		/* Update position */
 		pwriter->plast_read = pwriter->pdata + offset;
 
@@ -143,7 +303,7 @@ static inline void fifo_writer_update_reader(struct fifo_writer *pwriter)
 			pwriter->freesize_next = pwriter->plast_read - pwriter->pdata;
 		}
 	}
-	else if (pwriter->index_claimed == pwriter->index_write) {
+	else if (claimed == pwriter->index_write) {
 		/* Empty, reset */
 		pwriter->freesize = pwriter->datasize;
 		pwriter->freesize_next = 0;
@@ -158,6 +318,20 @@ static inline void fifo_writer_update_reader(struct fifo_writer *pwriter)
 	}
 }
 
+/**
+ * @brief Update where the reader is
+ *
+ * The writer needs to know where the reader is so we know how much free space
+ * there is in the fifo.
+ *
+ * With FIFO_FLAG_READER_CURSOR this takes constant time, otherwise the bdring
+ * is scanned from the last known reader position.
+ */
+static inline void fifo_writer_update_reader(struct fifo_writer *pwriter)
+{
+	_fifo_writer_update_reader(pwriter, pwriter->pfifo->geometry);
+}
+
 /**
  * @brief Wakeup a reader that is waiting for data
  *
@@ -169,7 +343,10 @@ static inline void fifo_writer_wakeup_reader(struct fifo_writer *pwriter, unsign
 	if (pwriter->wakeup_handler == NULL)
 		return;
 
-	if ((force) || (pwriter->pfifo->pheader->reader_status & RD_STS_WAITING))
+	/* Publish the BDs before checking if the reader went to sleep */
+	mb();
+
+	if ((force) || (*pwriter->pfifo->preader_status & RD_STS_WAITING))
 		pwriter->wakeup_handler(pwriter->wakeup_handler_arg);
 }
 
@@ -181,14 +358,51 @@ static inline void * fifo_writer_get_pointer(struct fifo_writer *pwriter)
 	return pwriter->pwrite;
 }
 
+/*
+ * Private function: same as fifo_writer_get_free_bd, for a given geometry
+ */
+static inline unsigned int _fifo_writer_get_free_bd(struct fifo_writer *pwriter, struct fifo_geometry g, unsigned int max_count)
+{
+	unsigned int used = (pwriter->index_write - pwriter->bdring_last_reader_idx) & g.bd_mask;
+	unsigned int free = g.bd_mask - used;
+
+	return (free < max_count) ? free : max_count;
+}
+
 /**
- * @brief Get free space (single block) of at least min_size
+ * @brief Get the number of free buffer descriptors, up to max_count
+ *
+ * Every block written needs a buffer descriptor. With small blocks the
+ * bdring can be full while there is still free space in the data ring.
+ *
+ * One BD is always kept free. Otherwise a bdring that is completely full
+ * can not be told apart from an empty one by fifo_writer_update_reader.
  *
  * NOTE: Update the reader with fifo_writer_update_reader before calling
  */
-static inline unsigned int fifo_writer_get_free_contiguous(struct fifo_writer *pwriter, unsigned int min_size)
+static inline unsigned int fifo_writer_get_free_bd(struct fifo_writer *pwriter, unsigned int max_count)
+{
+	return _fifo_writer_get_free_bd(pwriter, pwriter->pfifo->geometry, max_count);
+}
+
+/**
+ * @brief Get the biggest block that can be committed (see fifo_block_max_size)
+ */
+static inline unsigned int fifo_writer_get_block_max_size(struct fifo_writer *pwriter)
+{
+	return pwriter->pfifo->geometry.block_max_size;
+}
+
+/*
+ * Private function: same as fifo_writer_get_free_contiguous, for a given geometry
+ */
+static inline unsigned int _fifo_writer_get_free_contiguous(struct fifo_writer *pwriter, struct fifo_geometry g, unsigned int min_size)
 {
-	unsigned int aligned_size = _fifo_writer_align_up(pwriter, min_size);
+	unsigned int aligned_size = _fifo_writer_align_up(g, min_size);
+
+	/* A block can only be written if there is a BD for it */
+	if (_fifo_writer_get_free_bd(pwriter, g, 1) == 0)
+		return 0;
 
 	/* Try to get at least min_size of free space */
 	if (pwriter->freesize < aligned_size) {
@@ -204,6 +418,18 @@ static inline unsigned int fifo_writer_get_free_contiguous(struct fifo_writer *p
 	return pwriter->freesize;
 }
 
+/**
+ * @brief Get free space (single block) of at least min_size
+ *
+ * Returns 0 when there is no free buffer descriptor for the block.
+ *
+ * NOTE: Update the reader with fifo_writer_update_reader before calling
+ */
+static inline unsigned int fifo_writer_get_free_contiguous(struct fifo_writer *pwriter, unsigned int min_size)
+{
+	return _fifo_writer_get_free_contiguous(pwriter, pwriter->pfifo->geometry, min_size);
+}
+
 /**
  * @brief Get total free space
  *
@@ -215,52 +441,169 @@ static inline unsigned int fifo_writer_get_free_total(struct fifo_writer *pwrite
 	return (pwriter->freesize + pwriter->freesize_next);
 }
 
-/**
- * @brief Commit the data into the fifo for the reader to pickup
+/*
+ * Private function: same as fifo_writer_commit, for a given geometry
  */
-static inline unsigned int fifo_writer_commit(struct fifo_writer *pwriter, void *pdata, unsigned int size)
+static inline unsigned int _fifo_writer_commit(struct fifo_writer *pwriter, struct fifo_geometry g, void *pdata, unsigned int size)
 {
-	struct fifo_bd bd;
-
 	/* Validate block size */
-	if (size > FIFO_BLOCK_MAX_SIZE)
+	if (size > g.block_max_size)
 		return 0;
 
 	/* Validate pointer */
 	if ((uint8_t *)pdata < pwriter->pdata)
 		return 0;
 
-	bd.offset = (uint8_t *)pdata - pwriter->pdata;
-	bd.size   = size;
+	// The readers of a broadcast fifo stop at the next BD, it may be from the previous lap
+	if (g.broadcast)
+		_fifo_bd_clear_nobarrier(pwriter->pbdr, g, _fifo_bd_next(g, pwriter->index_claimed));
 
 	// Commit the data to the reader
-	bdring_bd_put(pwriter->pbdr, pwriter->index_claimed, bd.data);
+	_fifo_bd_put(pwriter->pbdr, g, pwriter->index_claimed, _fifo_data_offset(g, pwriter->pdata, pwriter->datasize, pdata), size);
+
+	// Publish the BD before the index, the scan for the reader may run in another thread
+	wmb();
 
 	if (pwriter->index_claimed == pwriter->index_write) {
 		// Advance both indices
-		pwriter->index_claimed = bdring_next(pwriter->pbdr, pwriter->index_claimed);
+		pwriter->index_claimed = _fifo_bd_next(g, pwriter->index_claimed);
 		pwriter->index_write = pwriter->index_claimed;
 	}
 	else {
 		// Advance the read index only
-		pwriter->index_claimed = bdring_next(pwriter->pbdr, pwriter->index_claimed);
+		pwriter->index_claimed = _fifo_bd_next(g, pwriter->index_claimed);
 	}
 
 	return size;
 }
 
 /**
- * @brief Advance the write pointer, but do not commit the data to the reader
+ * @brief Commit the data into the fifo for the reader to pickup
  */
-static inline void fifo_writer_claim(struct fifo_writer *pwriter, unsigned int count, unsigned int size)
+static inline unsigned int fifo_writer_commit(struct fifo_writer *pwriter, void *pdata, unsigned int size)
 {
-	unsigned int aligned_size = _fifo_writer_align_up(pwriter, size);
+	return _fifo_writer_commit(pwriter, pwriter->pfifo->geometry, pdata, size);
+}
+
+/*
+ * Private function: same as fifo_writer_claim, for a given geometry
+ */
+static inline void _fifo_writer_claim(struct fifo_writer *pwriter, struct fifo_geometry g, unsigned int count, unsigned int size)
+{
+	unsigned int aligned_size = _fifo_writer_align_up(g, size);
 
 	pwriter->freesize -= aligned_size;
 	pwriter->pwrite   += aligned_size;
 
+	/* The block ran into the second mapping, continue in the first */
+	if ((g.mirror) && (pwriter->pwrite >= pwriter->pdata + pwriter->datasize))
+		pwriter->pwrite -= pwriter->datasize;
+
 	while(count--)
-		pwriter->index_write = bdring_next(pwriter->pbdr, pwriter->index_write);
+		pwriter->index_write = _fifo_bd_next(g, pwriter->index_write);
+}
+
+/**
+ * @brief Advance the write pointer, but do not commit the data to the reader
+ */
+static inline void fifo_writer_claim(struct fifo_writer *pwriter, unsigned int count, unsigned int size)
+{
+	_fifo_writer_claim(pwriter, pwriter->pfifo->geometry, count, size);
+}
+
+/*
+ * Private function: same as fifo_writer_reserve, for a given geometry
+ */
+static inline unsigned int _fifo_writer_reserve(struct fifo_writer *pwriter, struct fifo_geometry g, struct fifo_block *pblocks, unsigned int max_count, unsigned int size)
+{
+	unsigned int aligned_size = _fifo_writer_align_up(g, size);
+	unsigned int count;
+	unsigned int i;
+
+	if ((size == 0) || (size > g.block_max_size))
+		return 0;
+
+	/* As many blocks as there are BDs and contiguous space for */
+	count = _fifo_writer_get_free_bd(pwriter, g, max_count);
+	if (count == 0)
+		return 0;
+	i = _fifo_writer_get_free_contiguous(pwriter, g, aligned_size * count) / aligned_size;
+	if (count > i)
+		count = i;
+
+	for (i = 0; i < count; i++) {
+		pblocks[i].pdata = pwriter->pwrite + i * aligned_size;
+		pblocks[i].size  = size;
+	}
+
+	_fifo_writer_claim(pwriter, g, count, aligned_size * count);
+
+	return count;
+}
+
+/**
+ * @brief Reserve up to max_count blocks of size bytes, to fill and commit at once
+ *
+ * The blocks are claimed, fill them and commit them with fifo_writer_commit_blocks:
+ *   fifo_writer_update_reader(pwriter);
+ *   count = fifo_writer_reserve(pwriter, blocks, max_count, size);
+ *   ... fill the blocks, the sizes can be made smaller ...
+ *   fifo_writer_commit_blocks(pwriter, blocks, count);
+ *   fifo_writer_wakeup_reader(pwriter, 0);
+ *
+ * NOTE: Update the reader with fifo_writer_update_reader before calling
+ *
+ * @return the number of blocks written into pblocks, 0 when there is no space
+ */
+static inline unsigned int fifo_writer_reserve(struct fifo_writer *pwriter, struct fifo_block *pblocks, unsigned int max_count, unsigned int size)
+{
+	return _fifo_writer_reserve(pwriter, pwriter->pfifo->geometry, pblocks, max_count, size);
+}
+
+/*
+ * Private function: same as fifo_writer_commit_blocks, for a given geometry
+ */
+static inline unsigned int _fifo_writer_commit_blocks(struct fifo_writer *pwriter, struct fifo_geometry g, const struct fifo_block *pblocks, unsigned int count)
+{
+	unsigned int claimed;
+	unsigned int i;
+
+	/* Validate all blocks, before any of them is committed */
+	for (i = 0; i < count; i++) {
+		if ((pblocks[i].size > g.block_max_size) || ((uint8_t *)pblocks[i].pdata < pwriter->pdata))
+			return 0;
+	}
+
+	// The readers of a broadcast fifo stop at the next BD, it may be from the previous lap
+	if ((g.broadcast) && (count > 0))
+		_fifo_bd_clear_nobarrier(pwriter->pbdr, g, (pwriter->index_claimed + count) & g.bd_mask);
+
+	// Commit the data to the reader, all blocks become visible at once
+	_fifo_bd_put_range(pwriter->pbdr, g, pwriter->index_claimed, pwriter->pdata, pwriter->datasize, pblocks, count);
+
+	// Publish the BDs before the index, the scan for the reader may run in another thread
+	wmb();
+
+	// Advance the write index too, when more blocks are committed than were claimed
+	claimed = (pwriter->index_write - pwriter->index_claimed) & g.bd_mask;
+	pwriter->index_claimed = (pwriter->index_claimed + count) & g.bd_mask;
+	if (count > claimed)
+		pwriter->index_write = pwriter->index_claimed;
+
+	return count;
+}
+
+/**
+ * @brief Commit count blocks at once, in the order they were claimed
+ *
+ * Same as calling fifo_writer_commit count times, but with one barrier and
+ * the reader sees all blocks at the same time.
+ *
+ * @return count, or 0 when a block is not valid and nothing is committed
+ */
+static inline unsigned int fifo_writer_commit_blocks(struct fifo_writer *pwriter, const struct fifo_block *pblocks, unsigned int count)
+{
+	return _fifo_writer_commit_blocks(pwriter, pwriter->pfifo->geometry, pblocks, count);
 }
 
 #ifdef __cplusplus
@@ -9,6 +9,10 @@
  */
 #include <linux/types.h>
 #include <asm/barrier.h>
+#include <asm/processor.h>
+
+/* Loads and stores before it, ahead of the stores after it */
+#define release_mb()	mb()
 
 #else
 
@@ -19,9 +23,17 @@
 #include <stdint.h>
 #include <stddef.h>
 //#include <asm/barrier.h>
-#define wmb()	do { } while(0)
-#define rmb()	do { } while(0)
-#define mb()	do { } while(0)
+#define wmb()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define rmb()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+/* Loads and stores before it, ahead of the stores after it */
+#define release_mb()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
 
 #endif
 
@@ -4,21 +4,47 @@
 /**
  * @file testconsumer.h
  * @brief Reads 32bit int's from the fifo and checks for incrementing numbers 0,1,2,3,...
+ *
+ * When a latency histogram is set, the first 64bits of every block are the
+ * timestamp from the testproducer, instead of incrementing numbers.
+ *
+ * How the numbers are checked is set with testconsumer_set_data (see testdata.h),
+ * or by a check function (see testconsumer_set_check).
  */
 
+#include <string.h> // memcpy
+
 #include "fifo_writer.h"
 #include "fifo_reader.h"
+#include "testlatency.h"
+#include "testdata.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Max number of blocks consumed at once, see testconsumer_set_batch */
+#define TESTCONSUMER_BATCH_MAX	(256)
+
+/*
+ * Checks the int's of one block after the first ones (the timestamp), returns
+ * the number of int's in the block, up to size32, or 0 on error
+ */
+typedef unsigned int (*fp_testconsumer_check)(void * arg, const uint32_t *block, unsigned int size32, unsigned int first);
+
 struct testconsumer
 {
 	struct fifo_reader *preader;
 	unsigned int count32;
 	unsigned int actual32;
 	unsigned int error;
+	unsigned int blocks;
+	unsigned int batch;
+	struct testlatency *platency;
+	enum testdata_mode data;
+	unsigned int handoff;
+	fp_testconsumer_check fp_check;
+	void *fp_check_arg;
 };
 
 /**
@@ -30,6 +56,60 @@ static inline void testconsumer_init(struct testconsumer *pcons, struct fifo_rea
 	pcons->count32 = count/4;
 	pcons->actual32 = 0;
 	pcons->error = 0;
+	pcons->blocks = 0;
+	pcons->batch = 0;
+	pcons->platency = NULL;
+	pcons->data = TESTDATA_SCALAR;
+	pcons->handoff = 0;
+	pcons->fp_check = NULL;
+	pcons->fp_check_arg = NULL;
+}
+
+/**
+ * @brief Consume up to batch blocks at once (fifo_reader_get_blocks), 0 for one at a time
+ */
+static inline void testconsumer_set_batch(struct testconsumer *pcons, unsigned int batch)
+{
+	if (batch > TESTCONSUMER_BATCH_MAX)
+		batch = TESTCONSUMER_BATCH_MAX;
+
+	pcons->batch = batch;
+}
+
+/**
+ * @brief Record the latency of every block into a histogram (NULL to disable)
+ */
+static inline void testconsumer_set_latency(struct testconsumer *pcons, struct testlatency *platency)
+{
+	pcons->platency = platency;
+}
+
+/**
+ * @brief Set how the numbers are checked (see testdata.h), must be the mode of the testproducer
+ */
+static inline void testconsumer_set_data(struct testconsumer *pcons, enum testdata_mode data)
+{
+	pcons->data = data;
+}
+
+/**
+ * @brief Read from a fifo with handoff descriptors instead of data (see fifo_pipe_set_mode)
+ */
+static inline void testconsumer_set_handoff(struct testconsumer *pcons, unsigned int enable)
+{
+	pcons->handoff = enable;
+}
+
+/**
+ * @brief Check the blocks with fp_check instead of one run of incrementing numbers (NULL to disable)
+ *
+ * For blocks of many producers, each with its own numbers (see testproducer_set_source).
+ * count of testconsumer_init is the total of all of them.
+ */
+static inline void testconsumer_set_check(struct testconsumer *pcons, fp_testconsumer_check fp_check, void *arg)
+{
+	pcons->fp_check = fp_check;
+	pcons->fp_check_arg = arg;
 }
 
 static inline int testconsumer_done(struct testconsumer *pcons)
@@ -42,38 +122,108 @@ static inline int testconsumer_error(struct testconsumer *pcons)
 	return pcons->error;
 }
 
+/*
+ * Private function: check the data of one block, returns 0 on error
+ */
+static inline int _testconsumer_check(struct testconsumer *pcons, const uint32_t *block, unsigned int size)
+{
+	unsigned int idx;
+	unsigned int size32;
+	uint64_t now, stamp;
+
+	// Record latency as early as possible
+	if (pcons->platency != NULL) {
+		now = testlatency_now();
+		memcpy(&stamp, block, sizeof(stamp)); // block may only be 32bit aligned
+		testlatency_record(pcons->platency, now - stamp);
+		idx = 2;
+	}
+	else {
+		idx = 0;
+	}
+
+	// Get number of ints to produce
+	size32 = size / sizeof(uint32_t);
+	if (size32 > (pcons->count32 - pcons->actual32))
+		size32 = pcons->count32 - pcons->actual32;
+
+	// Read from data block, skip the timestamp
+	if (pcons->fp_check != NULL) {
+		size32 = pcons->fp_check(pcons->fp_check_arg, block, size32, idx);
+		if (size32 == 0) {
+			pcons->error = 1;
+			return 0;
+		}
+	}
+	else if (testdata_check(pcons->data, block, size32, pcons->actual32, idx) == 0) {
+		pcons->error = 1;
+		return 0;
+	}
+	pcons->actual32 += size32;
+
+	return 1;
+}
+
 static inline unsigned int testconsumer_consume_one(struct testconsumer *pcons)
 {
 	uint32_t *block;
-	unsigned int idx;
 	unsigned int size;
-	unsigned int size32;
 	struct fifo_reader *preader = pcons->preader;
 
 	size = fifo_reader_get(preader, (void **)&block);
 	if (size < sizeof(uint32_t))
 		return 0;
 
-	// Get number of ints to produce
-	size32 = size / sizeof(uint32_t);
-	if (size32 > (pcons->count32 - pcons->actual32))
-		size32 = pcons->count32 - pcons->actual32;
-
 	// Claim the block
 	fifo_reader_claim(preader, 1, size);
 
-	// Read from data block
-	for (idx = 0; idx < size32; idx++)
-	{
-		if (block[idx] != pcons->actual32++) {
+	// The data is where the descriptor refers to
+	if (pcons->handoff)
+		size = fifo_reader_get_handoff(block, (void **)&block);
+
+	if (_testconsumer_check(pcons, block, size) == 0)
+		return 0;
+
+	// Notify writer of free block
+	fifo_reader_free(preader);
+	fifo_reader_wakeup_writer(preader, 0);
+	pcons->blocks++;
+
+	return size;
+}
+
+static inline unsigned int testconsumer_consume_batch(struct testconsumer *pcons)
+{
+	struct fifo_block blocks[TESTCONSUMER_BATCH_MAX];
+	unsigned int count;
+	unsigned int size = 0;
+	unsigned int i;
+	struct fifo_reader *preader = pcons->preader;
+
+	// Get all blocks that are ready
+	count = fifo_reader_get_blocks(preader, blocks, pcons->batch);
+	if (count == 0)
+		return 0;
+
+	// Claim the blocks
+	fifo_reader_claim(preader, count, 0);
+
+	for (i = 0; i < count; i++) {
+		// The data is where the descriptor refers to
+		if (pcons->handoff)
+			blocks[i].size = fifo_reader_get_handoff(blocks[i].pdata, &blocks[i].pdata);
+
+		if ((blocks[i].size < sizeof(uint32_t)) || (_testconsumer_check(pcons, (const uint32_t *)blocks[i].pdata, blocks[i].size) == 0)) {
 			pcons->error = 1;
 			return 0;
 		}
+		size += blocks[i].size;
 	}
 
-	// Notify writer of free block
-	fifo_reader_free(preader);
+	// Notify writer of free blocks, once
+	fifo_reader_free_blocks(preader, count);
 	fifo_reader_wakeup_writer(preader, 0);
+	pcons->blocks += count;
 
 	return size;
 }
@@ -83,8 +233,14 @@ static inline unsigned int testconsumer_consume(struct testconsumer *pcons)
 	unsigned int size = 0;
 	unsigned int total_size = 0;
 
-	while((size = testconsumer_consume_one(pcons)) > 0)
-		total_size += size;
+	if (pcons->batch != 0) {
+		while((size = testconsumer_consume_batch(pcons)) > 0)
+			total_size += size;
+	}
+	else {
+		while((size = testconsumer_consume_one(pcons)) > 0)
+			total_size += size;
+	}
 
 	// Force wakeup signal to the writer
 	fifo_reader_wakeup_writer(pcons->preader, 1);
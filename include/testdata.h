@@ -0,0 +1,192 @@
+#ifndef __TESTDATA_H
+#define __TESTDATA_H
+
+/**
+ * @file testdata.h
+ * @brief Payload of the testproducer and testconsumer: 32bit int's with incrementing numbers
+ *
+ * The payload can be generated and checked in three ways (testdata_mode):
+ * - scalar: one int at a time, the consumer branches on every int
+ * - simd:   a vector of int's at a time, the consumer checks all of them
+ *           with one branch at the end of the block
+ * - touch:  only the first and last cache line of every block are written
+ *           and checked, so the benchmark measures the fifo and not the
+ *           payload. The data in between is not defined.
+ *
+ * The simd mode uses AVX2 when compiled for it (-mavx2), otherwise SSE2. Without
+ * either it is the same as scalar.
+ */
+
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum testdata_mode
+{
+	TESTDATA_SCALAR = 0,
+	TESTDATA_SIMD,
+	TESTDATA_TOUCH,
+	TESTDATA_MODE_COUNT
+};
+
+/* Number of int's at both ends of a block that are written and checked in TESTDATA_TOUCH mode (one cache line) */
+#define TESTDATA_TOUCH_COUNT	(64 / sizeof(uint32_t))
+
+/*
+ * Private function: scalar fill, returns the next number
+ */
+static inline uint32_t _testdata_fill_scalar(uint32_t *block, unsigned int size32, uint32_t seq)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < size32; idx++)
+		block[idx] = seq++;
+
+	return seq;
+}
+
+/*
+ * Private function: scalar check, returns 0 on error
+ */
+static inline int _testdata_check_scalar(const uint32_t *block, unsigned int size32, uint32_t seq)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < size32; idx++) {
+		if (block[idx] != seq++)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Private function: vector fill, the block may only be 32bit aligned
+ */
+static inline void _testdata_fill_simd(uint32_t *block, unsigned int size32, uint32_t seq)
+{
+	unsigned int idx = 0;
+#if defined(__AVX2__)
+	__m256i vseq = _mm256_add_epi32(_mm256_set1_epi32((int)seq), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i vstep = _mm256_set1_epi32(8);
+
+	for (; idx + 8 <= size32; idx += 8) {
+		_mm256_storeu_si256((__m256i *)(block + idx), vseq);
+		vseq = _mm256_add_epi32(vseq, vstep);
+	}
+#elif defined(__SSE2__)
+	__m128i vseq = _mm_add_epi32(_mm_set1_epi32((int)seq), _mm_setr_epi32(0, 1, 2, 3));
+	const __m128i vstep = _mm_set1_epi32(4);
+
+	for (; idx + 4 <= size32; idx += 4) {
+		_mm_storeu_si128((__m128i *)(block + idx), vseq);
+		vseq = _mm_add_epi32(vseq, vstep);
+	}
+#endif
+	_testdata_fill_scalar(block + idx, size32 - idx, seq + idx);
+}
+
+/*
+ * Private function: vector check, one branch for the entire block, returns 0 on error
+ */
+static inline int _testdata_check_simd(const uint32_t *block, unsigned int size32, uint32_t seq)
+{
+	unsigned int idx = 0;
+#if defined(__AVX2__)
+	__m256i vseq = _mm256_add_epi32(_mm256_set1_epi32((int)seq), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i vstep = _mm256_set1_epi32(8);
+	__m256i vdiff = _mm256_setzero_si256();
+
+	for (; idx + 8 <= size32; idx += 8) {
+		vdiff = _mm256_or_si256(vdiff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(block + idx)), vseq));
+		vseq = _mm256_add_epi32(vseq, vstep);
+	}
+	if (_mm256_testz_si256(vdiff, vdiff) == 0)
+		return 0;
+#elif defined(__SSE2__)
+	__m128i vseq = _mm_add_epi32(_mm_set1_epi32((int)seq), _mm_setr_epi32(0, 1, 2, 3));
+	const __m128i vstep = _mm_set1_epi32(4);
+	__m128i vdiff = _mm_setzero_si128();
+
+	for (; idx + 4 <= size32; idx += 4) {
+		vdiff = _mm_or_si128(vdiff, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(block + idx)), vseq));
+		vseq = _mm_add_epi32(vseq, vstep);
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(vdiff, _mm_setzero_si128())) != 0xFFFF)
+		return 0;
+#endif
+	return _testdata_check_scalar(block + idx, size32 - idx, seq + idx);
+}
+
+/**
+ * @brief Write size32 incrementing numbers, starting at seq
+ *
+ * @param mode how the numbers are written (testdata_mode)
+ * @param block the data, at least 32bit aligned
+ * @param size32 number of int's in the block
+ * @param seq the number of the first int
+ */
+static inline void testdata_fill(enum testdata_mode mode, uint32_t *block, unsigned int size32, uint32_t seq)
+{
+	switch (mode) {
+		case TESTDATA_SIMD:
+			_testdata_fill_simd(block, size32, seq);
+			break;
+		case TESTDATA_TOUCH:
+			if (size32 > 2 * TESTDATA_TOUCH_COUNT) {
+				_testdata_fill_scalar(block, TESTDATA_TOUCH_COUNT, seq);
+				_testdata_fill_scalar(block + size32 - TESTDATA_TOUCH_COUNT, TESTDATA_TOUCH_COUNT, seq + size32 - TESTDATA_TOUCH_COUNT);
+				break;
+			}
+			_testdata_fill_scalar(block, size32, seq);
+			break;
+		default:
+			_testdata_fill_scalar(block, size32, seq);
+			break;
+	}
+}
+
+/**
+ * @brief Check size32 incrementing numbers, starting at seq
+ *
+ * The touch windows are at the same place in the block as with testdata_fill,
+ * whatever the number of int's skipped at the start.
+ *
+ * @param mode how the numbers are checked (testdata_mode), must match testdata_fill
+ * @param block the data, at least 32bit aligned
+ * @param size32 number of int's in the block
+ * @param seq the number of the first int
+ * @param first the first int to check, the ones before it are skipped (like a timestamp)
+ * @return 1 when the data is correct, 0 on error
+ */
+static inline int testdata_check(enum testdata_mode mode, const uint32_t *block, unsigned int size32, uint32_t seq, unsigned int first)
+{
+	if (first > size32)
+		first = size32;
+
+	switch (mode) {
+		case TESTDATA_SIMD:
+			return _testdata_check_simd(block + first, size32 - first, seq + first);
+		case TESTDATA_TOUCH:
+			if (size32 > 2 * TESTDATA_TOUCH_COUNT) {
+				if ((first < TESTDATA_TOUCH_COUNT) && (_testdata_check_scalar(block + first, TESTDATA_TOUCH_COUNT - first, seq + first) == 0))
+					return 0;
+				return _testdata_check_scalar(block + size32 - TESTDATA_TOUCH_COUNT, TESTDATA_TOUCH_COUNT, seq + size32 - TESTDATA_TOUCH_COUNT);
+			}
+			return _testdata_check_scalar(block + first, size32 - first, seq + first);
+		default:
+			return _testdata_check_scalar(block + first, size32 - first, seq + first);
+	}
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
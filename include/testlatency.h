@@ -0,0 +1,183 @@
+#ifndef __TESTLATENCY_H
+#define __TESTLATENCY_H
+
+/**
+ * @file testlatency.h
+ * @brief Latency histogram used by the testproducer and testconsumer
+ *
+ * The histogram is log-linear (like an HDR histogram): every power of 2 is
+ * split into a fixed number of linear sub-buckets. This gives a constant
+ * relative precision (< 1%) over the entire range, with a small fixed
+ * memory footprint and O(1) recording.
+ */
+
+#include <time.h>
+
+#include "linux_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TESTLATENCY_SUB_BITS	7  /* 2^(7-1) = 64 sub-buckets per power of 2 */
+#define TESTLATENCY_MAX_BITS	40 /* Max ~1099s, larger values are clamped */
+#define TESTLATENCY_SUB_HALF	(1 << (TESTLATENCY_SUB_BITS-1))
+#define TESTLATENCY_BUCKETS	((TESTLATENCY_MAX_BITS - TESTLATENCY_SUB_BITS + 2) * TESTLATENCY_SUB_HALF)
+#define TESTLATENCY_MAX_VALUE	((((uint64_t)1) << TESTLATENCY_MAX_BITS) - 1)
+
+struct testlatency
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[TESTLATENCY_BUCKETS];
+};
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds
+ */
+static inline uint64_t testlatency_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/**
+ * @brief Initialize (clear) the histogram
+ */
+static inline void testlatency_init(struct testlatency *plat)
+{
+	unsigned int idx;
+
+	plat->count = 0;
+	plat->sum = 0;
+	plat->min = 0;
+	plat->max = 0;
+	for (idx = 0; idx < TESTLATENCY_BUCKETS; idx++)
+		plat->bucket[idx] = 0;
+}
+
+/*
+ * Private function
+ */
+static inline unsigned int _testlatency_shift(uint64_t value)
+{
+	unsigned int msb = 63 - __builtin_clzll(value | 1);
+
+	return (msb < TESTLATENCY_SUB_BITS) ? 0 : (msb - TESTLATENCY_SUB_BITS + 1);
+}
+
+/*
+ * Private function
+ */
+static inline unsigned int _testlatency_index(uint64_t value)
+{
+	unsigned int shift = _testlatency_shift(value);
+
+	return (shift * TESTLATENCY_SUB_HALF) + (unsigned int)(value >> shift);
+}
+
+/*
+ * Private function: highest value that falls into the bucket
+ */
+static inline uint64_t _testlatency_value(unsigned int idx)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (idx < (2 * TESTLATENCY_SUB_HALF))
+		return idx;
+
+	shift = (idx / TESTLATENCY_SUB_HALF) - 1;
+	sub = (idx % TESTLATENCY_SUB_HALF) + TESTLATENCY_SUB_HALF;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Record a single value
+ */
+static inline void testlatency_record(struct testlatency *plat, uint64_t value)
+{
+	if (value > TESTLATENCY_MAX_VALUE)
+		value = TESTLATENCY_MAX_VALUE;
+
+	if ((plat->count == 0) || (value < plat->min))
+		plat->min = value;
+	if (value > plat->max)
+		plat->max = value;
+
+	plat->count++;
+	plat->sum += value;
+	plat->bucket[_testlatency_index(value)]++;
+}
+
+/**
+ * @brief Add all values of another histogram
+ */
+static inline void testlatency_merge(struct testlatency *plat, const struct testlatency *pother)
+{
+	unsigned int idx;
+
+	if (pother->count == 0)
+		return;
+
+	if ((plat->count == 0) || (pother->min < plat->min))
+		plat->min = pother->min;
+	if (pother->max > plat->max)
+		plat->max = pother->max;
+
+	plat->count += pother->count;
+	plat->sum += pother->sum;
+	for (idx = 0; idx < TESTLATENCY_BUCKETS; idx++)
+		plat->bucket[idx] += pother->bucket[idx];
+}
+
+/**
+ * @brief Get the value at a percentile (0.0 - 100.0)
+ *
+ * The value returned is the highest value of the bucket, so it is never
+ * lower than the real value.
+ */
+static inline uint64_t testlatency_percentile(const struct testlatency *plat, double percentile)
+{
+	uint64_t target;
+	uint64_t total = 0;
+	unsigned int idx;
+
+	if (plat->count == 0)
+		return 0;
+
+	target = (uint64_t)((percentile / 100.0) * plat->count + 0.5);
+	if (target < 1)
+		target = 1;
+	if (target > plat->count)
+		target = plat->count;
+
+	for (idx = 0; idx < TESTLATENCY_BUCKETS; idx++) {
+		total += plat->bucket[idx];
+		if (total >= target)
+			break;
+	}
+
+	/* Never report more than the real maximum */
+	return (_testlatency_value(idx) > plat->max) ? plat->max : _testlatency_value(idx);
+}
+
+/**
+ * @brief Get the mean value
+ */
+static inline uint64_t testlatency_mean(const struct testlatency *plat)
+{
+	return (plat->count == 0) ? 0 : (plat->sum / plat->count);
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
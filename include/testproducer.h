@@ -4,19 +4,43 @@
 /**
  * @file testproducer.h
  * @brief Writes 32bit int's into the fifo with incrementing numbers 0,1,2,3,...
+ *
+ * When timestamping is enabled, the first 64bits of every block are replaced
+ * by the time the block is committed (see testlatency.h).
+ *
+ * How the numbers are written is set with testproducer_set_data (see testdata.h).
+ *
+ * When a source number is set, the int after the timestamp is replaced by it,
+ * so a consumer can check blocks of many producers in one fifo.
  */
 
+#include <string.h> // memcpy
+
 #include "fifo_writer.h"
+#include "testlatency.h"
+#include "testdata.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Max number of blocks produced at once, see testproducer_set_batch */
+#define TESTPRODUCER_BATCH_MAX	(256)
+
+/* No source number in the blocks, see testproducer_set_source */
+#define TESTPRODUCER_NO_SOURCE	(~0U)
+
 struct testproducer
 {
 	struct fifo_writer *pwriter;
 	unsigned int count32;
 	unsigned int actual32;
+	unsigned int block_size;
+	unsigned int blocks;
+	unsigned int batch;
+	unsigned int timestamp;
+	unsigned int source;
+	enum testdata_mode data;
 };
 
 /**
@@ -27,6 +51,71 @@ static inline void testproducer_init(struct testproducer *pprod, struct fifo_wri
 	pprod->pwriter = pwriter;
 	pprod->count32 = count/4;
 	pprod->actual32 = 0;
+	pprod->block_size = FIFO_BLOCK_MAX_SIZE;
+	pprod->blocks = 0;
+	pprod->batch = 0;
+	pprod->timestamp = 0;
+	pprod->source = TESTPRODUCER_NO_SOURCE;
+	pprod->data = TESTDATA_SCALAR;
+}
+
+/**
+ * @brief Limit the size of the blocks written into the fifo
+ */
+static inline void testproducer_set_block_size(struct testproducer *pprod, unsigned int block_size)
+{
+	if (block_size > fifo_writer_get_block_max_size(pprod->pwriter))
+		block_size = fifo_writer_get_block_max_size(pprod->pwriter);
+
+	pprod->block_size = block_size;
+}
+
+/**
+ * @brief Produce up to batch blocks at once (fifo_writer_reserve), 0 for one at a time
+ */
+static inline void testproducer_set_batch(struct testproducer *pprod, unsigned int batch)
+{
+	if (batch > TESTPRODUCER_BATCH_MAX)
+		batch = TESTPRODUCER_BATCH_MAX;
+
+	pprod->batch = batch;
+}
+
+/**
+ * @brief Enable or disable timestamping of every block
+ */
+static inline void testproducer_set_timestamp(struct testproducer *pprod, unsigned int enable)
+{
+	pprod->timestamp = enable;
+}
+
+/**
+ * @brief Write the number of the source after the timestamp of every block (TESTPRODUCER_NO_SOURCE to disable)
+ */
+static inline void testproducer_set_source(struct testproducer *pprod, unsigned int source)
+{
+	pprod->source = source;
+}
+
+/**
+ * @brief Set how the numbers are written (see testdata.h), the testconsumer must use the same mode
+ */
+static inline void testproducer_set_data(struct testproducer *pprod, enum testdata_mode data)
+{
+	pprod->data = data;
+}
+
+/**
+ * @brief Get the smallest block the producer will write
+ */
+static inline unsigned int testproducer_min_size(struct testproducer *pprod)
+{
+	unsigned int min_size = (pprod->timestamp) ? sizeof(uint64_t) : 0;
+
+	if ((pprod->source != TESTPRODUCER_NO_SOURCE) || (min_size == 0))
+		min_size += sizeof(uint32_t);
+
+	return min_size;
 }
 
 static inline int testproducer_done(struct testproducer *pprod)
@@ -37,18 +126,23 @@ static inline int testproducer_done(struct testproducer *pprod)
 static inline unsigned int testproducer_produce_one(struct testproducer *pprod)
 {
 	uint32_t *block;
-	unsigned int idx;
 	unsigned int size;
 	unsigned int size32;
+	unsigned int min_size = testproducer_min_size(pprod);
+	uint64_t stamp;
 	struct fifo_writer *pwriter = pprod->pwriter;
 
-	// Get free size
-	fifo_writer_update_reader(pwriter);
-	size = fifo_writer_get_free_contiguous(pwriter, sizeof(uint32_t));
-	if (size > FIFO_BLOCK_MAX_SIZE)
-		size = FIFO_BLOCK_MAX_SIZE;
+	if (testproducer_done(pprod))
+		return 0;
+
+	// Get free size, only look for the reader when we are running out
+	if ((fifo_writer_get_free_total(pwriter) < pprod->block_size) || (fifo_writer_get_free_bd(pwriter, 1) == 0))
+		fifo_writer_update_reader(pwriter);
+	size = fifo_writer_get_free_contiguous(pwriter, min_size);
+	if (size > pprod->block_size)
+		size = pprod->block_size;
 	size &= ~3;
-	if (size < sizeof(uint32_t))
+	if (size < min_size)
 		return 0;
 
 	// Get number of ints to produce
@@ -63,23 +157,103 @@ static inline unsigned int testproducer_produce_one(struct testproducer *pprod)
 	fifo_writer_claim(pwriter, 1, size);
 
 	// Write to data block
-	for (idx = 0; idx < size32; idx++)
-		block[idx] = pprod->actual32++;
+	testdata_fill(pprod->data, block, size32, pprod->actual32);
+	pprod->actual32 += size32;
+	if (pprod->source != TESTPRODUCER_NO_SOURCE)
+		block[(pprod->timestamp) ? 2 : 0] = pprod->source;
+
+	// Timestamp as late as possible
+	if (pprod->timestamp) {
+		stamp = testlatency_now();
+		memcpy(block, &stamp, sizeof(stamp)); // block may only be 32bit aligned
+	}
 
 	// Notify reader of new data
 	fifo_writer_commit(pwriter, block, size);
 	fifo_writer_wakeup_reader(pwriter, 0);
+	pprod->blocks++;
 
 	return size;
 }
 
+static inline unsigned int testproducer_produce_batch(struct testproducer *pprod)
+{
+	struct fifo_block blocks[TESTPRODUCER_BATCH_MAX];
+	uint32_t *block;
+	unsigned int count;
+	unsigned int i;
+	unsigned int size;
+	unsigned int size32;
+	unsigned int total_size = 0;
+	unsigned int min_size = testproducer_min_size(pprod);
+	uint64_t stamp;
+	struct fifo_writer *pwriter = pprod->pwriter;
+
+	if (testproducer_done(pprod))
+		return 0;
+
+	// Get free size, only look for the reader when we are running out
+	if ((fifo_writer_get_free_total(pwriter) < pprod->block_size) || (fifo_writer_get_free_bd(pwriter, 1) == 0))
+		fifo_writer_update_reader(pwriter);
+	size = fifo_writer_get_free_contiguous(pwriter, min_size);
+	if (size > pprod->block_size)
+		size = pprod->block_size;
+	size &= ~3;
+	if (size < min_size)
+		return 0;
+
+	// Reserve the blocks, no more than needed for the remaining ints
+	size32 = size / sizeof(uint32_t);
+	count = (pprod->count32 - pprod->actual32 + size32 - 1) / size32;
+	if (count > pprod->batch)
+		count = pprod->batch;
+	count = fifo_writer_reserve(pwriter, blocks, count, size);
+	if (count == 0)
+		return 0;
+
+	// Write to data blocks
+	for (i = 0; i < count; i++) {
+		block = (uint32_t *)blocks[i].pdata;
+		size32 = blocks[i].size / sizeof(uint32_t);
+		if (size32 > (pprod->count32 - pprod->actual32))
+			size32 = pprod->count32 - pprod->actual32;
+
+		testdata_fill(pprod->data, block, size32, pprod->actual32);
+		pprod->actual32 += size32;
+		if (pprod->source != TESTPRODUCER_NO_SOURCE)
+			block[(pprod->timestamp) ? 2 : 0] = pprod->source;
+
+		total_size += blocks[i].size;
+	}
+
+	// Timestamp as late as possible
+	if (pprod->timestamp) {
+		stamp = testlatency_now();
+		for (i = 0; i < count; i++)
+			memcpy(blocks[i].pdata, &stamp, sizeof(stamp)); // block may only be 32bit aligned
+	}
+
+	// Notify reader of new data, once
+	fifo_writer_commit_blocks(pwriter, blocks, count);
+	fifo_writer_wakeup_reader(pwriter, 0);
+	pprod->blocks += count;
+
+	return total_size;
+}
+
 static inline unsigned int testproducer_produce(struct testproducer *pprod)
 {
 	unsigned int size = 0;
 	unsigned int total_size = 0;
 
-	while((size = testproducer_produce_one(pprod)) > 0)
-		total_size += size;
+	if (pprod->batch != 0) {
+		while((size = testproducer_produce_batch(pprod)) > 0)
+			total_size += size;
+	}
+	else {
+		while((size = testproducer_produce_one(pprod)) > 0)
+			total_size += size;
+	}
 
 	// Force wakeup signal to the reader
 	fifo_writer_wakeup_reader(pprod->pwriter, 1);
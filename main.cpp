@@ -1,46 +1,367 @@
 #include <iostream>
-#include <chrono>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
 
+#include "benchmark.h"
 
-using std::chrono::time_point;
-using std::chrono::system_clock;
-using std::chrono::milliseconds;
 
+//---------------------------------------------------------------------------
+static void
+usage(const char * sProgram)
+{
+	const SBenchTopology * ptopology;
+
+	std::cerr<<"Usage: "<<sProgram<<" [options]"<<std::endl;
+	std::cerr<<std::endl;
+	std::cerr<<"Every combination of the comma separated lists is benchmarked."<<std::endl;
+	std::cerr<<"Sizes accept a K, M or G suffix (powers of 1024)."<<std::endl;
+	std::cerr<<std::endl;
+	std::cerr<<"  -t, --topology=LIST    datapaths to run (default: all)"<<std::endl;
+	std::cerr<<"  -s, --fifo-size=LIST   fifo size in bytes (default: "<<FIFO_SIZE<<")"<<std::endl;
+	std::cerr<<"  -b, --bd-count=LIST    number of buffer descriptors (default: "<<FIFO_BD_COUNT<<")"<<std::endl;
+	std::cerr<<"  -a, --align=LIST       block alignment in bytes (default: 16)"<<std::endl;
+	std::cerr<<"  -k, --block-size=LIST  maximum block size in bytes (default: "<<FIFO_BLOCK_MAX_SIZE<<")"<<std::endl;
+	std::cerr<<"  -r, --reader=LIST      how the writer finds the reader: scan or cursor (default: scan)"<<std::endl;
+	std::cerr<<"  -L, --layout=LIST      fifo layout: packed, cache (cache line aligned), mirror (data ring mapped twice) or cache-mirror (default: packed)"<<std::endl;
+	std::cerr<<"  -B, --bd-size=LIST     buffer descriptor size in bits: 32 or 64 (large blocks and fifos) (default: 32)"<<std::endl;
+	std::cerr<<"  -W, --window=LIST      outstanding transfers per pipe, 0 for no limit (default: 0)"<<std::endl;
+	std::cerr<<"  -R, --read-batch=LIST  blocks consumed at once, 0 for one at a time (default: 0)"<<std::endl;
+	std::cerr<<"  -P, --write-batch=LIST blocks produced at once, 0 for one at a time (default: 0)"<<std::endl;
+	std::cerr<<"  -p, --producers=LIST   producer threads, mpsc and fanin only (default: 1)"<<std::endl;
+	std::cerr<<"  -N, --readers=LIST     lossless readers, bcast only (default: 1)"<<std::endl;
+	std::cerr<<"      --lossy=LIST       lossy readers, bcast only (default: 0)"<<std::endl;
+	std::cerr<<"  -H, --hops=LIST        pipes in a row, chain only (default: 1)"<<std::endl;
+	std::cerr<<"  -X, --workers=LIST     executor threads for the pipes, 0 for a thread per pipe, chain only (default: 0)"<<std::endl;
+	std::cerr<<"      --pipe=LIST        copy the data or hand off descriptors between the fifos, chain only (default: copy)"<<std::endl;
+	std::cerr<<"      --copy=LIST        copy kernel of the pipes and DMA engines: memcpy, auto, avx2, avx2-nt or avx512-nt (default: memcpy)"<<std::endl;
+	std::cerr<<"      --data=LIST        payload of producer and consumer: scalar, simd or touch (first and last cache line only) (default: scalar)"<<std::endl;
+	std::cerr<<"  -c, --count=SIZE       bytes transferred per run (default: "<<TEST_COUNT<<")"<<std::endl;
+	std::cerr<<"  -l, --latency          record the latency of every block (producer to consumer)"<<std::endl;
+	std::cerr<<"  -m, --wait=MODE        spin or block, how producer and consumer wait (default: spin)"<<std::endl;
+	std::cerr<<"      --dma-setup=NS     DMA setup time per transfer in ns (default: 0)"<<std::endl;
+	std::cerr<<"      --dma-bandwidth=SIZE  DMA bandwidth in bytes/s, 0 for as fast as memcpy (default: 0)"<<std::endl;
+	std::cerr<<"      --dma-burst=SIZE   DMA burst size in bytes, 0 for entire transfers (default: 0)"<<std::endl;
+	std::cerr<<"      --dma-shared-bus   the DMA engines share one bus, one burst at a time"<<std::endl;
+	std::cerr<<"      --cpus-producer=CPUS  pin the producer threads, like 0-3,8 (default: not pinned)"<<std::endl;
+	std::cerr<<"      --cpus-consumer=CPUS  pin the consumer threads (default: not pinned)"<<std::endl;
+	std::cerr<<"      --cpus-pipe=CPUS   pin the pipe and executor threads (default: not pinned)"<<std::endl;
+	std::cerr<<"      --cpus-dma=CPUS    pin the DMA threads (default: not pinned)"<<std::endl;
+	std::cerr<<"      --mem-node=NODE    NUMA node of the fifo memory: a number, writer, reader or any (default: any)"<<std::endl;
+	std::cerr<<"      --pages=PAGES      fifo memory pages: 4k, thp, 2m or 1g (default: 4k)"<<std::endl;
+	std::cerr<<"      --prefault         fault in the fifo memory before the test"<<std::endl;
+	std::cerr<<"      --mlock            lock the fifo memory"<<std::endl;
+	std::cerr<<"  -w, --warmup=N         unmeasured runs per combination (default: 1)"<<std::endl;
+	std::cerr<<"  -n, --trials=N         measured runs per combination (default: 5)"<<std::endl;
+	std::cerr<<"  -f, --format=FORMAT    csv or json (default: csv)"<<std::endl;
+	std::cerr<<"  -o, --output=FILE      write results to FILE instead of stdout"<<std::endl;
+	std::cerr<<"  -h, --help             show this help"<<std::endl;
+	std::cerr<<std::endl;
+	std::cerr<<"Topologies:"<<std::endl;
+	for (ptopology = bench_topologies; ptopology->sName != NULL; ptopology++)
+		std::cerr<<"  "<<ptopology->sName<<": "<<ptopology->sDescription<<std::endl;
+}
+
+//---------------------------------------------------------------------------
+static bool
+parse_size(const char * sValue, uint64_t & value)
+{
+	unsigned long long ull, scale = 1;
+	char * pend;
+
+	ull = strtoull(sValue, &pend, 0);
+	if (pend == sValue)
+		return false;
+
+	switch (*pend) {
+		case 'k': case 'K': scale = 1024;           pend++; break;
+		case 'm': case 'M': scale = 1024*1024;      pend++; break;
+		case 'g': case 'G': scale = 1024*1024*1024; pend++; break;
+	}
+
+	if ((*pend != '\0') || (ull > UINT64_MAX / scale))
+		return false;
+
+	value = ull * scale;
+	return true;
+}
+
+//---------------------------------------------------------------------------
+static bool
+parse_size(const char * sValue, unsigned int & value)
+{
+	uint64_t value64;
+
+	if ((parse_size(sValue, value64) == false) || (value64 > 0xffffffffULL))
+		return false;
+
+	value = (unsigned int)value64;
+	return true;
+}
+
+//---------------------------------------------------------------------------
+static bool
+parse_list(const char * sList, std::vector<unsigned int> & values)
+{
+	std::string sItem;
+	std::string s(sList);
+	size_t start = 0, end;
+	unsigned int value;
+
+	values.clear();
+	do {
+		end = s.find(',', start);
+		sItem = s.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+		if (parse_size(sItem.c_str(), value) == false)
+			return false;
+		values.push_back(value);
+		start = end + 1;
+	} while (end != std::string::npos);
 
-void test01();
-void test02();
-void test03();
+	return true;
+}
+
+//---------------------------------------------------------------------------
+static bool
+parse_names(const char * sList, const char * const * sNames, const unsigned int * pValues, std::vector<unsigned int> & values)
+{
+	std::string sItem;
+	std::string s(sList);
+	size_t start = 0, end;
+	unsigned int i;
+
+	values.clear();
+	do {
+		end = s.find(',', start);
+		sItem = s.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+		for (i = 0; sNames[i] != NULL; i++) {
+			if (sItem == sNames[i])
+				break;
+		}
+		if (sNames[i] == NULL)
+			return false;
+		values.push_back(pValues[i]);
+		start = end + 1;
+	} while (end != std::string::npos);
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+static bool
+parse_topology(const char * sList, std::vector<const SBenchTopology *> & values)
+{
+	std::string sItem;
+	std::string s(sList);
+	size_t start = 0, end;
+	const SBenchTopology * ptopology;
+
+	values.clear();
+	do {
+		end = s.find(',', start);
+		sItem = s.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+		ptopology = bench_find_topology(sItem.c_str());
+		if (ptopology == NULL)
+			return false;
+		values.push_back(ptopology);
+		start = end + 1;
+	} while (end != std::string::npos);
 
+	return true;
+}
+
+enum
+{
+	OPT_DMA_SETUP = 256,
+	OPT_DMA_BANDWIDTH,
+	OPT_DMA_BURST,
+	OPT_DMA_SHARED_BUS,
+	OPT_LOSSY,
+	OPT_CPUS_PRODUCER,
+	OPT_CPUS_CONSUMER,
+	OPT_CPUS_PIPE,
+	OPT_CPUS_DMA,
+	OPT_MEM_NODE,
+	OPT_PAGES,
+	OPT_PREFAULT,
+	OPT_MLOCK,
+	OPT_COPY,
+	OPT_DATA,
+	OPT_PIPE,
+};
 
 //---------------------------------------------------------------------------
 int
-main()
-{
-	time_point<system_clock> tstart, tend;
-
-#if 1
-	std::cout<<"datafifo test01"<<std::endl;
-	tstart = system_clock::now();
-	test01();
-	tend = system_clock::now();
-	std::cout<<"  - Time: "<<std::chrono::duration_cast<milliseconds>(tend - tstart).count()<<"ms"<<std::endl<<std::endl;
-#endif
-
-#if 1
-	std::cout<<"datafifo test02"<<std::endl;
-	tstart = system_clock::now();
-	test02();
-	tend = system_clock::now();
-	std::cout<<"  - Time: "<<std::chrono::duration_cast<milliseconds>(tend - tstart).count()<<"ms"<<std::endl<<std::endl;
-#endif
-
-#if 1
-	std::cout<<"datafifo test03"<<std::endl;
-	tstart = system_clock::now();
-	test03();
-	tend = system_clock::now();
-	std::cout<<"  - Time: "<<std::chrono::duration_cast<milliseconds>(tend - tstart).count()<<"ms"<<std::endl<<std::endl;
-#endif
-
-	return 0;
+main(int argc, char * argv[])
+{
+	static const struct option long_options[] = {
+		{"topology",   required_argument, NULL, 't'},
+		{"fifo-size",  required_argument, NULL, 's'},
+		{"bd-count",   required_argument, NULL, 'b'},
+		{"align",      required_argument, NULL, 'a'},
+		{"block-size", required_argument, NULL, 'k'},
+		{"reader",     required_argument, NULL, 'r'},
+		{"layout",     required_argument, NULL, 'L'},
+		{"bd-size",    required_argument, NULL, 'B'},
+		{"window",     required_argument, NULL, 'W'},
+		{"read-batch", required_argument, NULL, 'R'},
+		{"write-batch", required_argument, NULL, 'P'},
+		{"producers",  required_argument, NULL, 'p'},
+		{"readers",    required_argument, NULL, 'N'},
+		{"lossy",      required_argument, NULL, OPT_LOSSY},
+		{"hops",       required_argument, NULL, 'H'},
+		{"workers",    required_argument, NULL, 'X'},
+		{"pipe",       required_argument, NULL, OPT_PIPE},
+		{"copy",       required_argument, NULL, OPT_COPY},
+		{"data",       required_argument, NULL, OPT_DATA},
+		{"count",      required_argument, NULL, 'c'},
+		{"latency",    no_argument,       NULL, 'l'},
+		{"wait",       required_argument, NULL, 'm'},
+		{"dma-setup",     required_argument, NULL, OPT_DMA_SETUP},
+		{"dma-bandwidth", required_argument, NULL, OPT_DMA_BANDWIDTH},
+		{"dma-burst",     required_argument, NULL, OPT_DMA_BURST},
+		{"dma-shared-bus", no_argument,      NULL, OPT_DMA_SHARED_BUS},
+		{"cpus-producer", required_argument, NULL, OPT_CPUS_PRODUCER},
+		{"cpus-consumer", required_argument, NULL, OPT_CPUS_CONSUMER},
+		{"cpus-pipe",     required_argument, NULL, OPT_CPUS_PIPE},
+		{"cpus-dma",      required_argument, NULL, OPT_CPUS_DMA},
+		{"mem-node",      required_argument, NULL, OPT_MEM_NODE},
+		{"pages",         required_argument, NULL, OPT_PAGES},
+		{"prefault",      no_argument,       NULL, OPT_PREFAULT},
+		{"mlock",         no_argument,       NULL, OPT_MLOCK},
+		{"warmup",     required_argument, NULL, 'w'},
+		{"trials",     required_argument, NULL, 'n'},
+		{"format",     required_argument, NULL, 'f'},
+		{"output",     required_argument, NULL, 'o'},
+		{"help",       no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	static const char * const reader_names[] = {"scan", "cursor", NULL};
+	static const unsigned int reader_values[] = {0, FIFO_FLAG_READER_CURSOR};
+	static const char * const layout_names[] = {"packed", "cache", "mirror", "cache-mirror", NULL};
+	static const unsigned int layout_values[] = {0, FIFO_FLAG_CACHE_ALIGNED, FIFO_FLAG_MIRROR, FIFO_FLAG_CACHE_ALIGNED | FIFO_FLAG_MIRROR};
+	static const char * const bd_names[] = {"32", "64", NULL};
+	static const unsigned int bd_values[] = {0, FIFO_FLAG_BD64};
+	static const char * const pipe_names[] = {"copy", "handoff", NULL};
+	static const unsigned int pipe_values[] = {FIFO_PIPE_COPY, FIFO_PIPE_HANDOFF};
+	static const char * const copy_names[] = {"memcpy", "auto", "avx2", "avx2-nt", "avx512-nt", NULL};
+	static const unsigned int copy_values[] = {COPY_MEMCPY, COPY_AUTO, COPY_AVX2, COPY_AVX2_NT, COPY_AVX512_NT};
+	static const char * const data_names[] = {"scalar", "simd", "touch", NULL};
+	static const unsigned int data_values[] = {TESTDATA_SCALAR, TESTDATA_SIMD, TESTDATA_TOUCH};
+	CBenchmark bench;
+	const SBenchTopology * ptopology;
+	std::ofstream fout;
+	const char * sOutput = NULL;
+	uint64_t value;
+	bool bOk = true;
+	int opt;
+
+	/* The producer process of test04, started by the benchmark itself */
+	if ((argc > 1) && (strcmp(argv[1], TEST04_PRODUCER_OPTION) == 0))
+		return test04_producer_main(argc, argv);
+
+	/* Defaults: the configuration the tests have always been using */
+	for (ptopology = bench_topologies; ptopology->sName != NULL; ptopology++)
+		bench.topology.push_back(ptopology);
+	bench.fifo_size.push_back(FIFO_SIZE);
+	bench.bd_count.push_back(FIFO_BD_COUNT);
+	bench.align.push_back(16);
+	bench.block_size.push_back(FIFO_BLOCK_MAX_SIZE);
+	bench.reader.push_back(0);
+	bench.layout.push_back(0);
+	bench.bd.push_back(0);
+	bench.window.push_back(0);
+	bench.read_batch.push_back(0);
+	bench.write_batch.push_back(0);
+	bench.producers.push_back(1);
+	bench.readers.push_back(1);
+	bench.lossy_readers.push_back(0);
+	bench.hops.push_back(1);
+	bench.pipe_workers.push_back(0);
+	bench.pipe_mode.push_back(FIFO_PIPE_COPY);
+	bench.copy.push_back(COPY_MEMCPY);
+	bench.data.push_back(TESTDATA_SCALAR);
+
+	while ((opt = getopt_long(argc, argv, "t:s:b:a:k:r:L:B:W:R:P:p:N:H:X:c:lm:w:n:f:o:h", long_options, NULL)) != -1) {
+		switch (opt) {
+			case 't': bOk = parse_topology(optarg, bench.topology); break;
+			case 's': bOk = parse_list(optarg, bench.fifo_size); break;
+			case 'b': bOk = parse_list(optarg, bench.bd_count); break;
+			case 'a': bOk = parse_list(optarg, bench.align); break;
+			case 'k': bOk = parse_list(optarg, bench.block_size); break;
+			case 'r': bOk = parse_names(optarg, reader_names, reader_values, bench.reader); break;
+			case 'L': bOk = parse_names(optarg, layout_names, layout_values, bench.layout); break;
+			case 'B': bOk = parse_names(optarg, bd_names, bd_values, bench.bd); break;
+			case 'W': bOk = parse_list(optarg, bench.window); break;
+			case 'R': bOk = parse_list(optarg, bench.read_batch); break;
+			case 'P': bOk = parse_list(optarg, bench.write_batch); break;
+			case 'p': bOk = parse_list(optarg, bench.producers); break;
+			case 'N': bOk = parse_list(optarg, bench.readers); break;
+			case OPT_LOSSY: bOk = parse_list(optarg, bench.lossy_readers); break;
+			case 'H': bOk = parse_list(optarg, bench.hops); break;
+			case 'X': bOk = parse_list(optarg, bench.pipe_workers); break;
+			case OPT_PIPE: bOk = parse_names(optarg, pipe_names, pipe_values, bench.pipe_mode); break;
+			case OPT_COPY: bOk = parse_names(optarg, copy_names, copy_values, bench.copy); break;
+			case OPT_DATA: bOk = parse_names(optarg, data_names, data_values, bench.data); break;
+			case 'c': bOk = parse_size(optarg, bench.count); break;
+			case 'l': bench.latency = true; break;
+			case 'm':
+				if (strcmp(optarg, "spin") == 0)
+					bench.blocking = false;
+				else if (strcmp(optarg, "block") == 0)
+					bench.blocking = true;
+				else
+					bOk = false;
+				break;
+			case OPT_DMA_SETUP:     bOk = parse_size(optarg, value); bench.dma_timing.setup_ns   = value; break;
+			case OPT_DMA_BANDWIDTH: bOk = parse_size(optarg, value); bench.dma_timing.bandwidth  = value; break;
+			case OPT_DMA_BURST:     bOk = parse_size(optarg, value); bench.dma_timing.burst_size = value; break;
+			case OPT_DMA_SHARED_BUS: bench.dma_shared_bus = true; break;
+			case OPT_CPUS_PRODUCER:
+			case OPT_CPUS_CONSUMER:
+			case OPT_CPUS_PIPE:
+			case OPT_CPUS_DMA:
+				bOk = place_parse_cpus(optarg, bench.placement.cpus[opt - OPT_CPUS_PRODUCER]);
+				bench.placement.bPinned[opt - OPT_CPUS_PRODUCER] = true;
+				break;
+			case OPT_MEM_NODE: bOk = place_parse_mem(optarg, bench.placement.mem_node); break;
+			case OPT_PAGES: bOk = place_parse_pages(optarg, bench.placement.pages); break;
+			case OPT_PREFAULT: bench.placement.bPrefault = true; break;
+			case OPT_MLOCK: bench.placement.bLock = true; break;
+			case 'w': bOk = parse_size(optarg, bench.warmup); break;
+			case 'n': bOk = parse_size(optarg, bench.trials); break;
+			case 'f':
+				if (strcmp(optarg, "csv") == 0)
+					bench.format = BENCH_FORMAT_CSV;
+				else if (strcmp(optarg, "json") == 0)
+					bench.format = BENCH_FORMAT_JSON;
+				else
+					bOk = false;
+				break;
+			case 'o': sOutput = optarg; break;
+			case 'h': usage(argv[0]); return 0;
+			default:  bOk = false; break;
+		}
+
+		if (bOk == false) {
+			if (opt != '?')
+				std::cerr<<"Invalid argument: "<<optarg<<std::endl;
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (sOutput != NULL) {
+		fout.open(sOutput);
+		if (!fout) {
+			std::cerr<<"Unable to open "<<sOutput<<std::endl;
+			return 1;
+		}
+	}
+
+	bOk = bench.run((sOutput != NULL) ? fout : std::cout);
+
+	return bOk ? 0 : 2;
 }
@@ -0,0 +1,542 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "fifo_shm.h"
+
+#include "placement.h"
+
+
+/* Max number of NUMA nodes a fifo can be bound to */
+#define PLACE_NODE_MAX	(1024)
+
+static const char * role_name[PLACE_ROLE_COUNT] =
+{
+	"producer",
+	"consumer",
+	"pipe",
+	"dma",
+};
+
+static const char * pages_name[PLACE_PAGES_COUNT] =
+{
+	"4k",
+	"thp",
+	"2m",
+	"1g",
+};
+
+/* Size of the transparent hugepages, the alignment of PLACE_PAGES_THP memory */
+#define PLACE_THP_SIZE	(2UL << 20)
+
+
+//---------------------------------------------------------------------------
+static SPlacement
+place_default()
+{
+	SPlacement placement;
+
+	place_init(placement);
+
+	return placement;
+}
+
+static SPlacement placement_current = place_default();
+static bool bBindWarned = false;
+static bool bHugeWarned = false;
+static bool bLockWarned = false;
+
+// Mapped size of every place_alloc, it is rounded up to the page size
+static std::map<void *, size_t> alloc_size;
+static std::mutex alloc_mutex;
+
+
+//---------------------------------------------------------------------------
+void
+place_init(SPlacement & placement)
+{
+	unsigned int i;
+
+	for (i = 0; i < PLACE_ROLE_COUNT; i++) {
+		placement.bPinned[i] = false;
+		CPU_ZERO(&placement.cpus[i]);
+	}
+	placement.mem_node = PLACE_MEM_ANY;
+
+	placement.pages = PLACE_PAGES_DEFAULT;
+	placement.bPrefault = false;
+	placement.bLock = false;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_parse_cpus(const char * sList, cpu_set_t & cpus)
+{
+	const char * s = sList;
+	char * end;
+	unsigned long first, last, cpu;
+
+	CPU_ZERO(&cpus);
+
+	// Comma separated CPUs and ranges, like 0-3,8
+	while (*s != '\0') {
+		first = strtoul(s, &end, 0);
+		if (end == s)
+			return false;
+		last = first;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtoul(s, &end, 0);
+			if ((end == s) || (last < first))
+				return false;
+		}
+		if (last >= CPU_SETSIZE)
+			return false;
+		for (cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, &cpus);
+
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s != '\0')
+			return false;
+	}
+
+	return CPU_COUNT(&cpus) > 0;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_parse_mem(const char * sName, int & mem_node)
+{
+	char * end;
+	long node;
+
+	if (strcmp(sName, "any") == 0)
+		mem_node = PLACE_MEM_ANY;
+	else if (strcmp(sName, "writer") == 0)
+		mem_node = PLACE_MEM_WRITER;
+	else if (strcmp(sName, "reader") == 0)
+		mem_node = PLACE_MEM_READER;
+	else {
+		node = strtol(sName, &end, 0);
+		if ((end == sName) || (*end != '\0') || (node < 0) || (node >= PLACE_NODE_MAX))
+			return false;
+		mem_node = (int)node;
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_parse_pages(const char * sName, EPlacePages & pages)
+{
+	unsigned int i;
+
+	for (i = 0; i < PLACE_PAGES_COUNT; i++) {
+		if (strcmp(sName, pages_name[i]) == 0) {
+			pages = (EPlacePages)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------
+void
+place_set(const SPlacement & placement)
+{
+	placement_current = placement;
+}
+
+//---------------------------------------------------------------------------
+const SPlacement &
+place_get()
+{
+	return placement_current;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_thread(EPlaceRole role)
+{
+	if (placement_current.bPinned[role] == false)
+		return true;
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &placement_current.cpus[role]) == 0;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_thread(std::thread & thr, EPlaceRole role)
+{
+	if (placement_current.bPinned[role] == false)
+		return true;
+
+	return pthread_setaffinity_np(thr.native_handle(), sizeof(cpu_set_t), &placement_current.cpus[role]) == 0;
+}
+
+//---------------------------------------------------------------------------
+static int
+place_role_node(EPlaceRole role)
+{
+	int cpu;
+
+	if (placement_current.bPinned[role] == false)
+		return PLACE_MEM_ANY;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &placement_current.cpus[role]))
+			return place_cpu_node(cpu);
+	}
+
+	return PLACE_MEM_ANY;
+}
+
+//---------------------------------------------------------------------------
+static int
+place_mem_node(EPlaceRole writer, EPlaceRole reader)
+{
+	if (placement_current.mem_node == PLACE_MEM_WRITER)
+		return place_role_node(writer);
+	if (placement_current.mem_node == PLACE_MEM_READER)
+		return place_role_node(reader);
+
+	return placement_current.mem_node;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_bind(void * p, size_t size, EPlaceRole writer, EPlaceRole reader)
+{
+	unsigned long nodemask[PLACE_NODE_MAX / (8 * sizeof(unsigned long))] = {0};
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)p & ~(page - 1);
+	int node = place_mem_node(writer, reader);
+
+	if (node < 0)
+		return true;
+
+	// Before the pages are touched, so they are allocated on the node
+	nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(SYS_mbind, start, (uintptr_t)p + size - start, MPOL_BIND, nodemask, PLACE_NODE_MAX, MPOL_MF_MOVE) != 0) {
+		if (bBindWarned == false)
+			std::cerr<<"Unable to bind fifo memory to node "<<node<<": "<<strerror(errno)<<std::endl;
+		bBindWarned = true;
+		return false;
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool
+place_prefault(void * p, size_t size)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)p & ~(page - 1);
+	volatile uint8_t * pbyte;
+	uintptr_t addr;
+
+	if (placement_current.bPrefault) {
+		// Fault in the pages writable, without changing the data. Older kernels do not know MADV_POPULATE_WRITE.
+		if (madvise((void *)start, (uintptr_t)p + size - start, MADV_POPULATE_WRITE) != 0) {
+			for (addr = start; addr < (uintptr_t)p + size; addr += page) {
+				pbyte = (volatile uint8_t *)addr;
+				*pbyte = *pbyte;
+			}
+		}
+	}
+
+	if ((placement_current.bLock) && (mlock(p, size) != 0)) {
+		if (bLockWarned == false)
+			std::cerr<<"Unable to lock fifo memory: "<<strerror(errno)<<" (see ulimit -l)"<<std::endl;
+		bLockWarned = true;
+		return false;
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+static void *
+place_map_huge(size_t & size)
+{
+	size_t page = (placement_current.pages == PLACE_PAGES_1G) ? (1UL << 30) : (1UL << 21);
+	int huge = (placement_current.pages == PLACE_PAGES_1G) ? 30 : 21;
+	void * p;
+
+	size = (size + page - 1) & ~(page - 1);
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (huge << MAP_HUGE_SHIFT), -1, 0);
+	if (p == MAP_FAILED) {
+		if (bHugeWarned == false)
+			std::cerr<<"No "<<pages_name[placement_current.pages]<<" hugepages (see vm.nr_hugepages), using transparent hugepages"<<std::endl;
+		bHugeWarned = true;
+		return NULL;
+	}
+
+	return p;
+}
+
+//---------------------------------------------------------------------------
+static void *
+place_map_thp(size_t & size)
+{
+	size_t mapped;
+	uintptr_t start, aligned;
+	void * p;
+
+	// Map more, and cut it to whole aligned hugepages
+	size = (size + PLACE_THP_SIZE - 1) & ~(PLACE_THP_SIZE - 1);
+	mapped = size + PLACE_THP_SIZE;
+	p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	start = (uintptr_t)p;
+	aligned = (start + PLACE_THP_SIZE - 1) & ~(PLACE_THP_SIZE - 1);
+	if (aligned > start)
+		munmap(p, aligned - start);
+	if (start + mapped > aligned + size)
+		munmap((void *)(aligned + size), start + mapped - aligned - size);
+
+	// Only a hint, the kernel may not support it
+	madvise((void *)aligned, size, MADV_HUGEPAGE);
+
+	return (void *)aligned;
+}
+
+//---------------------------------------------------------------------------
+void *
+place_alloc(size_t size, EPlaceRole writer, EPlaceRole reader)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	size_t mapped = size;
+	void * p = NULL;
+
+	if ((placement_current.pages == PLACE_PAGES_2M) || (placement_current.pages == PLACE_PAGES_1G))
+		p = place_map_huge(mapped);
+	if ((p == NULL) && (placement_current.pages != PLACE_PAGES_DEFAULT)) {
+		mapped = size;
+		p = place_map_thp(mapped);
+	}
+	if ((p == NULL) && (placement_current.pages == PLACE_PAGES_DEFAULT)) {
+		mapped = (size + page - 1) & ~(page - 1);
+		p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			p = NULL;
+	}
+	if (p == NULL)
+		return NULL;
+
+	// Bind before the first touch
+	place_bind(p, mapped, writer, reader);
+	place_prefault(p, mapped);
+
+	std::lock_guard<std::mutex> locker(alloc_mutex);
+	alloc_size[p] = mapped;
+
+	return p;
+}
+
+//---------------------------------------------------------------------------
+void *
+place_alloc_fifo(size_t size, unsigned int bd_count, unsigned int align, unsigned int flags, EPlaceRole writer, EPlaceRole reader)
+{
+	struct fifo_shm shm;
+	size_t mapped;
+
+	if ((flags & FIFO_FLAG_MIRROR) == 0)
+		return place_alloc(size, writer, reader);
+
+	// Shared memory, so the data ring can be mapped twice. Always 4 KiB pages.
+	if (fifo_shm_create_mirror(&shm, NULL, size, bd_count, align, flags) != 0)
+		return NULL;
+	close(shm.fd);
+	mapped = shm.size + shm.mirror;
+
+	// Bind before the first touch
+	place_bind(shm.pdata, mapped, writer, reader);
+	place_prefault(shm.pdata, mapped);
+
+	std::lock_guard<std::mutex> locker(alloc_mutex);
+	alloc_size[shm.pdata] = mapped;
+
+	return shm.pdata;
+}
+
+//---------------------------------------------------------------------------
+void
+place_free(void * p, size_t size)
+{
+	std::map<void *, size_t>::iterator it;
+
+	if (p == NULL)
+		return;
+
+	std::lock_guard<std::mutex> locker(alloc_mutex);
+	it = alloc_size.find(p);
+	if (it != alloc_size.end()) {
+		size = it->second;
+		alloc_size.erase(it);
+	}
+	munmap(p, size);
+}
+
+//---------------------------------------------------------------------------
+int
+place_shm_flags(bool bAnonymous)
+{
+	switch (placement_current.pages) {
+		case PLACE_PAGES_THP:
+			return FIFO_SHM_THP;
+		case PLACE_PAGES_2M:
+			return bAnonymous ? FIFO_SHM_HUGE_2M : FIFO_SHM_THP;
+		case PLACE_PAGES_1G:
+			return bAnonymous ? FIFO_SHM_HUGE_1G : FIFO_SHM_THP;
+		default:
+			return 0;
+	}
+}
+
+//---------------------------------------------------------------------------
+int
+place_node_count()
+{
+	DIR * dir = opendir("/sys/devices/system/node");
+	struct dirent * pent;
+	int count = 0;
+
+	if (dir == NULL)
+		return 1;
+
+	while ((pent = readdir(dir)) != NULL) {
+		if ((strncmp(pent->d_name, "node", 4) == 0) && (pent->d_name[4] >= '0') && (pent->d_name[4] <= '9'))
+			count++;
+	}
+	closedir(dir);
+
+	return (count == 0) ? 1 : count;
+}
+
+//---------------------------------------------------------------------------
+int
+place_cpu_node(int cpu)
+{
+	std::string sDir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	DIR * dir = opendir(sDir.c_str());
+	struct dirent * pent;
+	int node = 0;
+
+	if (dir == NULL)
+		return 0;
+
+	// The node is a link in the directory of the CPU
+	while ((pent = readdir(dir)) != NULL) {
+		if ((strncmp(pent->d_name, "node", 4) == 0) && (pent->d_name[4] >= '0') && (pent->d_name[4] <= '9')) {
+			node = atoi(&pent->d_name[4]);
+			break;
+		}
+	}
+	closedir(dir);
+
+	return node;
+}
+
+//---------------------------------------------------------------------------
+static std::string
+place_cpus_name(const cpu_set_t & cpus)
+{
+	std::string s;
+	int cpu, last;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus) == 0)
+			continue;
+		for (last = cpu; (last + 1 < CPU_SETSIZE) && CPU_ISSET(last + 1, &cpus); last++);
+
+		if (s.empty() == false)
+			s += ",";
+		s += std::to_string(cpu);
+		if (last > cpu)
+			s += "-" + std::to_string(last);
+		cpu = last;
+	}
+
+	return s;
+}
+
+//---------------------------------------------------------------------------
+static std::string
+place_mem_name(int mem_node)
+{
+	if (mem_node == PLACE_MEM_ANY)
+		return "any";
+	if (mem_node == PLACE_MEM_WRITER)
+		return "writer";
+	if (mem_node == PLACE_MEM_READER)
+		return "reader";
+
+	return std::to_string(mem_node);
+}
+
+//---------------------------------------------------------------------------
+static std::string
+place_node_cpus(int node)
+{
+	std::ifstream fin("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string s;
+
+	if (!std::getline(fin, s))
+		s = "0-" + std::to_string(sysconf(_SC_NPROCESSORS_ONLN) - 1);
+
+	return s;
+}
+
+//---------------------------------------------------------------------------
+void
+place_report(std::ostream & out, bool json)
+{
+	int nodes = place_node_count();
+	int node;
+	unsigned int i;
+
+	if (json) {
+		out<<"\"host\": {\"cpus\": "<<sysconf(_SC_NPROCESSORS_ONLN)<<", \"nodes\": [";
+		for (node = 0; node < nodes; node++)
+			out<<((node == 0) ? "" : ", ")<<"\""<<place_node_cpus(node)<<"\"";
+		out<<"]}, \"placement\": {";
+		for (i = 0; i < PLACE_ROLE_COUNT; i++)
+			out<<"\"cpus_"<<role_name[i]<<"\": \""<<(placement_current.bPinned[i] ? place_cpus_name(placement_current.cpus[i]) : "any")<<"\", ";
+		out<<"\"mem_node\": \""<<place_mem_name(placement_current.mem_node)<<"\", ";
+		out<<"\"pages\": \""<<pages_name[placement_current.pages]<<"\", ";
+		out<<"\"prefault\": "<<(placement_current.bPrefault ? "true" : "false")<<", ";
+		out<<"\"mlock\": "<<(placement_current.bLock ? "true" : "false")<<"}";
+	}
+	else {
+		out<<"host: "<<sysconf(_SC_NPROCESSORS_ONLN)<<" cpus, "<<nodes<<" nodes";
+		for (node = 0; node < nodes; node++)
+			out<<" node"<<node<<"="<<place_node_cpus(node);
+		out<<std::endl;
+		out<<"placement:";
+		for (i = 0; i < PLACE_ROLE_COUNT; i++)
+			out<<" "<<role_name[i]<<"="<<(placement_current.bPinned[i] ? place_cpus_name(placement_current.cpus[i]) : "any");
+		out<<" mem_node="<<place_mem_name(placement_current.mem_node);
+		out<<" pages="<<pages_name[placement_current.pages];
+		out<<" prefault="<<(placement_current.bPrefault ? "yes" : "no");
+		out<<" mlock="<<(placement_current.bLock ? "yes" : "no")<<std::endl;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+
+#include <thread>
+#include <ostream>
+#include <sched.h>
+#include <stddef.h>
+
+
+/*
+ * Threads of a test, every role can be pinned to its own set of CPUs
+ */
+enum EPlaceRole
+{
+	PLACE_PRODUCER = 0,
+	PLACE_CONSUMER,
+	PLACE_PIPE,		// CPipe threads and CPipeExecutor workers
+	PLACE_DMA,		// CDMASim threads
+	PLACE_ROLE_COUNT
+};
+
+/*
+ * NUMA node of the fifo memory: a node number, or one of these
+ */
+#define PLACE_MEM_ANY		(-1)	// where the kernel puts it (first touch)
+#define PLACE_MEM_WRITER	(-2)	// node of the first CPU of the thread writing into the fifo
+#define PLACE_MEM_READER	(-3)	// node of the first CPU of the thread reading from the fifo
+
+/*
+ * Pages of the fifo memory
+ */
+enum EPlacePages
+{
+	PLACE_PAGES_DEFAULT = 0,	// 4 KiB pages
+	PLACE_PAGES_THP,		// advise transparent hugepages, 2 MiB aligned
+	PLACE_PAGES_2M,			// hugetlb pages, THP when none are reserved
+	PLACE_PAGES_1G,
+	PLACE_PAGES_COUNT
+};
+
+struct SPlacement
+{
+	bool bPinned[PLACE_ROLE_COUNT];
+	cpu_set_t cpus[PLACE_ROLE_COUNT];
+	int mem_node;
+
+	EPlacePages pages;
+	bool bPrefault;			// fault in all pages before the test
+	bool bLock;			// mlock the fifo memory
+};
+
+
+void place_init(SPlacement & placement);
+bool place_parse_cpus(const char * sList, cpu_set_t & cpus);
+bool place_parse_mem(const char * sName, int & mem_node);
+bool place_parse_pages(const char * sName, EPlacePages & pages);
+
+// Placement used by all threads and fifos from now on
+void place_set(const SPlacement & placement);
+const SPlacement & place_get();
+
+// Pin the calling thread, or another thread, to the CPUs of its role. Does nothing when the role is not pinned.
+bool place_thread(EPlaceRole role);
+bool place_thread(std::thread & thr, EPlaceRole role);
+
+// Memory for a fifo between a writer and reader thread, page aligned, bound, prefaulted and locked
+void * place_alloc(size_t size, EPlaceRole writer, EPlaceRole reader);
+void place_free(void * p, size_t size);
+bool place_bind(void * p, size_t size, EPlaceRole writer, EPlaceRole reader);
+bool place_prefault(void * p, size_t size);
+
+// Memory for a fifo created with these arguments, mapped twice for FIFO_FLAG_MIRROR
+void * place_alloc_fifo(size_t size, unsigned int bd_count, unsigned int align, unsigned int flags, EPlaceRole writer, EPlaceRole reader);
+
+// fifo_shm_create_flags flags for shared fifo memory
+int place_shm_flags(bool bAnonymous);
+
+int place_node_count();
+int place_cpu_node(int cpu);
+void place_report(std::ostream & out, bool json);
+
+
+#endif // PLACEMENT_H
@@ -1,6 +1,7 @@
 #include "fifo.h"
 #include "fifo_reader.h"
 #include "fifo_writer.h"
+#include "fifo_wait.h"
 
 #include "testcommon.h"
 
@@ -19,7 +20,7 @@
 
 //---------------------------------------------------------------------------
 void
-test01()
+test01(const struct test_config * pcfg, struct test_result * pres)
 {
 	uint8_t			*databuffer;		// fifo data
 	struct fifo		fifo;			// fifo object
@@ -29,17 +30,25 @@ test01()
 	struct testproducer	prod;
 
 	// Init fifo
-	databuffer = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo, databuffer, FIFO_SIZE, FIFO_BD_COUNT, 16);
+	databuffer = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_CONSUMER);
+	if (databuffer == NULL) {
+		test_result_error(pres, "no memory for the fifo");
+		return;
+	}
+	fifo_init_create(&fifo, databuffer, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
 	fifo_writer_init(&fifo_writer, &fifo);
 	fifo_reader_init(&fifo_reader, &fifo);
 
+	// Wake the producer and consumer when they are sleeping
+	fifo_writer_set_wakeup_handler(&fifo_writer, fifo_wait_wakeup_reader, &fifo);
+	fifo_reader_set_wakeup_handler(&fifo_reader, fifo_wait_wakeup_writer, &fifo);
+
 	// Init test
-	testproducer_init(&prod, &fifo_writer, TEST_COUNT);
-	testconsumer_init(&cons, &fifo_reader, TEST_COUNT);
+	testproducer_init(&prod, &fifo_writer, pcfg->count);
+	testconsumer_init(&cons, &fifo_reader, pcfg->count);
 
-	run_test(&prod, &cons);
+	run_test(pcfg, &prod, &cons, pres);
 
 	// Cleanup
-	delete[] databuffer;
+	place_free(databuffer, pcfg->fifo_size);
 }
@@ -4,6 +4,7 @@
 #include "fifo_reader.h"
 #include "fifo_writer.h"
 #include "fifo_pipe.h"
+#include "fifo_wait.h"
 
 #include "testcommon.h"
 #include "cdmasim.h"
@@ -26,22 +27,9 @@
  */
 
 
-//---------------------------------------------------------------------------
-static void fifo_pipe_transfer_async_complete(void * arg)
-{
-	struct fifo_pipe_transfer *ptransfer = (struct fifo_pipe_transfer *)arg;
-	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
-}
-
-//---------------------------------------------------------------------------
-static void fifo_pipe_transfer_async(struct fifo_pipe_transfer *ptransfer)
-{
-	dma_ee.put(ptransfer->dst, ptransfer->src, ptransfer->size, fifo_pipe_transfer_async_complete, ptransfer);
-}
-
 //---------------------------------------------------------------------------
 void
-test02()
+test02(const struct test_config * pcfg, struct test_result * pres)
 {
 	uint8_t			*databuffer1;		// fifo data
 	struct fifo		fifo1;			// fifo object
@@ -58,35 +46,58 @@ test02()
 	struct testconsumer	cons;
 	struct testproducer	prod;
 
+	// Allocate the fifos
+	databuffer1 = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_PIPE);
+	databuffer2 = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PIPE, PLACE_CONSUMER);
+	if ((databuffer1 == NULL) || (databuffer2 == NULL)) {
+		place_free(databuffer2, pcfg->fifo_size);
+		place_free(databuffer1, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fifos");
+		return;
+	}
+
 	// Init fifo 1
-	databuffer1 = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo1, databuffer1, FIFO_SIZE, FIFO_BD_COUNT, 16);
+	fifo_init_create(&fifo1, databuffer1, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
 	fifo_writer_init(&fifo1_writer, &fifo1);
 	fifo_reader_init(&fifo1_reader, &fifo1);
 
 	// Init fifo 2
-	databuffer2 = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo2, databuffer2, FIFO_SIZE, FIFO_BD_COUNT, 16);
+	fifo_init_create(&fifo2, databuffer2, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
 	fifo_writer_init(&fifo2_writer, &fifo2);
 	fifo_reader_init(&fifo2_reader, &fifo2);
 
 	// Init fifo pipe 12
-	fifo_pipe_init(&fifo_pipe12, &fifo1_reader, &fifo2_writer);
-	fifo_pipe12.fp_transfer = fifo_pipe_transfer_async;
+	if (fifo_pipe_init(&fifo_pipe12, &fifo1_reader, &fifo2_writer) != 0) {
+		fifo_pipe_deinit(&fifo_pipe12);
+		place_free(databuffer1, pcfg->fifo_size);
+		place_free(databuffer2, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the pipe");
+		return;
+	}
+	fifo_pipe_set_window(&fifo_pipe12, pcfg->pipe_window);
+	fifo_pipe12.fp_transfer = cdmasim_transfer_ee;
 
 	// Create and hookup thread for pipe 12
 	CPipe cpipe12("Pipe12", &fifo_pipe12);
 	fifo_writer_set_wakeup_handler(&fifo1_writer, CPipe::wakeup, &cpipe12);
 	fifo_reader_set_wakeup_handler(&fifo2_reader, CPipe::wakeup, &cpipe12);
+	fifo_pipe_set_wakeup_handler(&fifo_pipe12, CPipe::wakeup, &cpipe12);
+
+	// Wake the producer and consumer when they are sleeping
+	fifo_reader_set_wakeup_handler(&fifo1_reader, fifo_wait_wakeup_writer, &fifo1);
+	fifo_writer_set_wakeup_handler(&fifo2_writer, fifo_wait_wakeup_reader, &fifo2);
 
 	// Init test
-	testproducer_init(&prod, &fifo1_writer, TEST_COUNT);
-	testconsumer_init(&cons, &fifo2_reader, TEST_COUNT);
+	testproducer_init(&prod, &fifo1_writer, pcfg->count);
+	testconsumer_init(&cons, &fifo2_reader, pcfg->count);
 
 	// Run the test
-	run_test(&prod, &cons);
-
-	// Cleanup
-	delete[] databuffer1;
-	delete[] databuffer2;
+	run_test(pcfg, &prod, &cons, pres);
+
+	// Cleanup: stop the pipe, and wait for the DMA transfers it started
+	cpipe12.stop();
+	dma_ee.sync();
+	fifo_pipe_deinit(&fifo_pipe12);
+	place_free(databuffer1, pcfg->fifo_size);
+	place_free(databuffer2, pcfg->fifo_size);
 }
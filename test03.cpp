@@ -4,6 +4,7 @@
 #include "fifo_reader.h"
 #include "fifo_writer.h"
 #include "fifo_pipe.h"
+#include "fifo_wait.h"
 
 #include "testcommon.h"
 #include "cdmasim.h"
@@ -33,28 +34,9 @@
  */
 
 
-//---------------------------------------------------------------------------
-static void dma_transfer_complete(void * arg)
-{
-	struct fifo_pipe_transfer *ptransfer = (struct fifo_pipe_transfer *)arg;
-	fifo_pipe_transfer_commit(ptransfer->ppipe, ptransfer);
-}
-
-//---------------------------------------------------------------------------
-static void dma_transfer_ee(struct fifo_pipe_transfer *ptransfer)
-{
-	dma_ee.put(ptransfer->dst, ptransfer->src, ptransfer->size, dma_transfer_complete, ptransfer);
-}
-
-//---------------------------------------------------------------------------
-static void dma_transfer_iop(struct fifo_pipe_transfer *ptransfer)
-{
-	dma_iop.put(ptransfer->dst, ptransfer->src, ptransfer->size, dma_transfer_complete, ptransfer);
-}
-
 //---------------------------------------------------------------------------
 void
-test03()
+test03(const struct test_config * pcfg, struct test_result * pres)
 {
 	uint8_t			*databuffer1;		// fifo data
 	struct fifo		fifo1;			// fifo object
@@ -78,51 +60,85 @@ test03()
 	struct testconsumer	cons;
 	struct testproducer	prod;
 
+	// Allocate the fifos
+	databuffer1 = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_PIPE);
+	databuffer2 = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PIPE, PLACE_PIPE);
+	databuffer3 = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PIPE, PLACE_CONSUMER);
+	if ((databuffer1 == NULL) || (databuffer2 == NULL) || (databuffer3 == NULL)) {
+		place_free(databuffer3, pcfg->fifo_size);
+		place_free(databuffer2, pcfg->fifo_size);
+		place_free(databuffer1, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fifos");
+		return;
+	}
+
 	// Init fifo 1
-	databuffer1 = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo1, databuffer1, FIFO_SIZE, FIFO_BD_COUNT, 16);
+	fifo_init_create(&fifo1, databuffer1, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
 	fifo_writer_init(&fifo1_writer, &fifo1);
 	fifo_reader_init(&fifo1_reader, &fifo1);
 
 	// Init fifo 2
-	databuffer2 = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo2, databuffer2, FIFO_SIZE, FIFO_BD_COUNT, 16);
+	fifo_init_create(&fifo2, databuffer2, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
 	fifo_writer_init(&fifo2_writer, &fifo2);
 	fifo_reader_init(&fifo2_reader, &fifo2);
 
-	// Init fifo pipe 12
-	fifo_pipe_init(&fifo_pipe12, &fifo1_reader, &fifo2_writer);
-	fifo_pipe12.fp_transfer = dma_transfer_ee;
+	// Init fifo 3
+	fifo_init_create(&fifo3, databuffer3, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+	fifo_writer_init(&fifo3_writer, &fifo3);
+	fifo_reader_init(&fifo3_reader, &fifo3);
+
+	// Init the fifo pipes, before any pipe thread is started
+	int pipe12_err = fifo_pipe_init(&fifo_pipe12, &fifo1_reader, &fifo2_writer);
+	int pipe23_err = fifo_pipe_init(&fifo_pipe23, &fifo2_reader, &fifo3_writer);
+	if ((pipe12_err != 0) || (pipe23_err != 0)) {
+		fifo_pipe_deinit(&fifo_pipe12);
+		fifo_pipe_deinit(&fifo_pipe23);
+		place_free(databuffer1, pcfg->fifo_size);
+		place_free(databuffer2, pcfg->fifo_size);
+		place_free(databuffer3, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the pipes");
+		return;
+	}
+
+	// Setup fifo pipe 12
+	fifo_pipe_set_window(&fifo_pipe12, pcfg->pipe_window);
+	fifo_pipe12.fp_transfer = cdmasim_transfer_ee;
 
 	// Create and hookup thread for pipe 12
 	CPipe cpipe12("Pipe12", &fifo_pipe12);
 	fifo_writer_set_wakeup_handler(&fifo1_writer, CPipe::wakeup, &cpipe12);
 	fifo_reader_set_wakeup_handler(&fifo2_reader, CPipe::wakeup, &cpipe12);
+	fifo_pipe_set_wakeup_handler(&fifo_pipe12, CPipe::wakeup, &cpipe12);
 
-	// Init fifo 3
-	databuffer3 = new uint8_t[FIFO_SIZE];
-	fifo_init_create(&fifo3, databuffer3, FIFO_SIZE, FIFO_BD_COUNT, 16);
-	fifo_writer_init(&fifo3_writer, &fifo3);
-	fifo_reader_init(&fifo3_reader, &fifo3);
-
-	// Init fifo pipe 23
-	fifo_pipe_init(&fifo_pipe23, &fifo2_reader, &fifo3_writer);
-	fifo_pipe23.fp_transfer = dma_transfer_iop;
+	// Setup fifo pipe 23
+	fifo_pipe_set_window(&fifo_pipe23, pcfg->pipe_window);
+	fifo_pipe23.fp_transfer = cdmasim_transfer_iop;
 
 	// Create and hookup thread for pipe 23
 	CPipe cpipe23("Pipe23", &fifo_pipe23);
 	fifo_writer_set_wakeup_handler(&fifo2_writer, CPipe::wakeup, &cpipe23);
 	fifo_reader_set_wakeup_handler(&fifo3_reader, CPipe::wakeup, &cpipe23);
+	fifo_pipe_set_wakeup_handler(&fifo_pipe23, CPipe::wakeup, &cpipe23);
+
+	// Wake the producer and consumer when they are sleeping
+	fifo_reader_set_wakeup_handler(&fifo1_reader, fifo_wait_wakeup_writer, &fifo1);
+	fifo_writer_set_wakeup_handler(&fifo3_writer, fifo_wait_wakeup_reader, &fifo3);
 
 	// Init test
-	testproducer_init(&prod, &fifo1_writer, TEST_COUNT);
-	testconsumer_init(&cons, &fifo3_reader, TEST_COUNT);
+	testproducer_init(&prod, &fifo1_writer, pcfg->count);
+	testconsumer_init(&cons, &fifo3_reader, pcfg->count);
 
 	// Run the test
-	run_test(&prod, &cons);
-
-	// Cleanup
-	delete[] databuffer1;
-	delete[] databuffer2;
-	delete[] databuffer3;
+	run_test(pcfg, &prod, &cons, pres);
+
+	// Cleanup: stop the pipes, and wait for the DMA transfers they started
+	cpipe12.stop();
+	cpipe23.stop();
+	dma_ee.sync();
+	dma_iop.sync();
+	fifo_pipe_deinit(&fifo_pipe12);
+	fifo_pipe_deinit(&fifo_pipe23);
+	place_free(databuffer1, pcfg->fifo_size);
+	place_free(databuffer2, pcfg->fifo_size);
+	place_free(databuffer3, pcfg->fifo_size);
 }
@@ -0,0 +1,192 @@
+#include <iostream>
+#include <string>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_wait.h"
+#include "fifo_shm.h"
+
+#include "testcommon.h"
+
+
+/*
+ * Test 04: Simple test with one fifo, shared between two processes
+ *
+ * Datapath in this test:
+ * child process:
+ *   1 - prod			(testproducer)	process producing data
+ *   2 - fifo_writer		(fifo_writer)	connected with fifo_init_connect
+ * shared memory:
+ *   3 - fifo			(fifo)
+ * this process:
+ *   4 - fifo_reader		(fifo_reader)	created with fifo_init_create
+ *   5 - cons			(testconsumer)	thread consuming data
+ *
+ * The child process is this program started again with TEST04_PRODUCER_OPTION,
+ * not a fork: the DMA threads already run when the test starts. It gets the
+ * test_config and placement through a pipe.
+ */
+
+extern char **environ;
+
+
+//---------------------------------------------------------------------------
+int
+test04_producer_main(int argc, char * argv[])
+{
+	struct fifo_shm		shm;			// shared memory
+	struct fifo		fifo;			// fifo object
+	struct fifo_writer	fifo_writer;		// fifo writer object
+	struct testproducer	prod;
+	struct test_config	cfg;
+	SPlacement		placement;
+	int			fdConfig, fdReady;
+	char			ready = 1;
+
+	// Arguments: TEST04_PRODUCER_OPTION name fdConfig fdReady
+	if (argc != 5)
+		return 1;
+	fdConfig = atoi(argv[3]);
+	fdReady = atoi(argv[4]);
+
+	// Same binary, the structs can be sent as they are
+	if ((read(fdConfig, &cfg, sizeof(cfg)) != sizeof(cfg)) || (read(fdConfig, &placement, sizeof(placement)) != sizeof(placement)))
+		return 1;
+	close(fdConfig);
+	place_set(placement);
+
+	// Map the fifo created by the other process
+	if (fifo_shm_open(&shm, argv[2]) != 0)
+		return 1;
+	place_prefault(shm.pdata, shm.size + shm.mirror);
+	fifo_init_connect(&fifo, shm.pdata);
+	fifo_writer_init(&fifo_writer, &fifo);
+
+	// Wake the consumer when it is sleeping
+	fifo_writer_set_wakeup_handler(&fifo_writer, fifo_wait_wakeup_reader, &fifo);
+
+	// Tell the other process we are ready to start
+	if (write(fdReady, &ready, 1) != 1) {
+		fifo_shm_close(&shm);
+		return 1;
+	}
+	close(fdReady);
+
+	testproducer_init(&prod, &fifo_writer, cfg.count);
+	run_test_producer(&cfg, &prod);
+
+	fifo_shm_close(&shm);
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+static pid_t
+test04_spawn_producer(const struct test_config * pcfg, const char * sName, int fdReady[2])
+{
+	posix_spawn_file_actions_t actions;
+	std::string sConfig, sReady;
+	char * argv[6];
+	int fdConfig[2];
+	pid_t pid = -1;
+
+	if (pipe(fdConfig) != 0)
+		return -1;
+
+	// The config fits in the pipe, send it before the child exists
+	if ((write(fdConfig[1], pcfg, sizeof(*pcfg)) == sizeof(*pcfg)) && (write(fdConfig[1], &place_get(), sizeof(SPlacement)) == sizeof(SPlacement))) {
+		sConfig = std::to_string(fdConfig[0]);
+		sReady = std::to_string(fdReady[1]);
+		argv[0] = (char *)"/proc/self/exe";
+		argv[1] = (char *)TEST04_PRODUCER_OPTION;
+		argv[2] = (char *)sName;
+		argv[3] = (char *)sConfig.c_str();
+		argv[4] = (char *)sReady.c_str();
+		argv[5] = NULL;
+
+		// The child only keeps its ends of the pipes
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_addclose(&actions, fdConfig[1]);
+		posix_spawn_file_actions_addclose(&actions, fdReady[0]);
+		if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0)
+			pid = -1;
+		posix_spawn_file_actions_destroy(&actions);
+	}
+
+	close(fdConfig[0]);
+	close(fdConfig[1]);
+	return pid;
+}
+
+//---------------------------------------------------------------------------
+void
+test04(const struct test_config * pcfg, struct test_result * pres)
+{
+	struct fifo_shm		shm;			// shared memory
+	struct fifo		fifo;			// fifo object
+	struct fifo_reader	fifo_reader;		// fifo reader object
+	struct testconsumer	cons;
+	int			created;
+	std::string		sName = "/datafifo-test04-" + std::to_string(getpid());
+	int			fdReady[2];
+	char			ready = 0;
+	int			status;
+	pid_t			pid;
+
+	pres->time_ns = pres->bytes = pres->blocks = 0;
+	pres->error = true;
+	testlatency_init(&pres->latency);
+
+	// Init fifo in shared memory, a mirrored fifo maps its data ring twice
+	if (pcfg->fifo_flags & FIFO_FLAG_MIRROR)
+		created = fifo_shm_create_mirror(&shm, sName.c_str(), pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+	else
+		created = fifo_shm_create_flags(&shm, sName.c_str(), pcfg->fifo_size, place_shm_flags(false));
+	if (created != 0) {
+		std::cerr<<"Unable to create shared memory "<<sName<<std::endl;
+		return;
+	}
+	place_bind(shm.pdata, shm.size + shm.mirror, PLACE_PRODUCER, PLACE_CONSUMER);
+	place_prefault(shm.pdata, shm.size + shm.mirror);
+	fifo_init_create(&fifo, shm.pdata, shm.size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+	fifo_reader_init(&fifo_reader, &fifo);
+
+	// Wake the producer when it is sleeping
+	fifo_reader_set_wakeup_handler(&fifo_reader, fifo_wait_wakeup_writer, &fifo);
+
+	// Start the producer process
+	if (pipe(fdReady) != 0) {
+		fifo_shm_close(&shm);
+		fifo_shm_unlink(sName.c_str());
+		return;
+	}
+	pid = test04_spawn_producer(pcfg, sName.c_str(), fdReady);
+	close(fdReady[1]);
+
+	if ((pid > 0) && (read(fdReady[0], &ready, 1) == 1) && (ready == 1)) {
+		// Init test
+		testconsumer_init(&cons, &fifo_reader, pcfg->count);
+
+		run_test(pcfg, NULL, &cons, pres);
+	}
+	else {
+		std::cerr<<"Unable to start the producer process"<<std::endl;
+	}
+	close(fdReady[0]);
+
+	// Cleanup: the producer never stops by itself when the consumer failed
+	if (pid > 0) {
+		if (pres->error)
+			kill(pid, SIGKILL);
+		if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+			pres->error = true;
+	}
+	fifo_shm_close(&shm);
+	fifo_shm_unlink(sName.c_str());
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <new>
+
+#include "datafifo.h"
+#include "fifo_wait.h"
+
+#include "testcommon.h"
+#include "cdmasim.h"
+#include "cpipe.h"
+
+
+/*
+ * Test 05: Same as test 02, with the geometry of the fifos fixed at compile time
+ *
+ * Datapath in this test:
+ *   1 - prod			(testproducer)	thread producing data
+ *   2 - fifo1_writer		(datafifo::writer)
+ *   3 - fifo1			(datafifo::fifo)
+ *   4 - fifo1_reader		(datafifo::reader)
+ *   5 - pipe12			(datafifo::pipe)	thread kicking DMA controller
+ *   6 - fifo2_writer		(datafifo::writer)
+ *   7 - fifo2			(datafifo::fifo)
+ *   8 - fifo2_reader		(datafifo::reader)
+ *   9 - cons			(testconsumer)	thread consuming data
+ *
+ * The producer and consumer use the C functions on the same fifos.
+ */
+
+typedef datafifo::fifo<FIFO_SIZE, FIFO_BD_COUNT, 16> test05_fifo;
+typedef datafifo::pipe<test05_fifo, test05_fifo> test05_pipe;
+
+
+//---------------------------------------------------------------------------
+static void test05_transfer_async_complete(void * arg)
+{
+	test05_pipe::commit((struct fifo_pipe_transfer *)arg);
+}
+
+//---------------------------------------------------------------------------
+static void test05_transfer_async(struct fifo_pipe_transfer *ptransfer)
+{
+	cdmasim_transfer(dma_ee, ptransfer, test05_transfer_async_complete);
+}
+
+//---------------------------------------------------------------------------
+const char *
+test05_check(const struct test_config * pcfg)
+{
+	if (test_check_point_to_point(pcfg) != NULL)
+		return test_check_point_to_point(pcfg);
+	if ((pcfg->fifo_size != test05_fifo::size) || (pcfg->bd_count != test05_fifo::bd_count) ||
+	    (pcfg->align != test05_fifo::align) || (pcfg->fifo_flags != test05_fifo::flags))
+		return "only the geometry fixed at compile time (default fifo_size, bd_count, align, reader, layout and bd)";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+void
+test05(const struct test_config * pcfg, struct test_result * pres)
+{
+	void				*pmem1 = place_alloc(sizeof(test05_fifo), PLACE_PRODUCER, PLACE_PIPE);
+	void				*pmem2 = place_alloc(sizeof(test05_fifo), PLACE_PIPE, PLACE_CONSUMER);
+
+	if ((pmem1 == NULL) || (pmem2 == NULL)) {
+		place_free(pmem2, sizeof(test05_fifo));
+		place_free(pmem1, sizeof(test05_fifo));
+		test_result_error(pres, "no memory for the fifos");
+		return;
+	}
+
+	test05_fifo			*pfifo1 = new (pmem1) test05_fifo;
+	datafifo::writer<test05_fifo>	fifo1_writer(*pfifo1);
+	datafifo::reader<test05_fifo>	fifo1_reader(*pfifo1);
+
+	test05_fifo			*pfifo2 = new (pmem2) test05_fifo;
+	datafifo::writer<test05_fifo>	fifo2_writer(*pfifo2);
+	datafifo::reader<test05_fifo>	fifo2_reader(*pfifo2);
+
+	struct testconsumer	cons;
+	struct testproducer	prod;
+
+	{
+		// Init pipe 12
+		test05_pipe pipe12(fifo1_reader, fifo2_writer);
+		if (pipe12.is_valid() == false)
+			test_result_error(pres, "no memory for the pipe");
+		else {
+			pipe12.set_window(pcfg->pipe_window);
+			pipe12.set_transfer(test05_transfer_async);
+
+			// Create and hookup thread for pipe 12
+			CPipe cpipe12("Pipe12", pipe12.native(), test05_pipe::transfer);
+			fifo1_writer.set_wakeup_handler(CPipe::wakeup, &cpipe12);
+			fifo2_reader.set_wakeup_handler(CPipe::wakeup, &cpipe12);
+			pipe12.set_wakeup_handler(CPipe::wakeup, &cpipe12);
+
+			// Wake the producer and consumer when they are sleeping
+			fifo1_reader.set_wakeup_handler(fifo_wait_wakeup_writer, pfifo1->native());
+			fifo2_writer.set_wakeup_handler(fifo_wait_wakeup_reader, pfifo2->native());
+
+			// Init test
+			testproducer_init(&prod, fifo1_writer.native(), pcfg->count);
+			testconsumer_init(&cons, fifo2_reader.native(), pcfg->count);
+
+			// Run the test
+			run_test(pcfg, &prod, &cons, pres);
+
+			// Cleanup: stop the pipe, and wait for the DMA transfers it started
+			cpipe12.stop();
+			dma_ee.sync();
+		}
+	}
+
+	pfifo1->~test05_fifo();
+	pfifo2->~test05_fifo();
+	place_free(pfifo1, sizeof(test05_fifo));
+	place_free(pfifo2, sizeof(test05_fifo));
+}
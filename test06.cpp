@@ -0,0 +1,168 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string.h>
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_mpsc.h"
+#include "fifo_wait.h"
+
+#include "testcommon.h"
+
+
+/*
+ * Test 06: Many producers writing into one fifo
+ *
+ * Datapath in this test:
+ *   1 - prod[0..N-1]		(test06_producer)	threads producing data
+ *   2 - fifo_mpsc		(fifo_mpsc)
+ *   3 - fifo			(fifo)
+ *   4 - fifo_reader		(fifo_reader)
+ *   5 - cons			(testconsumer)	thread consuming data
+ *
+ * The consumer checks the same incrementing numbers as in the other tests.
+ * Every block has the same size, so the numbers in a block follow from the
+ * sequence number of its reservation. The reader gets the blocks in that
+ * order, whatever producer wrote them.
+ */
+
+#define TEST06_WAIT_TIMEOUT_NS	(100*1000*1000)
+
+struct test06_producer
+{
+	struct fifo_mpsc *pmpsc;
+	unsigned int count32;
+	unsigned int block_size;
+	bool timestamp;
+	enum testdata_mode data;
+	bool blocking;
+	std::atomic<bool> *pbStop;
+	unsigned int wait_spin;
+};
+
+
+//---------------------------------------------------------------------------
+static void
+test06_produce(struct test06_producer * pprod)
+{
+	uint32_t *block;
+	uint32_t seq;
+	uint32_t start32;
+	unsigned int size32 = pprod->block_size / sizeof(uint32_t);
+	uint64_t stamp;
+
+	place_thread(PLACE_PRODUCER);
+
+	while (pprod->pbStop->load(std::memory_order_relaxed) == false) {
+		block = (uint32_t *)fifo_mpsc_reserve(pprod->pmpsc, pprod->block_size, &seq);
+		if (block == NULL) {
+			if (pprod->blocking)
+				fifo_mpsc_wait_free(pprod->pmpsc, &pprod->wait_spin, pprod->block_size, TEST06_WAIT_TIMEOUT_NS);
+			else
+				cpu_relax();
+			continue;
+		}
+
+		// Write to data block, the blocks after the end are only committed
+		start32 = seq * size32;
+		if (start32 < pprod->count32)
+			testdata_fill(pprod->data, block, (pprod->count32 - start32 < size32) ? (pprod->count32 - start32) : size32, start32);
+
+		// Timestamp as late as possible
+		if (pprod->timestamp) {
+			stamp = testlatency_now();
+			memcpy(block, &stamp, sizeof(stamp)); // block may only be 32bit aligned
+		}
+
+		// Notify reader of new data
+		fifo_mpsc_commit(pprod->pmpsc, seq, block, pprod->block_size);
+		fifo_mpsc_wakeup_reader(pprod->pmpsc, 0);
+
+		if (start32 + size32 >= pprod->count32)
+			break;
+	}
+
+	// Force wakeup signal to the reader
+	fifo_mpsc_wakeup_reader(pprod->pmpsc, 1);
+}
+
+//---------------------------------------------------------------------------
+const char *
+test06_check(const struct test_config * pcfg)
+{
+	if ((pcfg->fifo_flags & FIFO_FLAG_READER_CURSOR) == 0)
+		return "needs the reader cursor (reader=cursor)";
+	if (pcfg->producers == 0)
+		return "needs at least one producer";
+	if (pcfg->write_batch != 0)
+		return "write_batch not supported";
+	if ((pcfg->readers != 1) || (pcfg->lossy_readers != 0))
+		return "only one reader";
+	if ((pcfg->hops != 1) || (pcfg->pipe_workers != 0) || (pcfg->pipe_mode != FIFO_PIPE_COPY))
+		return "hops, workers and handoff only for the chain";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+void
+test06(const struct test_config * pcfg, struct test_result * pres)
+{
+	uint8_t			*databuffer;		// fifo data
+	struct fifo		fifo;			// fifo object
+	struct fifo_mpsc	fifo_mpsc;		// fifo writer object, shared by all producers
+	struct fifo_reader	fifo_reader;		// fifo reader object
+	struct testconsumer	cons;
+	std::vector<struct test06_producer> prod(pcfg->producers);
+	std::vector<std::thread> tProd;
+	std::atomic<bool>	bStop(false);
+	unsigned int		block_size;
+	unsigned int		i;
+
+	// Init fifo
+	databuffer = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_CONSUMER);
+	if (databuffer == NULL) {
+		test_result_error(pres, "no memory for the fifo");
+		return;
+	}
+	fifo_init_create(&fifo, databuffer, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+	fifo_mpsc_init(&fifo_mpsc, &fifo);
+	fifo_reader_init(&fifo_reader, &fifo);
+
+	// Wake the producers and consumer when they are sleeping
+	fifo_mpsc_set_wakeup_handler(&fifo_mpsc, fifo_wait_wakeup_reader, &fifo);
+	fifo_reader_set_wakeup_handler(&fifo_reader, fifo_wait_wakeup_writers, &fifo);
+
+	// All blocks have the same size
+	block_size = pcfg->block_size;
+	if (block_size > fifo_mpsc_get_block_max_size(&fifo_mpsc))
+		block_size = fifo_mpsc_get_block_max_size(&fifo_mpsc);
+	block_size &= ~3;
+
+	// Init test
+	testconsumer_init(&cons, &fifo_reader, pcfg->count);
+	for (i = 0; i < pcfg->producers; i++) {
+		prod[i].pmpsc = &fifo_mpsc;
+		prod[i].count32 = pcfg->count / 4;
+		prod[i].block_size = block_size;
+		prod[i].timestamp = pcfg->latency;
+		prod[i].data = pcfg->data;
+		prod[i].blocking = pcfg->blocking;
+		prod[i].pbStop = &bStop;
+		prod[i].wait_spin = 0;
+	}
+
+	// Run the test, the producers run next to it
+	for (i = 0; i < pcfg->producers; i++)
+		tProd.push_back(std::thread(test06_produce, &prod[i]));
+	run_test(pcfg, NULL, &cons, pres);
+
+	// Cleanup: the producers may be waiting for space the consumer never frees
+	bStop = true;
+	for (i = 0; i < pcfg->producers; i++)
+		tProd[i].join();
+
+	place_free(databuffer, pcfg->fifo_size);
+}
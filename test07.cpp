@@ -0,0 +1,212 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_wait.h"
+
+#include "testcommon.h"
+
+
+/*
+ * Test 07: One producer, broadcast to many consumers through one fifo
+ *
+ * Datapath in this test:
+ *   1 - prod			(testproducer)	thread producing data
+ *   2 - fifo_writer		(fifo_writer)
+ *   3 - fifo			(fifo)		broadcast, a slot per reader
+ *   4 - fifo_reader[0..N-1]	(fifo_reader)	lossless
+ *   5 - cons[0..N-1]		(testconsumer)	threads consuming all data
+ * and optionally:
+ *   6 - fifo_reader[N..]	(fifo_reader)	lossy
+ *   7 - monitor		(test07_monitor)	threads checking what they get
+ *
+ * The time is measured by consumer 0, the writer waits for the slowest one.
+ */
+
+#define TEST07_WAIT_TIMEOUT_NS	(100*1000*1000)
+
+struct test07_monitor
+{
+	struct fifo_reader reader;
+	unsigned int count32;
+	unsigned int skip32;		// timestamp at the start of every block
+	enum testdata_mode data;	// how the producer wrote the numbers
+	bool blocking;
+	std::atomic<bool> *pbStop;
+	unsigned int blocks;
+	unsigned int lost;
+	bool error;
+};
+
+
+//---------------------------------------------------------------------------
+static void
+test07_consume(struct testconsumer * pcons, bool blocking, std::atomic<bool> * pbStop)
+{
+	place_thread(PLACE_CONSUMER);
+
+	while ((testconsumer_done(pcons) == 0) && (pbStop->load(std::memory_order_relaxed) == false)) {
+		testconsumer_consume(pcons);
+		if (testconsumer_error(pcons) != 0) {
+			// Do not hold back the others
+			fifo_reader_detach(pcons->preader);
+			break;
+		}
+		if ((blocking) && (testconsumer_done(pcons) == 0))
+			fifo_reader_wait(pcons->preader, TEST07_WAIT_TIMEOUT_NS);
+	}
+}
+
+//---------------------------------------------------------------------------
+static void
+test07_monitor(struct test07_monitor * pmon)
+{
+	uint32_t *block;
+	unsigned int size;
+	unsigned int size32;
+	uint32_t seq;
+	unsigned int lost;
+	bool bad;
+
+	place_thread(PLACE_CONSUMER);
+
+	while (pmon->pbStop->load(std::memory_order_relaxed) == false) {
+		size = fifo_reader_get(&pmon->reader, (void **)&block);
+		if (size < sizeof(uint32_t)) {
+			if (pmon->blocking)
+				fifo_reader_wait(&pmon->reader, TEST07_WAIT_TIMEOUT_NS);
+			else
+				cpu_relax();
+			continue;
+		}
+		fifo_reader_claim(&pmon->reader, 1, size);
+
+		// The numbers in a block increment from its first one, up to the end of the data
+		bad = false;
+		if (block[pmon->skip32] < pmon->count32) {
+			seq = block[pmon->skip32] - pmon->skip32;
+			size32 = size / sizeof(uint32_t);
+			if (size32 > pmon->count32 - seq)
+				size32 = pmon->count32 - seq;
+			bad = (testdata_check(pmon->data, block, size32, seq, pmon->skip32) == 0);
+		}
+
+		// Only when the writer did not overwrite it, the block must be right
+		lost = fifo_reader_sync(&pmon->reader);
+		if (lost != 0) {
+			pmon->lost += lost;
+			continue;
+		}
+		if (bad)
+			pmon->error = true;
+
+		fifo_reader_free(&pmon->reader);
+		pmon->blocks++;
+	}
+}
+
+//---------------------------------------------------------------------------
+const char *
+test07_check(const struct test_config * pcfg)
+{
+	struct test_config cfg = *pcfg;
+
+	if (pcfg->producers != 1)
+		return "only one producer";
+	if (pcfg->readers == 0)
+		return "needs at least one lossless reader";
+	if (pcfg->readers + pcfg->lossy_readers > fifo_reader_count(FIFO_FLAG_BROADCAST_MASK))
+		return "too many readers";
+	if ((pcfg->hops != 1) || (pcfg->pipe_workers != 0) || (pcfg->pipe_mode != FIFO_PIPE_COPY))
+		return "hops, workers and handoff only for the chain";
+
+	// The slots make the header bigger
+	cfg.fifo_flags |= FIFO_FLAG_BROADCAST(pcfg->readers + pcfg->lossy_readers);
+	return test_config_check(&cfg);
+}
+
+//---------------------------------------------------------------------------
+void
+test07(const struct test_config * pcfg, struct test_result * pres)
+{
+	uint8_t			*databuffer;		// fifo data
+	struct fifo		fifo;			// fifo object
+	struct fifo_writer	fifo_writer;		// fifo writer object
+	std::vector<struct fifo_reader> fifo_reader(pcfg->readers);	// fifo reader objects, lossless
+	std::vector<struct testconsumer> cons(pcfg->readers);
+	std::vector<struct testlatency> latency(pcfg->readers);	// consumer 0 records into pres
+	std::vector<struct test07_monitor> mon(pcfg->lossy_readers);
+	std::vector<std::thread> tCons;
+	std::atomic<bool>	bStop(false);
+	struct testproducer	prod;
+	unsigned int		i;
+
+	// Init fifo
+	databuffer = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_CONSUMER);
+	if (databuffer == NULL) {
+		test_result_error(pres, "no memory for the fifo");
+		return;
+	}
+	fifo_init_create(&fifo, databuffer, pcfg->fifo_size, pcfg->bd_count, pcfg->align,
+		pcfg->fifo_flags | FIFO_FLAG_BROADCAST(pcfg->readers + pcfg->lossy_readers));
+	fifo_writer_init(&fifo_writer, &fifo);
+	for (i = 0; i < pcfg->readers; i++)
+		fifo_reader_init_broadcast(&fifo_reader[i], &fifo, i, FIFO_READER_LOSSLESS);
+	for (i = 0; i < pcfg->lossy_readers; i++)
+		fifo_reader_init_broadcast(&mon[i].reader, &fifo, pcfg->readers + i, FIFO_READER_LOSSY);
+
+	// Wake the producer and consumers when they are sleeping
+	fifo_writer_set_wakeup_handler(&fifo_writer, fifo_wait_wakeup_readers, &fifo);
+	for (i = 0; i < pcfg->readers; i++)
+		fifo_reader_set_wakeup_handler(&fifo_reader[i], fifo_wait_wakeup_writer, &fifo);
+
+	// Init test
+	testproducer_init(&prod, &fifo_writer, pcfg->count);
+	for (i = 0; i < pcfg->readers; i++) {
+		testconsumer_init(&cons[i], &fifo_reader[i], pcfg->count);
+		testconsumer_set_batch(&cons[i], pcfg->read_batch);
+		testconsumer_set_data(&cons[i], pcfg->data);
+		testlatency_init(&latency[i]);
+		if (pcfg->latency)
+			testconsumer_set_latency(&cons[i], &latency[i]);
+	}
+	for (i = 0; i < pcfg->lossy_readers; i++) {
+		mon[i].count32 = pcfg->count / 4;
+		mon[i].skip32 = pcfg->latency ? (sizeof(uint64_t) / sizeof(uint32_t)) : 0;
+		mon[i].data = pcfg->data;
+		mon[i].blocking = pcfg->blocking;
+		mon[i].pbStop = &bStop;
+		mon[i].blocks = 0;
+		mon[i].lost = 0;
+		mon[i].error = false;
+	}
+
+	// Run the test, the other consumers run next to consumer 0
+	for (i = 1; i < pcfg->readers; i++)
+		tCons.push_back(std::thread(test07_consume, &cons[i], pcfg->blocking, &bStop));
+	for (i = 0; i < pcfg->lossy_readers; i++)
+		tCons.push_back(std::thread(test07_monitor, &mon[i]));
+	run_test(pcfg, &prod, &cons[0], pres);
+
+	// Cleanup: the others stop when they are done, or when consumer 0 failed
+	if (pres->error)
+		bStop = true;
+	for (i = 1; i < pcfg->readers; i++) {
+		tCons[i-1].join();
+		if ((testconsumer_error(&cons[i]) != 0) || (testconsumer_done(&cons[i]) == 0))
+			pres->error = true;
+	}
+	bStop = true;
+	for (i = 0; i < pcfg->lossy_readers; i++) {
+		tCons[pcfg->readers - 1 + i].join();
+		std::cerr<<"lossy reader "<<i<<": blocks="<<mon[i].blocks<<" lost="<<mon[i].lost<<std::endl;
+		if (mon[i].error)
+			pres->error = true;
+	}
+
+	place_free(databuffer, pcfg->fifo_size);
+}
@@ -0,0 +1,214 @@
+#include <iostream>
+#include <vector>
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_fanin.h"
+#include "fifo_wait.h"
+
+#include "testcommon.h"
+#include "cdmasim.h"
+#include "cpipe.h"
+
+
+/*
+ * Test 08: Many producers, each with a fifo, merged into one fifo using DMA
+ *
+ * Datapath in this test:
+ *   1 - prod[0..N-1]		(testproducer)	threads producing data
+ *   2 - src[0..N-1].writer	(fifo_writer)
+ *   3 - src[0..N-1].fifo	(fifo)
+ *   4 - src[0..N-1].reader	(fifo_reader)
+ *   5 - fanin			(fifo_fanin)	thread kicking DMA controller
+ *   6 - fifo_writer		(fifo_writer)
+ *   7 - fifo			(fifo)
+ *   8 - fifo_reader		(fifo_reader)
+ *   9 - cons			(testconsumer)	thread consuming data
+ *
+ * The order of the blocks from different sources is up to the scheduler, so
+ * every block starts with the number of its source (after the timestamp).
+ * The consumer checks the incrementing numbers of every source on its own
+ * (test08_check_block).
+ *
+ * Source i has weight i+1. The bytes every source got before the first one
+ * was done show how the fan-in shared the bandwidth.
+ */
+
+struct test08_source
+{
+	uint8_t *databuffer;
+	struct fifo fifo;
+	struct fifo_writer writer;
+	struct fifo_reader reader;
+};
+
+/*
+ * Numbers of every source, checked by the testconsumer
+ */
+struct test08_sources
+{
+	enum testdata_mode data;
+	unsigned int count32;		// of every source
+	std::vector<unsigned int> expected;
+	std::vector<uint64_t> bytes;
+	std::vector<uint64_t> share;	// bytes when the first source was done
+	unsigned int done;		// sources that are done
+};
+
+
+//---------------------------------------------------------------------------
+static unsigned int
+test08_check_block(void * arg, const uint32_t * block, unsigned int size32, unsigned int first)
+{
+	struct test08_sources *psources = (struct test08_sources *)arg;
+	unsigned int id = block[first];
+
+	if (id >= psources->expected.size())
+		return 0;
+
+	// The last block of a source may be longer than its numbers
+	if (size32 > (psources->count32 - psources->expected[id]))
+		size32 = psources->count32 - psources->expected[id];
+	if (size32 == 0)
+		return 0;
+
+	// Skip the source number
+	if (testdata_check(psources->data, block, size32, psources->expected[id], first + 1) == 0)
+		return 0;
+	psources->expected[id] += size32;
+	psources->bytes[id] += size32 * sizeof(uint32_t);
+
+	if (psources->expected[id] == psources->count32) {
+		if (psources->done++ == 0)
+			psources->share = psources->bytes;
+	}
+
+	return size32;
+}
+
+//---------------------------------------------------------------------------
+const char *
+test08_check(const struct test_config * pcfg)
+{
+	if ((pcfg->producers == 0) || (pcfg->count / 4 / pcfg->producers == 0))
+		return "needs at least one producer, with data";
+	if ((pcfg->readers != 1) || (pcfg->lossy_readers != 0))
+		return "only one reader";
+	if ((pcfg->hops != 1) || (pcfg->pipe_workers != 0) || (pcfg->pipe_mode != FIFO_PIPE_COPY))
+		return "hops, workers and handoff only for the chain";
+	if (pcfg->block_size < (pcfg->latency ? 4 : 2) * sizeof(uint32_t))
+		return "block_size too small for the source number";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+void
+test08(const struct test_config * pcfg, struct test_result * pres)
+{
+	std::vector<struct test08_source> src(pcfg->producers);
+	std::vector<struct testproducer> prod(pcfg->producers);
+
+	uint8_t			*databuffer;		// fifo data
+	struct fifo		fifo;			// fifo object
+	struct fifo_writer	fifo_writer;		// fifo writer object
+	struct fifo_reader	fifo_reader;		// fifo reader object
+
+	struct fifo_fanin	fanin;			// fan-in from all sources into fifo
+
+	struct testconsumer	cons;
+	struct test08_sources	sources;
+	unsigned int		count32 = pcfg->count / 4 / pcfg->producers;
+	unsigned int		i;
+	bool			bAlloc;
+
+	// Allocate the merged fifo and the source fifos
+	databuffer = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PIPE, PLACE_CONSUMER);
+	bAlloc = (databuffer != NULL);
+	for (i = 0; i < pcfg->producers; i++) {
+		src[i].databuffer = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, PLACE_PRODUCER, PLACE_PIPE);
+		bAlloc = bAlloc && (src[i].databuffer != NULL);
+	}
+	if (bAlloc == false) {
+		for (i = 0; i < pcfg->producers; i++)
+			place_free(src[i].databuffer, pcfg->fifo_size);
+		place_free(databuffer, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fifos");
+		return;
+	}
+
+	// Init merged fifo
+	fifo_init_create(&fifo, databuffer, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+	fifo_writer_init(&fifo_writer, &fifo);
+	fifo_reader_init(&fifo_reader, &fifo);
+
+	// Init source fifos, and the fan-in
+	if (fifo_fanin_init(&fanin, &fifo_writer, pcfg->producers) != 0) {
+		for (i = 0; i < pcfg->producers; i++)
+			place_free(src[i].databuffer, pcfg->fifo_size);
+		place_free(databuffer, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fan-in");
+		return;
+	}
+	for (i = 0; i < pcfg->producers; i++) {
+		fifo_init_create(&src[i].fifo, src[i].databuffer, pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+		fifo_writer_init(&src[i].writer, &src[i].fifo);
+		fifo_reader_init(&src[i].reader, &src[i].fifo);
+		fifo_reader_set_wakeup_handler(&src[i].reader, fifo_wait_wakeup_writer, &src[i].fifo);
+
+		bAlloc = (fifo_fanin_add_source(&fanin, &src[i].reader, i + 1) >= 0) && bAlloc;
+	}
+	if (bAlloc == false) {
+		fifo_fanin_deinit(&fanin);
+		for (i = 0; i < pcfg->producers; i++)
+			place_free(src[i].databuffer, pcfg->fifo_size);
+		place_free(databuffer, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fan-in sources");
+		return;
+	}
+	fifo_fanin_set_window(&fanin, pcfg->pipe_window);
+	fifo_fanin_set_transfer(&fanin, cdmasim_transfer_ee);	// one DMA for all sources keeps them in order
+
+	// Create and hookup thread for the fan-in
+	CPipe cfanin("Fanin", &fanin);
+	for (i = 0; i < pcfg->producers; i++)
+		fifo_writer_set_wakeup_handler(&src[i].writer, CPipe::wakeup, &cfanin);
+	fifo_reader_set_wakeup_handler(&fifo_reader, CPipe::wakeup, &cfanin);
+	fifo_fanin_set_wakeup_handler(&fanin, CPipe::wakeup, &cfanin);
+
+	// Wake the consumer when it is sleeping
+	fifo_writer_set_wakeup_handler(&fifo_writer, fifo_wait_wakeup_reader, &fifo);
+
+	// Init test, every source has its own numbers
+	for (i = 0; i < pcfg->producers; i++) {
+		testproducer_init(&prod[i], &src[i].writer, count32 * 4);
+		testproducer_set_source(&prod[i], i);
+	}
+	sources.data = pcfg->data;
+	sources.count32 = count32;
+	sources.expected.assign(pcfg->producers, 0);
+	sources.bytes.assign(pcfg->producers, 0);
+	sources.done = 0;
+	testconsumer_init(&cons, &fifo_reader, count32 * 4 * pcfg->producers);
+	testconsumer_set_check(&cons, test08_check_block, &sources);
+
+	// Run the test
+	run_test(pcfg, &prod[0], pcfg->producers, &cons, pres);
+
+	// Cleanup: stop the fan-in, and wait for the DMA transfers it started
+	cfanin.stop();
+	dma_ee.sync();
+
+	if (sources.share.size() == pcfg->producers) {
+		std::cerr<<"share before the first source was done (weight:bytes):";
+		for (i = 0; i < pcfg->producers; i++)
+			std::cerr<<" "<<(i + 1)<<":"<<sources.share[i];
+		std::cerr<<std::endl;
+	}
+
+	fifo_fanin_deinit(&fanin);
+	for (i = 0; i < pcfg->producers; i++)
+		place_free(src[i].databuffer, pcfg->fifo_size);
+	place_free(databuffer, pcfg->fifo_size);
+}
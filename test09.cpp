@@ -0,0 +1,158 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "fifo.h"
+#include "fifo_reader.h"
+#include "fifo_writer.h"
+#include "fifo_pipe.h"
+#include "fifo_wait.h"
+
+#include "testcommon.h"
+#include "cpipe.h"
+#include "cpipeexecutor.h"
+#include "copykernel.h"
+
+
+/*
+ * Test 09: A chain of fifos, with a pipe between every two of them
+ *
+ * Datapath in this test:
+ *   1 - prod			(testproducer)	thread producing data
+ *   2 - fifo[0]		(fifo)
+ *   3 - pipe[0]		(fifo_pipe)	copy kernel (copy_transfer)
+ *   4 - fifo[1]		(fifo)
+ *       ...
+ *   5 - pipe[N-1]		(fifo_pipe)	copy kernel (copy_transfer)
+ *   6 - fifo[N]		(fifo)
+ *   7 - cons			(testconsumer)	thread consuming data
+ *
+ * The pipes run on a thread each (CPipe), or on the workers of one
+ * CPipeExecutor (pipe_workers).
+ *
+ * With pipe_mode FIFO_PIPE_HANDOFF the pipes do not copy: fifo[1] .. fifo[N]
+ * get descriptors of the data, that stays in fifo[0] until the consumer is
+ * done with it.
+ */
+
+
+//---------------------------------------------------------------------------
+const char *
+test09_check(const struct test_config * pcfg)
+{
+	if (pcfg->producers != 1)
+		return "only one producer";
+	if ((pcfg->readers != 1) || (pcfg->lossy_readers != 0))
+		return "only one reader";
+	if (pcfg->hops == 0)
+		return "needs at least one hop";
+	if ((pcfg->pipe_workers != 0) && (pcfg->hops > pcfg->pipe_workers * EXEC_QUEUE_SIZE))
+		return "more hops than the workers can run";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+void
+test09(const struct test_config * pcfg, struct test_result * pres)
+{
+	unsigned int		hops = pcfg->hops;
+	std::vector<uint8_t *>	databuffer(hops + 1);	// fifo data
+	std::vector<struct fifo> fifo(hops + 1);	// fifo objects
+	std::vector<struct fifo_writer> fifo_writer(hops + 1);
+	std::vector<struct fifo_reader> fifo_reader(hops + 1);
+	std::vector<struct fifo_pipe> fifo_pipe(hops);	// fifo pipe objects from fifo[i] -> fifo[i+1]
+
+	std::vector<CPipe *>	cpipe;			// a thread per pipe
+	CPipeExecutor		*pexec = NULL;		// or all pipes on the executor
+	SPipeTask		*ptask;
+	std::string		sName;
+
+	struct testconsumer	cons;
+	struct testproducer	prod;
+	unsigned int		i;
+	bool			bAlloc = true;
+
+	// Allocate the fifos
+	for (i = 0; i <= hops; i++) {
+		databuffer[i] = (uint8_t *)place_alloc_fifo(pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags, (i == 0) ? PLACE_PRODUCER : PLACE_PIPE, (i == hops) ? PLACE_CONSUMER : PLACE_PIPE);
+		bAlloc = bAlloc && (databuffer[i] != NULL);
+	}
+	if (bAlloc == false) {
+		for (i = 0; i <= hops; i++)
+			place_free(databuffer[i], pcfg->fifo_size);
+		test_result_error(pres, "no memory for the fifos");
+		return;
+	}
+
+	// Init fifos
+	for (i = 0; i <= hops; i++) {
+		fifo_init_create(&fifo[i], databuffer[i], pcfg->fifo_size, pcfg->bd_count, pcfg->align, pcfg->fifo_flags);
+		fifo_writer_init(&fifo_writer[i], &fifo[i]);
+		fifo_reader_init(&fifo_reader[i], &fifo[i]);
+	}
+
+	// Init fifo pipes
+	for (i = 0; i < hops; i++) {
+		bAlloc = (fifo_pipe_init(&fifo_pipe[i], &fifo_reader[i], &fifo_writer[i+1]) == 0) && bAlloc;
+		fifo_pipe_set_window(&fifo_pipe[i], pcfg->pipe_window);
+		fifo_pipe[i].fp_transfer = copy_transfer;
+		if (pcfg->pipe_mode != FIFO_PIPE_COPY)
+			fifo_pipe_set_mode(&fifo_pipe[i], (i == 0) ? FIFO_PIPE_HANDOFF : FIFO_PIPE_HANDOFF_FORWARD);
+	}
+	if (bAlloc == false) {
+		for (i = 0; i < hops; i++)
+			fifo_pipe_deinit(&fifo_pipe[i]);
+		for (i = 0; i <= hops; i++)
+			place_free(databuffer[i], pcfg->fifo_size);
+		test_result_error(pres, "no memory for the pipes");
+		return;
+	}
+
+	// Create and hookup the threads or tasks of the pipes
+	if (pcfg->pipe_workers == 0) {
+		for (i = 0; i < hops; i++) {
+			sName = "Pipe" + std::to_string(i);
+			cpipe.push_back(new CPipe(sName.c_str(), &fifo_pipe[i]));
+			fifo_writer_set_wakeup_handler(&fifo_writer[i], CPipe::wakeup, cpipe[i]);
+			fifo_reader_set_wakeup_handler(&fifo_reader[i+1], CPipe::wakeup, cpipe[i]);
+			fifo_pipe_set_wakeup_handler(&fifo_pipe[i], CPipe::wakeup, cpipe[i]);
+		}
+	}
+	else {
+		pexec = new CPipeExecutor(pcfg->pipe_workers);
+		for (i = 0; i < hops; i++) {
+			sName = "Pipe" + std::to_string(i);
+			ptask = pexec->add(sName.c_str(), &fifo_pipe[i]);
+			if (ptask == NULL)
+				break;
+			fifo_writer_set_wakeup_handler(&fifo_writer[i], CPipeExecutor::wakeup, ptask);
+			fifo_reader_set_wakeup_handler(&fifo_reader[i+1], CPipeExecutor::wakeup, ptask);
+			fifo_pipe_set_wakeup_handler(&fifo_pipe[i], CPipeExecutor::wakeup, ptask);
+		}
+	}
+
+	// Wake the producer and consumer when they are sleeping
+	fifo_reader_set_wakeup_handler(&fifo_reader[0], fifo_wait_wakeup_writer, &fifo[0]);
+	fifo_writer_set_wakeup_handler(&fifo_writer[hops], fifo_wait_wakeup_reader, &fifo[hops]);
+
+	// Init test
+	testproducer_init(&prod, &fifo_writer[0], pcfg->count);
+	testconsumer_init(&cons, &fifo_reader[hops], pcfg->count);
+	testconsumer_set_handoff(&cons, pcfg->pipe_mode != FIFO_PIPE_COPY);
+
+	// Run the test, unless the executor did not take all pipes
+	if (i == hops)
+		run_test(pcfg, &prod, &cons, pres);
+	else
+		test_result_error(pres, "the executor is full");
+
+	// Cleanup: the pipes copy synchronously or hand off, nothing is in flight when they stopped
+	for (i = 0; i < cpipe.size(); i++)
+		delete cpipe[i];
+	delete pexec;
+	for (i = 0; i < hops; i++)
+		fifo_pipe_deinit(&fifo_pipe[i]);
+	for (i = 0; i <= hops; i++)
+		place_free(databuffer[i], pcfg->fifo_size);
+}
@@ -0,0 +1,118 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string.h>
+
+#include "testcommon.h"
+#include "copykernel.h"
+
+
+/*
+ * Test 10: The copy kernel of the pipes and DMA engines, without fifos
+ *
+ * Datapath in this test:
+ *   1 - src			(buffer)	fifo_size bytes, filled with a pattern
+ *   2 - copy			(copy kernel)	thread copying block_size at a time
+ *   3 - dst			(buffer)	fifo_size bytes
+ *
+ * The blocks start at offset align of both buffers and follow each other at
+ * align, like in a fifo. They wrap around to the start when the buffer is
+ * full, until count bytes are copied.
+ */
+
+
+//---------------------------------------------------------------------------
+const char *
+test10_check(const struct test_config * pcfg)
+{
+	const char * sError = test_check_point_to_point(pcfg);
+
+	if (sError != NULL)
+		return sError;
+	if (pcfg->fifo_size < (2 * pcfg->align + pcfg->block_size))
+		return "fifo_size too small for one block";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+static void
+thr_copy(const struct test_config * pcfg, uint8_t * dst, const uint8_t * src, struct test_result * pres, size_t * pend)
+{
+	fp_copy fp = copy_select(pcfg->copy, pcfg->block_size);
+	size_t stride = (pcfg->block_size + (pcfg->align - 1)) & ~(size_t)(pcfg->align - 1);
+	size_t pos = pcfg->align;
+	size_t end = pos;
+	uint64_t bytes = 0;
+	uint64_t blocks = 0;
+	std::chrono::steady_clock::time_point tstart, tend;
+
+	place_thread(PLACE_PIPE);
+
+	tstart = std::chrono::steady_clock::now();
+
+	while (bytes < pcfg->count) {
+		if (pos + pcfg->block_size > pcfg->fifo_size)
+			pos = pcfg->align;
+
+		fp(dst + pos, src + pos, pcfg->block_size);
+
+		if (pos + pcfg->block_size > end)
+			end = pos + pcfg->block_size;
+		pos += stride;
+		bytes += pcfg->block_size;
+		blocks++;
+	}
+
+	tend = std::chrono::steady_clock::now();
+
+	pres->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tend - tstart).count();
+	pres->bytes   = bytes;
+	pres->blocks  = blocks;
+	*pend = end;
+}
+
+//---------------------------------------------------------------------------
+void
+test10(const struct test_config * pcfg, struct test_result * pres)
+{
+	uint8_t			*src;			// source buffer
+	uint8_t			*dst;			// destination buffer
+	size_t			stride = (pcfg->block_size + (pcfg->align - 1)) & ~(size_t)(pcfg->align - 1);
+	size_t			end = 0;		// end of the copied blocks
+	size_t			i;
+
+	// Init buffers, both touched so the copy does not measure page faults
+	src = (uint8_t *)place_alloc(pcfg->fifo_size, PLACE_PIPE, PLACE_PIPE);
+	dst = (uint8_t *)place_alloc(pcfg->fifo_size, PLACE_PIPE, PLACE_PIPE);
+	if ((src == NULL) || (dst == NULL)) {
+		place_free(dst, pcfg->fifo_size);
+		place_free(src, pcfg->fifo_size);
+		test_result_error(pres, "no memory for the buffers");
+		return;
+	}
+	for (i = 0; i < pcfg->fifo_size; i++)
+		src[i] = (uint8_t)(i * 7 + (i >> 8));
+	memset(dst, 0, pcfg->fifo_size);
+
+	testlatency_init(&pres->latency);
+
+	// Run the test
+	std::thread tCopy(thr_copy, pcfg, dst, src, pres, &end);
+	tCopy.join();
+
+	// Every copied block must match the source
+	pres->error = false;
+	for (i = pcfg->align; i + pcfg->block_size <= end; i += stride) {
+		if (memcmp(dst + i, src + i, pcfg->block_size) != 0) {
+			pres->error = true;
+			break;
+		}
+	}
+
+	std::cerr<<"Done, copied "<<pres->bytes<<" bytes with "<<copy_name(pcfg->copy)<<(pres->error ? ", ERROR" : "")<<std::endl;
+
+	// Cleanup
+	place_free(dst, pcfg->fifo_size);
+	place_free(src, pcfg->fifo_size);
+}
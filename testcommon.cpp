@@ -1,10 +1,18 @@
 #include <iostream>
 #include <thread>
+#include <vector>
+#include <chrono>
 
 #include "testcommon.h"
+#include "fifo_wait.h"
+
+
+/* Timeout of the blocking waits, so an error in the other thread is noticed */
+#define TEST_WAIT_TIMEOUT_NS	(100*1000*1000)
 
 
 static bool bError;
+static bool bBlocking;
 
 
 //---------------------------------------------------------------------------
@@ -12,59 +20,209 @@ void
 print_data_size(unsigned int size)
 {
 	/*if(size > (5*1024*1024*1024))
-		std::cout<<(size/(1024*1024*1024))<<"GiB";
+		std::cerr<<(size/(1024*1024*1024))<<"GiB";
 	else*/ if(size > (5*1024*1024))
-		std::cout<<(size/(1024*1024))<<"MiB";
+		std::cerr<<(size/(1024*1024))<<"MiB";
 	else if(size > (5*1024))
-		std::cout<<(size/(1024))<<"KiB";
+		std::cerr<<(size/(1024))<<"KiB";
 	else
-		std::cout<<size<<"B";
+		std::cerr<<size<<"B";
 }
 
 //---------------------------------------------------------------------------
 void
 thr_produce(struct testproducer * pprod)
 {
-	std::cout<<"producer running"<<std::endl;
+	std::cerr<<"producer running"<<std::endl;
+	place_thread(PLACE_PRODUCER);
 
 	while ((testproducer_done(pprod) == 0) && (bError == false)) {
 		testproducer_produce(pprod);
+		if (bBlocking)
+			fifo_writer_wait_free(pprod->pwriter, testproducer_min_size(pprod), TEST_WAIT_TIMEOUT_NS);
 	}
 
-	std::cout<<"producer stopping"<<std::endl;
+	std::cerr<<"producer stopping"<<std::endl;
 }
 
 //---------------------------------------------------------------------------
 void
 thr_consume(struct testconsumer * pcons)
 {
-	std::cout<<"consumer running"<<std::endl;
+	std::cerr<<"consumer running"<<std::endl;
+	place_thread(PLACE_CONSUMER);
 
 	while ((testconsumer_done(pcons) == 0) && (bError == false)) {
 		testconsumer_consume(pcons);
 		bError = testconsumer_error(pcons) != 0;
+		if ((bBlocking) && (bError == false) && (testconsumer_done(pcons) == 0))
+			fifo_reader_wait(pcons->preader, TEST_WAIT_TIMEOUT_NS);
 	}
 
-	std::cout<<"consumer stopping"<<std::endl;
+	std::cerr<<"consumer stopping"<<std::endl;
+}
+
+//---------------------------------------------------------------------------
+void
+test_config_default(struct test_config * pcfg)
+{
+	pcfg->fifo_size  = FIFO_SIZE;
+	pcfg->bd_count   = FIFO_BD_COUNT;
+	pcfg->align      = 16;
+	pcfg->fifo_flags = 0;
+	pcfg->block_size = FIFO_BLOCK_MAX_SIZE;
+	pcfg->pipe_window = 0;
+	pcfg->read_batch = 0;
+	pcfg->write_batch = 0;
+	pcfg->producers  = 1;
+	pcfg->readers    = 1;
+	pcfg->lossy_readers = 0;
+	pcfg->hops       = 1;
+	pcfg->pipe_workers = 0;
+	pcfg->pipe_mode  = FIFO_PIPE_COPY;
+	pcfg->copy       = COPY_MEMCPY;
+	pcfg->data       = TESTDATA_SCALAR;
+	pcfg->count      = TEST_COUNT;
+	pcfg->latency    = false;
+	pcfg->blocking   = false;
+}
+
+//---------------------------------------------------------------------------
+const char *
+test_config_check(const struct test_config * pcfg)
+{
+	unsigned int align = (pcfg->align < 4) ? 4 : pcfg->align;
+	unsigned int layout_align = fifo_layout_align(align, pcfg->fifo_flags);
+	unsigned int header_size = fifo_header_size(align, pcfg->fifo_flags);
+	unsigned int bdring_size = (fifo_bd_size(pcfg->fifo_flags) * pcfg->bd_count + (layout_align-1)) & ~(layout_align-1);
+
+	if ((pcfg->bd_count < 2) || (pcfg->bd_count & (pcfg->bd_count-1)))
+		return "bd_count must be a power of 2";
+	if ((pcfg->align & (pcfg->align-1)) || (pcfg->align > 0x8000))
+		return "align must be a power of 2, up to 32KiB";
+	if ((pcfg->block_size < sizeof(uint32_t)) || (pcfg->block_size > fifo_block_max_size(pcfg->fifo_flags)))
+		return "block_size out of range";
+	if (pcfg->read_batch > TESTCONSUMER_BATCH_MAX)
+		return "read_batch too big";
+	if (pcfg->write_batch > TESTPRODUCER_BATCH_MAX)
+		return "write_batch too big";
+	if ((pcfg->latency) && (pcfg->block_size < sizeof(uint64_t)))
+		return "block_size too small for latency timestamps";
+	if (pcfg->fifo_size < (header_size + bdring_size + (layout_align-1) + ((pcfg->block_size + (align-1)) & ~(align-1))))
+		return "fifo_size too small";
+	if ((pcfg->fifo_size - header_size - bdring_size) > fifo_datasize_max(pcfg->fifo_flags))
+		return "fifo_size too big";
+	if (copy_supported(pcfg->copy) == false)
+		return "copy kernel not supported by this CPU";
+
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+const char *
+test_check_point_to_point(const struct test_config * pcfg)
+{
+	if (pcfg->producers != 1)
+		return "only one producer";
+	if ((pcfg->readers != 1) || (pcfg->lossy_readers != 0))
+		return "only one reader";
+	if ((pcfg->hops != 1) || (pcfg->pipe_workers != 0) || (pcfg->pipe_mode != FIFO_PIPE_COPY))
+		return "hops, workers and handoff only for the chain";
+
+	return NULL;
 }
 
 //---------------------------------------------------------------------------
 void
-run_test(struct testproducer * pprod, struct testconsumer * pcons)
+test_result_error(struct test_result * pres, const char * sError)
+{
+	std::cerr<<"Not run, "<<sError<<std::endl;
+
+	pres->time_ns = 0;
+	pres->bytes   = 0;
+	pres->blocks  = 0;
+	pres->error   = true;
+	testlatency_init(&pres->latency);
+}
+
+//---------------------------------------------------------------------------
+static void
+setup_producer(const struct test_config * pcfg, struct testproducer * pprod)
+{
+	testproducer_set_block_size(pprod, pcfg->block_size);
+	testproducer_set_batch(pprod, pcfg->write_batch);
+	testproducer_set_data(pprod, pcfg->data);
+	if (pcfg->latency)
+		testproducer_set_timestamp(pprod, 1);
+}
+
+//---------------------------------------------------------------------------
+void
+run_test_producer(const struct test_config * pcfg, struct testproducer * pprod)
 {
 	bError = false;
+	bBlocking = pcfg->blocking;
+
+	setup_producer(pcfg, pprod);
+	thr_produce(pprod);
+}
 
-	std::thread tProd(thr_produce, pprod);
+//---------------------------------------------------------------------------
+void
+run_test(const struct test_config * pcfg, struct testproducer * pprod, struct testconsumer * pcons, struct test_result * pres)
+{
+	run_test(pcfg, pprod, (pprod != NULL) ? 1 : 0, pcons, pres);
+}
+
+//---------------------------------------------------------------------------
+void
+run_test(const struct test_config * pcfg, struct testproducer * pprod, unsigned int producers, struct testconsumer * pcons, struct test_result * pres)
+{
+	std::chrono::steady_clock::time_point tstart, tend;
+	std::vector<std::thread> tProd;
+	unsigned int produced32 = 0;
+	unsigned int i;
+
+	bError = false;
+	bBlocking = pcfg->blocking;
+
+	for (i = 0; i < producers; i++)
+		setup_producer(pcfg, &pprod[i]);
+
+	testlatency_init(&pres->latency);
+	if (pcfg->latency)
+		testconsumer_set_latency(pcons, &pres->latency);
+	testconsumer_set_batch(pcons, pcfg->read_batch);
+	testconsumer_set_data(pcons, pcfg->data);
+
+	tstart = std::chrono::steady_clock::now();
+
+	for (i = 0; i < producers; i++)
+		tProd.push_back(std::thread(thr_produce, &pprod[i]));
 	std::thread tCons(thr_consume, pcons);
 
-	tProd.join();
+	for (i = 0; i < producers; i++)
+		tProd[i].join();
 	tCons.join();
 
-	std::cout<<"Done, produced: ";
-	print_data_size(pprod->actual32*4);
-	std::cout<<    ", consumed: ";
+	tend = std::chrono::steady_clock::now();
+
+	pres->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tend - tstart).count();
+	pres->bytes   = (uint64_t)pcons->actual32 * 4;
+	pres->blocks  = pcons->blocks;
+	pres->error   = bError;
+
+	std::cerr<<"Done, ";
+	if (producers != 0) {
+		for (i = 0; i < producers; i++)
+			produced32 += pprod[i].actual32;
+		std::cerr<<"produced: ";
+		print_data_size(produced32*4);
+		std::cerr<<", ";
+	}
+	std::cerr<<"consumed: ";
 	print_data_size(pcons->actual32*4);
 	if (bError == true)
-		std::cout<<", ERROR@nr"<<pcons->actual32;
-	std::cout<<std::endl;
+		std::cerr<<", ERROR@nr"<<pcons->actual32;
+	std::cerr<<std::endl;
 }
@@ -2,14 +2,84 @@
 #define TESTCOMMON_H
 
 
+#include <stdint.h>
+
 #include "testproducer.h"
 #include "testconsumer.h"
+#include "placement.h"
+#include "copykernel.h"
 
 
 #define TEST_COUNT (1024*1024*1024)
 
+/* First argument of the producer process of test04 (see test04_producer_main) */
+#define TEST04_PRODUCER_OPTION	"--test04-producer"
+
+
+/*
+ * Parameters of a single test run
+ */
+struct test_config
+{
+	unsigned int fifo_size;		// size of each fifo in bytes (header + bdring + data)
+	unsigned int bd_count;		// number of buffer descriptors in each fifo
+	unsigned int align;		// alignment of the blocks in each fifo
+	unsigned int fifo_flags;	// FIFO_FLAG_* options of each fifo
+	unsigned int block_size;	// maximum size of a block written by the producer
+	unsigned int pipe_window;	// outstanding transfers per fifo_pipe, 0 for no limit
+	unsigned int read_batch;	// blocks consumed at once, 0 for one at a time
+	unsigned int write_batch;	// blocks produced at once, 0 for one at a time
+	unsigned int producers;		// number of producer threads, only for fifo_mpsc and fifo_fanin
+	unsigned int readers;		// number of lossless readers, more than 1 for a broadcast fifo
+	unsigned int lossy_readers;	// number of lossy readers of a broadcast fifo
+	unsigned int hops;		// number of pipes in a chain of fifos
+	unsigned int pipe_workers;	// threads of a CPipeExecutor, 0 for a CPipe thread per pipe
+	enum fifo_pipe_mode pipe_mode;	// FIFO_PIPE_COPY, or FIFO_PIPE_HANDOFF to pass descriptors instead of data
+	ECopyKernel copy;		// copy kernel of the copying pipes and the DMA engines
+	enum testdata_mode data;	// how producer and consumer generate and check the payload (testdata.h)
+	unsigned int count;		// number of bytes to transfer
+	bool latency;			// timestamp every block and record the latency
+	bool blocking;			// producer and consumer sleep when they can not continue (fifo_wait.h)
+};
+
+/*
+ * Measured results of a single test run
+ */
+struct test_result
+{
+	uint64_t time_ns;		// time from starting the producer until the consumer is done
+	uint64_t bytes;			// number of bytes consumed
+	uint64_t blocks;		// number of blocks consumed
+	bool error;			// consumer detected corrupt data
+	struct testlatency latency;	// producer commit -> consumer get, when enabled
+};
+
+
+void test_config_default(struct test_config * pcfg);
+const char * test_config_check(const struct test_config * pcfg);
+const char * test_check_point_to_point(const struct test_config * pcfg);
+void run_test(const struct test_config * pcfg, struct testproducer * pprod, struct testconsumer * pcons, struct test_result * pres);
+void run_test(const struct test_config * pcfg, struct testproducer * pprod, unsigned int producers, struct testconsumer * pcons, struct test_result * pres);
+void run_test_producer(const struct test_config * pcfg, struct testproducer * pprod);
+void test_result_error(struct test_result * pres, const char * sError);
 
-void run_test(struct testproducer * pprod, struct testconsumer * pcons);
+void test01(const struct test_config * pcfg, struct test_result * pres);
+void test02(const struct test_config * pcfg, struct test_result * pres);
+void test03(const struct test_config * pcfg, struct test_result * pres);
+void test04(const struct test_config * pcfg, struct test_result * pres);
+int test04_producer_main(int argc, char * argv[]);
+void test05(const struct test_config * pcfg, struct test_result * pres);
+const char * test05_check(const struct test_config * pcfg);
+void test06(const struct test_config * pcfg, struct test_result * pres);
+const char * test06_check(const struct test_config * pcfg);
+void test07(const struct test_config * pcfg, struct test_result * pres);
+const char * test07_check(const struct test_config * pcfg);
+void test08(const struct test_config * pcfg, struct test_result * pres);
+const char * test08_check(const struct test_config * pcfg);
+void test09(const struct test_config * pcfg, struct test_result * pres);
+const char * test09_check(const struct test_config * pcfg);
+void test10(const struct test_config * pcfg, struct test_result * pres);
+const char * test10_check(const struct test_config * pcfg);
 
 
 #endif // TESTCOMMON_H